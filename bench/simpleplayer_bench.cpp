@@ -0,0 +1,503 @@
+#include "directoryscanner.h"
+#include "fileexplorermodel.h"
+#include "metadata.h"
+#include "playlistmodel.h"
+#include "shuffleorder.h"
+#include "trackstore.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include <QtTest>
+#include <cstring>
+#include <iterator>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Benchmarks for the paths that have to scale with the library: playlist
+// inserts, removals, data(), sorting and search from 10k to 1M rows, the
+// shuffle order, extension checks, directory listing and tag reading,
+// and the resident memory of a playlist held as a TrackStore against the
+// plain QList<Metadata> it replaced.
+//
+// Runs under Qt Test, so the usual options apply (-iterations, -callgrind,
+// function names to pick benchmarks). Results are also written as JSON, to
+// the file given with --json or simpleplayer_bench.json, one entry per
+// benchmark and data row, so runs from different commits can be diffed.
+//
+// readMetadata runs over SIMPLEPLAYER_BENCH_CORPUS when it names a
+// directory of audio files, and over generated WAV files otherwise.
+
+namespace {
+
+const char *const Genres[] = {"Rock", "Jazz", "Electronic", "Classical", "Hip-Hop", "Folk", "Metal", "Ambient"};
+
+// Synthetic playlist: 2000 artists with 10 albums each, unique titles and
+// paths, so the string pools look like a large real library
+Metadata makeTrack(QRandomGenerator &random, int i) {
+    const int artist = random.bounded(2000);
+    const int album = artist * 10 + random.bounded(10);
+
+    Metadata metadata;
+    metadata.artist = QString("Artist %1").arg(artist);
+    metadata.album = QString("Album %1").arg(album);
+    metadata.title = QString("Track title %1").arg(i);
+    metadata.genre = Genres[random.bounded(int(std::size(Genres)))];
+    metadata.filePath = QString("/music/%1/%2/%3.flac").arg(metadata.artist, metadata.album).arg(i);
+    metadata.duration = 60000 + random.bounded(400000);
+    metadata.trackNumber = 1 + i % 20;
+    metadata.year = 1960 + random.bounded(60);
+    return metadata;
+}
+
+QList<Metadata> makeTracks(int count) {
+    QRandomGenerator random(42);
+    QList<Metadata> tracks;
+    tracks.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        tracks.append(makeTrack(random, i));
+    }
+    return tracks;
+}
+
+// VmRSS from /proc/self/status, or -1 where there is none
+qint64 residentBytes() {
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    while (!status.atEnd()) {
+        const QByteArray line = status.readLine();
+        if (line.startsWith("VmRSS:")) {
+            // "VmRSS:    123456 kB"
+            return line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+        }
+    }
+    return -1;
+}
+
+void addRowCounts() {
+    QTest::addColumn<int>("rows");
+    for (int rows : {10000, 100000, 1000000}) {
+        QTest::addRow("%d", rows) << rows;
+    }
+}
+
+void appendChunk(QByteArray &out, const char *id, const QByteArray &body) {
+    const quint32 length = body.size();
+    out.append(id, 4);
+    out.append(reinterpret_cast<const char*>(&length), 4);
+    out.append(body);
+    if (body.size() & 1) {
+        out.append('\0');
+    }
+}
+
+// A short 8 kHz mono WAV with RIFF INFO tags, which TagParser reads
+// without the multimedia backend
+QByteArray makeWav(int index) {
+    QByteArray info("INFO");
+    auto addField = [&info](const char *id, const QByteArray &value) {
+        appendChunk(info, id, value + '\0');
+    };
+    addField("INAM", QByteArray("Generated title ") + QByteArray::number(index));
+    addField("IART", QByteArray("Generated artist ") + QByteArray::number(index % 50));
+    addField("IPRD", QByteArray("Generated album ") + QByteArray::number(index % 200));
+    addField("ITRK", QByteArray::number(1 + index % 12));
+
+    QByteArray format(16, '\0');
+    const quint16 pcm = 1, channels = 1, blockAlign = 1, bitsPerSample = 8;
+    const quint32 sampleRate = 8000, byteRate = 8000;
+    memcpy(format.data(), &pcm, 2);
+    memcpy(format.data() + 2, &channels, 2);
+    memcpy(format.data() + 4, &sampleRate, 4);
+    memcpy(format.data() + 8, &byteRate, 4);
+    memcpy(format.data() + 12, &blockAlign, 2);
+    memcpy(format.data() + 14, &bitsPerSample, 2);
+
+    QByteArray body("WAVE");
+    appendChunk(body, "fmt ", format);
+    appendChunk(body, "LIST", info);
+    appendChunk(body, "data", QByteArray(8000, char(0x80)));
+
+    QByteArray wav;
+    appendChunk(wav, "RIFF", body);
+    return wav;
+}
+
+} // namespace
+
+class SimplePlayerBench : public QObject {
+    Q_OBJECT
+
+private slots:
+    void addTrack_data() { addRowCounts(); }
+    void addTrack();
+    void addTracks_data() { addRowCounts(); }
+    void addTracks();
+    void removeTrack_data() { addRowCounts(); }
+    void removeTrack();
+    void data_data() { addRowCounts(); }
+    void data();
+    void sort_data() { addRowCounts(); }
+    void sort();
+    void search_data() { addRowCounts(); }
+    void search();
+    void shuffleNext_data() { addRowCounts(); }
+    void shuffleNext();
+    void shuffleInsert_data() { addRowCounts(); }
+    void shuffleInsert();
+    void isAudioFile();
+    void listDirectoryTree();
+    void scanDirectoryTree();
+    void readMetadata();
+    void memory_data();
+    void memory();
+
+private:
+    // 100 directories of 100 files, half of them audio
+    bool makeTree(QTemporaryDir &root);
+
+    // Resident growth of the TrackStore rows, keyed by row count, for the
+    // QList<Metadata> rows that follow them to compare against
+    QHash<int, qint64> compactBytes;
+};
+
+void SimplePlayerBench::addTrack() {
+    QFETCH(int, rows);
+    const QList<Metadata> tracks = makeTracks(rows);
+
+    QBENCHMARK {
+        PlaylistModel model;
+        for (const Metadata &metadata : tracks) {
+            model.addTrack(metadata);
+        }
+    }
+}
+
+void SimplePlayerBench::addTracks() {
+    QFETCH(int, rows);
+    const QList<Metadata> tracks = makeTracks(rows);
+
+    QBENCHMARK {
+        PlaylistModel model;
+        model.addTracks(tracks);
+    }
+}
+
+void SimplePlayerBench::removeTrack() {
+    QFETCH(int, rows);
+    PlaylistModel model;
+    model.addTracks(makeTracks(rows));
+
+    // Removals from the middle move half of the records each time
+    QBENCHMARK_ONCE {
+        for (int i = 0; i < 100; ++i) {
+            model.removeTrack(model.rowCount() / 2);
+        }
+    }
+}
+
+void SimplePlayerBench::data() {
+    QFETCH(int, rows);
+    PlaylistModel model;
+    model.addTracks(makeTracks(rows));
+
+    // What a view asks for when every row scrolls past once
+    int valid = 0;
+    QBENCHMARK {
+        for (int row = 0; row < model.rowCount(); ++row) {
+            for (int column = 0; column < PlaylistModel::ColumnCount; ++column) {
+                valid += model.data(model.index(row, column)).isValid();
+            }
+        }
+    }
+    QVERIFY(valid > 0);
+}
+
+void SimplePlayerBench::sort() {
+    QFETCH(int, rows);
+    PlaylistModel model;
+    model.addTracks(makeTracks(rows));
+
+    // The first sort also builds the collation ranks
+    QBENCHMARK_ONCE {
+        model.sort(PlaylistModel::ColumnArtist, Qt::AscendingOrder);
+    }
+}
+
+void SimplePlayerBench::search() {
+    QFETCH(int, rows);
+    PlaylistModel model;
+    model.addTracks(makeTracks(rows));
+    model.search("warm up");
+
+    QBENCHMARK {
+        model.search("artist 12 album");
+    }
+}
+
+void SimplePlayerBench::shuffleNext() {
+    QFETCH(int, rows);
+    ShuffleOrder order;
+    order.reset(rows);
+
+    // One full pass through the playlist the way peekNextTrackIndex steps
+    int current = order.rowAt(0);
+    QBENCHMARK {
+        for (int i = 0; i < rows; ++i) {
+            current = order.rowAt((order.positionOf(current) + 1) % order.size());
+        }
+    }
+    QVERIFY(current >= 0);
+}
+
+void SimplePlayerBench::shuffleInsert() {
+    QFETCH(int, rows);
+
+    // Appends arriving in import-sized batches
+    QBENCHMARK {
+        ShuffleOrder order;
+        for (int first = 0; first < rows; first += 4096) {
+            order.insertRows(first, qMin(4096, rows - first), 0);
+        }
+    }
+}
+
+void SimplePlayerBench::isAudioFile() {
+    const char *const suffixes[] = {".mp3", ".FLAC", ".jpg", ".txt", ".ogg", ".cue", ".m4a", ".log"};
+    QStringList names;
+    for (int i = 0; i < 100000; ++i) {
+        names.append(QString("/music/folder %1/file %2%3").arg(i / 100).arg(i).arg(suffixes[i % 8]));
+    }
+
+    int audio = 0;
+    QBENCHMARK {
+        for (const QString &name : std::as_const(names)) {
+            audio += MetadataReader::isAudioFile(name);
+        }
+    }
+    QVERIFY(audio > 0);
+}
+
+bool SimplePlayerBench::makeTree(QTemporaryDir &root) {
+    if (!root.isValid()) {
+        return false;
+    }
+    for (int d = 0; d < 100; ++d) {
+        const QString directory = root.path() + QString("/Artist %1/Album %2").arg(d / 10).arg(d);
+        if (!QDir().mkpath(directory)) {
+            return false;
+        }
+        for (int f = 0; f < 100; ++f) {
+            QFile file(directory + QString("/%1 - Track%2").arg(f).arg(f % 2 ? ".mp3" : ".txt"));
+            if (!file.open(QIODevice::WriteOnly)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void SimplePlayerBench::listDirectoryTree() {
+    QTemporaryDir root;
+    QVERIFY(makeTree(root));
+
+    // Every directory listed the way the explorer lists an expanded one
+    int entries = 0;
+    QBENCHMARK {
+        QStringList pending = {root.path()};
+        while (!pending.isEmpty()) {
+            const QString path = pending.takeLast();
+            for (const DirectoryEntry &entry : FileExplorerModel::listDirectory(path)) {
+                ++entries;
+                if (entry.isDir) {
+                    pending.append(path + '/' + entry.name);
+                }
+            }
+        }
+    }
+    QVERIFY(entries > 0);
+}
+
+void SimplePlayerBench::scanDirectoryTree() {
+    QTemporaryDir root;
+    QVERIFY(makeTree(root));
+
+    DirectoryScanner scanner;
+    QSignalSpy finished(&scanner, &DirectoryScanner::finished);
+    QBENCHMARK {
+        finished.clear();
+        scanner.scan({root.path()});
+        QVERIFY(finished.wait(60000));
+    }
+}
+
+void SimplePlayerBench::readMetadata() {
+    QStringList files;
+    QTemporaryDir generated;
+    const QString corpus = qEnvironmentVariable("SIMPLEPLAYER_BENCH_CORPUS");
+    if (!corpus.isEmpty()) {
+        QDirIterator it(corpus, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString path = it.next();
+            if (MetadataReader::isAudioFile(path)) {
+                files.append(path);
+            }
+        }
+    } else {
+        QVERIFY(generated.isValid());
+        for (int i = 0; i < 500; ++i) {
+            QFile file(generated.path() + QString("/%1.wav").arg(i));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write(makeWav(i));
+            files.append(file.fileName());
+        }
+    }
+    if (files.isEmpty()) {
+        QSKIP("No audio files in SIMPLEPLAYER_BENCH_CORPUS");
+    }
+
+    qint64 duration = 0;
+    QBENCHMARK {
+        for (const QString &file : std::as_const(files)) {
+            duration += MetadataReader::readMetadata(file).duration;
+        }
+    }
+    QVERIFY(duration > 0);
+}
+
+void SimplePlayerBench::memory_data() {
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<bool>("compact");
+    for (int rows : {10000, 100000, 1000000}) {
+        QTest::addRow("%d TrackStore", rows) << rows << true;
+        QTest::addRow("%d QList<Metadata>", rows) << rows << false;
+    }
+}
+
+void SimplePlayerBench::memory() {
+    QFETCH(int, rows);
+    QFETCH(bool, compact);
+
+    // Memory freed by earlier benchmarks would otherwise absorb the growth
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    const qint64 before = residentBytes();
+    if (before < 0) {
+        QSKIP("VmRSS is not available on this system");
+    }
+
+    // Tracks are generated one at a time so only the playlist itself stays
+    // resident; the generated strings are freed as it goes
+    QRandomGenerator random(42);
+    TrackStore store;
+    QList<Metadata> tracks;
+    if (compact) {
+        store.reserve(rows);
+    } else {
+        tracks.reserve(rows);
+    }
+    for (int i = 0; i < rows; ++i) {
+        const Metadata metadata = makeTrack(random, i);
+        if (compact) {
+            store.append(metadata);
+        } else {
+            tracks.append(metadata);
+        }
+    }
+    const qint64 grown = residentBytes() - before;
+    QCOMPARE(store.size() + tracks.size(), rows);
+
+    // Reported as the benchmark result, so the JSON carries the RSS delta
+    qInfo("%s: %lld bytes resident, %.1f per row", QTest::currentDataTag(), grown, double(grown) / rows);
+    QTest::setBenchmarkResult(grown, QTest::BytesAllocated);
+
+    if (compact) {
+        compactBytes.insert(rows, grown);
+    } else if (compactBytes.contains(rows)) {
+        // The point of the compact store; fails the run if it regresses
+        const qint64 compactGrown = compactBytes.value(rows);
+        qInfo("%d rows: TrackStore uses %.0f%% less resident memory", rows,
+              100.0 * double(grown - compactGrown) / double(qMax<qint64>(grown, 1)));
+        QVERIFY2(compactGrown < grown, "TrackStore should be resident in less memory than QList<Metadata>");
+    }
+}
+
+// Turns the BenchmarkResult elements of Qt Test's XML log into JSON
+static bool writeJson(const QString &xmlPath, const QString &jsonPath) {
+    QFile xml(xmlPath);
+    if (!xml.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonArray results;
+    QString function;
+    QXmlStreamReader reader(&xml);
+    while (!reader.atEnd()) {
+        if (reader.readNext() != QXmlStreamReader::StartElement) {
+            continue;
+        }
+        const QXmlStreamAttributes attributes = reader.attributes();
+        if (reader.name() == QLatin1String("TestFunction")) {
+            function = attributes.value("name").toString();
+        } else if (reader.name() == QLatin1String("BenchmarkResult")) {
+            QJsonObject result;
+            result.insert("name", function);
+            result.insert("tag", attributes.value("tag").toString());
+            result.insert("metric", attributes.value("metric").toString());
+            result.insert("value", attributes.value("value").toDouble());
+            result.insert("iterations", attributes.value("iterations").toInt());
+            results.append(result);
+        }
+    }
+    if (reader.hasError()) {
+        return false;
+    }
+
+    QJsonObject root;
+    root.insert("qtVersion", QString(qVersion()));
+    root.insert("benchmarks", results);
+
+    QFile json(jsonPath);
+    return json.open(QIODevice::WriteOnly | QIODevice::Truncate)
+           && json.write(QJsonDocument(root).toJson()) >= 0;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QString jsonPath = "simpleplayer_bench.json";
+    QStringList arguments;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = QString::fromLocal8Bit(argv[++i]);
+        } else {
+            arguments.append(QString::fromLocal8Bit(argv[i]));
+        }
+    }
+
+    // Human-readable results on stdout, XML for the JSON conversion
+    QTemporaryDir logDir;
+    const QString xmlPath = logDir.path() + "/results.xml";
+    arguments << "-o" << "-,txt" << "-o" << xmlPath + ",xml";
+
+    SimplePlayerBench bench;
+    const int failures = QTest::qExec(&bench, arguments);
+    if (!writeJson(xmlPath, jsonPath)) {
+        qWarning() << "Failed to write benchmark results to" << jsonPath;
+        return failures ? failures : 1;
+    }
+    return failures;
+}
+
+#include "simpleplayer_bench.moc"
@@ -0,0 +1,55 @@
+#include "audioringbuffer.h"
+#include <algorithm>
+#include <cstring>
+
+AudioRingBuffer::AudioRingBuffer(int capacity)
+    : writeIndex(0), readIndex(0), flushRequested(false) {
+    int size = 1;
+    while (size < capacity) {
+        size *= 2;
+    }
+    buffer.reset(new qint16[size]);
+    mask = size - 1;
+}
+
+int AudioRingBuffer::availableToWrite() const {
+    const quint64 read = readIndex.load(std::memory_order_acquire);
+    return capacity() - int(writeIndex.load(std::memory_order_relaxed) - read);
+}
+
+int AudioRingBuffer::write(const qint16 *samples, int count) {
+    const quint64 write = writeIndex.load(std::memory_order_relaxed);
+    count = std::min(count, availableToWrite());
+
+    // The free space may wrap around the end of the buffer
+    const int offset = int(write & quint64(mask));
+    const int first = std::min(count, capacity() - offset);
+    std::memcpy(buffer.get() + offset, samples, size_t(first) * sizeof(qint16));
+    std::memcpy(buffer.get(), samples + first, size_t(count - first) * sizeof(qint16));
+
+    // Publishes the samples together with the new index
+    writeIndex.store(write + quint64(count), std::memory_order_release);
+    return count;
+}
+
+int AudioRingBuffer::read(qint16 *samples, int count) {
+    // The flag is checked before the write index is loaded so that the
+    // index covers everything the producer wrote before requesting the flush
+    if (flushRequested.load(std::memory_order_acquire)) {
+        readIndex.store(writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+        flushRequested.store(false, std::memory_order_release);
+        return 0;
+    }
+
+    const quint64 write = writeIndex.load(std::memory_order_acquire);
+    const quint64 read = readIndex.load(std::memory_order_relaxed);
+    count = std::min(count, int(write - read));
+    const int offset = int(read & quint64(mask));
+    const int first = std::min(count, capacity() - offset);
+    std::memcpy(samples, buffer.get() + offset, size_t(first) * sizeof(qint16));
+    std::memcpy(samples + first, buffer.get(), size_t(count - first) * sizeof(qint16));
+
+    // The space is only handed back once the samples are copied out
+    readIndex.store(read + quint64(count), std::memory_order_release);
+    return count;
+}
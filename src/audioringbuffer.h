@@ -0,0 +1,44 @@
+#ifndef AUDIORINGBUFFER_H
+#define AUDIORINGBUFFER_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <memory>
+
+// Lock-free single-producer, single-consumer ring of interleaved 16-bit
+// samples between the decode thread and the audio output thread. Indices
+// only ever grow, so they double as running sample counts: readCount()
+// tells the producer how far playback has got.
+//
+// A flush is requested by the producer and carried out by the consumer on
+// its next read, so the consumer remains the only writer of the read index.
+// The producer must not write while a flush is pending.
+class AudioRingBuffer {
+public:
+    // Capacity is rounded up to a power of two
+    explicit AudioRingBuffer(int capacity);
+
+    int capacity() const { return mask + 1; }
+
+    // Producer side
+    int availableToWrite() const;
+    int write(const qint16 *samples, int count);
+    quint64 writeCount() const { return writeIndex.load(std::memory_order_relaxed); }
+    void requestFlush() { flushRequested.store(true, std::memory_order_release); }
+    bool isFlushPending() const { return flushRequested.load(std::memory_order_acquire); }
+
+    // Consumer side; carries out a pending flush before reading
+    int read(qint16 *samples, int count);
+    quint64 readCount() const { return readIndex.load(std::memory_order_acquire); }
+
+private:
+    std::unique_ptr<qint16[]> buffer;
+    int mask;
+
+    // On separate cache lines so the two threads don't contend on one
+    alignas(64) std::atomic<quint64> writeIndex;
+    alignas(64) std::atomic<quint64> readIndex;
+    alignas(64) std::atomic<bool> flushRequested;
+};
+
+#endif // AUDIORINGBUFFER_H
@@ -0,0 +1,52 @@
+#include "directorycache.h"
+#include "trace.h"
+
+// Rough per-entry heap cost on top of the name's UTF-16 data
+static const qint64 EntryOverheadBytes = sizeof(DirectoryEntry) + 32;
+
+DirectoryCache::DirectoryCache(qint64 maxBytes)
+    : cache(maxBytes), hitCount(0), missCount(0) {
+}
+
+void DirectoryCache::setMaxBytes(qint64 maxBytes) {
+    cache.setMaxCost(maxBytes);
+}
+
+bool DirectoryCache::lookup(const QString &path, QList<DirectoryEntry> &entries, qint64 &modified) {
+    // QCache::object also marks the entry as most recently used
+    Listing *listing = cache.object(path);
+    if (!listing) {
+        ++missCount;
+        TRACE_COUNTER("explorer cache misses", qint64(missCount));
+        return false;
+    }
+    ++hitCount;
+    TRACE_COUNTER("explorer cache hits", qint64(hitCount));
+    entries = listing->entries;
+    modified = listing->modified;
+    return true;
+}
+
+void DirectoryCache::setModified(const QString &path, qint64 modified) {
+    Listing *listing = cache.object(path);
+    if (listing) {
+        listing->modified = modified;
+    }
+}
+
+void DirectoryCache::insert(const QString &path, qint64 modified, const QList<DirectoryEntry> &entries) {
+    qint64 cost = path.size() * 2 + entries.size() * EntryOverheadBytes;
+    for (const DirectoryEntry &entry : entries) {
+        cost += entry.name.size() * 2;
+    }
+
+    Listing *listing = new Listing;
+    listing->modified = modified;
+    listing->entries = entries;
+    // Takes ownership; a listing bigger than the whole cache is dropped
+    cache.insert(path, listing, cost);
+}
+
+void DirectoryCache::remove(const QString &path) {
+    cache.remove(path);
+}
@@ -0,0 +1,51 @@
+#ifndef DIRECTORYCACHE_H
+#define DIRECTORYCACHE_H
+
+#include <QCache>
+#include <QList>
+#include <QString>
+
+// One entry of a directory listing
+struct DirectoryEntry {
+    QString name;
+    bool isDir;
+
+    DirectoryEntry() : isDir(false) {}
+    DirectoryEntry(const QString &name, bool isDir) : name(name), isDir(isDir) {}
+};
+
+// LRU cache of directory listings, bounded by an estimate of the memory the
+// listings take. Each listing remembers the directory's mtime so callers can
+// serve it immediately and revalidate in the background.
+class DirectoryCache {
+public:
+    static const qint64 DefaultMaxBytes = 8 * 1024 * 1024;
+
+    explicit DirectoryCache(qint64 maxBytes = DefaultMaxBytes);
+
+    void setMaxBytes(qint64 maxBytes);
+    qint64 maxBytes() const { return cache.maxCost(); }
+    qint64 usedBytes() const { return cache.totalCost(); }
+
+    bool lookup(const QString &path, QList<DirectoryEntry> &entries, qint64 &modified);
+    void insert(const QString &path, qint64 modified, const QList<DirectoryEntry> &entries);
+    void remove(const QString &path);
+    // Updates the mtime a cached listing is revalidated against
+    void setModified(const QString &path, qint64 modified);
+    void clear() { cache.clear(); }
+
+    quint64 hits() const { return hitCount; }
+    quint64 misses() const { return missCount; }
+
+private:
+    struct Listing {
+        qint64 modified;
+        QList<DirectoryEntry> entries;
+    };
+
+    QCache<QString, Listing> cache;
+    quint64 hitCount;
+    quint64 missCount;
+};
+
+#endif // DIRECTORYCACHE_H
@@ -0,0 +1,189 @@
+#include "directoryscanner.h"
+#include "ioscheduler.h"
+#include "metadata.h"
+#include "trace.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+// How often found files are handed to the GUI thread
+static const int FlushIntervalMs = 50;
+
+DirectoryScanner::DirectoryScanner(QObject *parent)
+    : QObject(parent), pendingDirectories(0), generation(0) {
+    flushTimer.setInterval(FlushIntervalMs);
+    connect(&flushTimer, &QTimer::timeout, this, &DirectoryScanner::flush);
+}
+
+DirectoryScanner::~DirectoryScanner() {
+    ++generation;
+    IoScheduler::shared().cancel(this);
+    IoScheduler::shared().waitForDone(this);
+}
+
+void DirectoryScanner::scan(const QStringList &directories) {
+    if (directories.isEmpty()) {
+        return;
+    }
+
+    // The roots' devices are looked up on the scheduler's threads, as the
+    // stat can stall on a sleeping disk or a network mount
+    const quint64 currentGeneration = generation;
+    for (const QString &directory : directories) {
+        const QByteArray path = QFile::encodeName(directory);
+        if (addTask(currentGeneration)) {
+            IoScheduler::shared().submitPath(this, path, [this, currentGeneration, path]() {
+                scanDirectory(currentGeneration, path);
+            });
+        }
+    }
+
+    if (!flushTimer.isActive()) {
+        flushTimer.start();
+    }
+}
+
+void DirectoryScanner::cancel() {
+    if (!isBusy()) {
+        return;
+    }
+
+    // Tasks still running see the new generation, stop descending and
+    // leave the next scan's state alone, so there is nothing to wait for
+    ++generation;
+    IoScheduler::shared().cancel(this);
+    reset();
+    emit finished(true);
+}
+
+bool DirectoryScanner::isBusy() const {
+    return flushTimer.isActive();
+}
+
+void DirectoryScanner::scanDirectory(quint64 scanGeneration, const QByteArray &path) {
+    TRACE_SCOPE("DirectoryScanner::scanDirectory");
+    if (generation == scanGeneration) {
+        const int dirFd = open(path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR *dir = dirFd >= 0 ? fdopendir(dirFd) : nullptr;
+        if (!dir && dirFd >= 0) {
+            close(dirFd);
+        }
+
+        // Symlinked directories can lead back up the tree; each directory is
+        // only walked once
+        struct stat dirStat;
+        bool firstVisit = false;
+        if (dir && fstat(dirFd, &dirStat) == 0) {
+            QMutexLocker locker(&mutex);
+            if (generation == scanGeneration) {
+                firstVisit = !visited.contains({quint64(dirStat.st_dev), quint64(dirStat.st_ino)});
+                visited.insert({quint64(dirStat.st_dev), quint64(dirStat.st_ino)});
+            }
+        }
+
+        QStringList files;
+        const QByteArray prefix = path.endsWith('/') ? path : path + '/';
+        while (firstVisit && generation == scanGeneration) {
+            const struct dirent *entry = readdir(dir);
+            if (!entry) {
+                break;
+            }
+            if (entry->d_name[0] == '.') {
+                continue;  // ".", ".." and hidden entries
+            }
+
+            // Only filesystems that don't fill in d_type, and symlinks, cost a stat
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                struct stat st;
+                if (fstatat(dirFd, entry->d_name, &st, 0) != 0) {
+                    continue;  // Dangling symlink or removed meanwhile
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+
+            if (type == DT_DIR) {
+                // Queued on this directory's device; a mount point below it
+                // is listed there once before its own subtree moves over
+                submit(scanGeneration, dirStat.st_dev, prefix + entry->d_name);
+            } else if (type == DT_REG) {
+                const QString filePath = QFile::decodeName(prefix + entry->d_name);
+                if (MetadataReader::isAudioFile(filePath)) {
+                    files.append(filePath);
+                }
+            }
+        }
+        if (dir) {
+            closedir(dir);
+        }
+
+        if (!files.isEmpty()) {
+            // Keeps an album's tracks together and in order
+            std::sort(files.begin(), files.end());
+
+            QMutexLocker locker(&mutex);
+            if (generation == scanGeneration) {
+                found.append(files);
+            }
+        }
+    }
+
+    // A cancelled scan's tasks were written off by reset()
+    QMutexLocker locker(&mutex);
+    if (generation == scanGeneration) {
+        --pendingDirectories;
+    }
+}
+
+bool DirectoryScanner::addTask(quint64 scanGeneration) {
+    QMutexLocker locker(&mutex);
+    if (generation != scanGeneration) {
+        return false;
+    }
+    ++pendingDirectories;
+    return true;
+}
+
+void DirectoryScanner::submit(quint64 scanGeneration, quint64 device, const QByteArray &path) {
+    if (!addTask(scanGeneration)) {
+        return;
+    }
+    IoScheduler::shared().submit(this, device, path, [this, scanGeneration, path]() {
+        scanDirectory(scanGeneration, path);
+    });
+}
+
+void DirectoryScanner::flush() {
+    QStringList batch;
+    {
+        QMutexLocker locker(&mutex);
+        batch.swap(found);
+    }
+
+    if (!batch.isEmpty()) {
+        emit filesFound(batch);
+    }
+
+    // Every directory task has finished and its files were taken above
+    if (pendingDirectories == 0) {
+        QMutexLocker locker(&mutex);
+        if (found.isEmpty()) {
+            locker.unlock();
+            reset();
+            emit finished(false);
+        }
+    }
+}
+
+void DirectoryScanner::reset() {
+    flushTimer.stop();
+
+    QMutexLocker locker(&mutex);
+    found.clear();
+    visited.clear();
+    pendingDirectories = 0;
+}
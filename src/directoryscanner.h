@@ -0,0 +1,56 @@
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <atomic>
+
+// Walks directory trees for audio files through the I/O scheduler, one task
+// per directory, queued on the device the directory lives on. Entries are classified by readdir's d_type so regular files and
+// directories are never stat'ed. Found files are streamed back to the GUI
+// thread in batches while the walk continues; each directory's files arrive
+// together and sorted by name.
+class DirectoryScanner : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DirectoryScanner(QObject *parent = nullptr);
+    ~DirectoryScanner();
+
+    void scan(const QStringList &directories);
+    void cancel();
+    bool isBusy() const;
+
+signals:
+    void filesFound(const QStringList &files);
+    void finished(bool cancelled);
+
+private slots:
+    void flush();
+
+private:
+    void scanDirectory(quint64 generation, const QByteArray &path);
+    // Counts a task of the given scan; false if it has been cancelled
+    bool addTask(quint64 generation);
+    void submit(quint64 generation, quint64 device, const QByteArray &path);
+    void reset();
+
+    QTimer flushTimer;
+
+    // Guarded by mutex
+    QMutex mutex;
+    QStringList found;
+    QSet<QPair<quint64, quint64>> visited;  // (st_dev, st_ino) of directories, breaks symlink loops
+
+    // Tasks of the current scan; only changed under mutex, against the
+    // generation, so tasks of a cancelled scan don't count
+    std::atomic<int> pendingDirectories;
+    std::atomic<quint64> generation;
+};
+
+#endif // DIRECTORYSCANNER_H
@@ -0,0 +1,161 @@
+#include "directorywatcher.h"
+#include <QDebug>
+#include <QFile>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Events are batched over this window; it is not restarted by later events,
+// so a long copy still produces an update every window
+static const int CoalesceWindowMs = 250;
+
+static const uint32_t WatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                  | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+DirectoryWatcher::DirectoryWatcher(QObject *parent)
+    : QObject(parent), notifier(nullptr) {
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        qWarning() << "inotify is unavailable:" << strerror(errno);
+        return;
+    }
+
+    notifier = new QSocketNotifier(inotifyFd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &DirectoryWatcher::readEvents);
+
+    coalesceTimer.setSingleShot(true);
+    coalesceTimer.setInterval(CoalesceWindowMs);
+    connect(&coalesceTimer, &QTimer::timeout, this, &DirectoryWatcher::emitChanges);
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+    }
+}
+
+void DirectoryWatcher::addPath(const QString &path) {
+    if (!isValid() || path.isEmpty()) {
+        return;
+    }
+    if (useCounts.value(path) > 0) {
+        ++useCounts[path];
+        return;
+    }
+
+    const int watch = inotify_add_watch(inotifyFd, QFile::encodeName(path).constData(), WatchMask);
+    if (watch < 0) {
+        qWarning() << "Failed to watch" << path << ":" << strerror(errno);
+        return;
+    }
+    pathsByWatch.insert(watch, path);
+    watchesByPath.insert(path, watch);
+    useCounts.insert(path, 1);
+}
+
+void DirectoryWatcher::removePath(const QString &path) {
+    auto count = useCounts.find(path);
+    if (count == useCounts.end()) {
+        return;
+    }
+    if (--count.value() > 0) {
+        return;
+    }
+    useCounts.erase(count);
+
+    const int watch = watchesByPath.take(path);
+    pathsByWatch.remove(watch);
+    inotify_rm_watch(inotifyFd, watch);
+}
+
+DirectoryChange &DirectoryWatcher::changeFor(const QString &path) {
+    auto it = pendingChanges.find(path);
+    if (it == pendingChanges.end()) {
+        it = pendingChanges.insert(path, DirectoryChange());
+        it.value().path = path;
+    }
+    if (!coalesceTimer.isActive()) {
+        coalesceTimer.start();
+    }
+    return it.value();
+}
+
+void DirectoryWatcher::readEvents() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    for (;;) {
+        const ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;  // EAGAIN: drained
+        }
+
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                emit overflowed();
+                continue;
+            }
+
+            const QString path = pathsByWatch.value(event->wd);
+            if (path.isEmpty()) {
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED) {
+                // The kernel dropped the watch (directory deleted or unmounted)
+                pathsByWatch.remove(event->wd);
+                watchesByPath.remove(path);
+                useCounts.remove(path);
+                continue;
+            }
+            if (event->len == 0) {
+                continue;  // Events about the directory itself
+            }
+
+            const QString name = QFile::decodeName(event->name);
+            const bool isDir = event->mask & IN_ISDIR;
+            DirectoryChange &change = changeFor(path);
+
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                change.added.append(DirectoryEntry(name, isDir));
+                if ((event->mask & IN_MOVED_TO) && !isDir) {
+                    change.completed.append(name);
+                }
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                // Something created and removed within one window never happened
+                bool cancelled = false;
+                for (int i = change.added.size() - 1; i >= 0; --i) {
+                    if (change.added[i].name == name) {
+                        change.added.removeAt(i);
+                        cancelled = true;
+                        break;
+                    }
+                }
+                change.completed.removeAll(name);
+                if (!cancelled) {
+                    change.removed.append(name);
+                }
+            } else if ((event->mask & IN_CLOSE_WRITE) && !change.completed.contains(name)) {
+                change.completed.append(name);
+            }
+        }
+    }
+}
+
+void DirectoryWatcher::emitChanges() {
+    QList<DirectoryChange> changes;
+    changes.reserve(pendingChanges.size());
+    for (const DirectoryChange &change : std::as_const(pendingChanges)) {
+        if (!change.added.isEmpty() || !change.removed.isEmpty() || !change.completed.isEmpty()) {
+            changes.append(change);
+        }
+    }
+    pendingChanges.clear();
+
+    if (!changes.isEmpty()) {
+        emit directoriesChanged(changes);
+    }
+}
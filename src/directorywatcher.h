@@ -0,0 +1,58 @@
+#ifndef DIRECTORYWATCHER_H
+#define DIRECTORYWATCHER_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QTimer>
+#include "directorycache.h"
+
+// Everything that happened to one directory during a coalescing window
+struct DirectoryChange {
+    QString path;
+    QList<DirectoryEntry> added;  // Created or moved in
+    QStringList removed;          // Deleted or moved out
+    QStringList completed;        // Files closed after writing, or moved in whole
+};
+
+// inotify-based watcher for a set of directories (not recursive). Bursts of
+// events, such as a large copy, are coalesced into one batch per window and
+// reported as per-directory diffs.
+class DirectoryWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DirectoryWatcher(QObject *parent = nullptr);
+    ~DirectoryWatcher();
+
+    bool isValid() const { return inotifyFd >= 0; }
+
+    // Watches are reference counted so several users can share a directory
+    void addPath(const QString &path);
+    void removePath(const QString &path);
+
+signals:
+    void directoriesChanged(const QList<DirectoryChange> &changes);
+    // Events were lost; watched directories should be re-listed
+    void overflowed();
+
+private slots:
+    void readEvents();
+    void emitChanges();
+
+private:
+    DirectoryChange &changeFor(const QString &path);
+
+    int inotifyFd;
+    QSocketNotifier *notifier;
+    QHash<int, QString> pathsByWatch;
+    QHash<QString, int> watchesByPath;
+    QHash<QString, int> useCounts;
+
+    QHash<QString, DirectoryChange> pendingChanges;
+    QTimer coalesceTimer;
+};
+
+#endif // DIRECTORYWATCHER_H
@@ -0,0 +1,477 @@
+#include "fileexplorermodel.h"
+#include "trace.h"
+#include <QColor>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMimeData>
+#include <QSet>
+#include <QUrl>
+#include <algorithm>
+#include <iterator>
+
+FileExplorerModel::FileExplorerModel(QObject *parent)
+    : QAbstractItemModel(parent), root(nullptr), nextRequestId(0) {
+    // A couple of threads is enough; listings are I/O bound
+    listingPool.setMaxThreadCount(2);
+}
+
+FileExplorerModel::~FileExplorerModel() {
+    listingPool.clear();
+    listingPool.waitForDone();
+    delete root;
+
+    if (listingCache.hits() + listingCache.misses() > 0) {
+        qInfo() << "Directory cache:" << listingCache.hits() << "hits," << listingCache.misses() << "misses,"
+                << listingCache.usedBytes() << "bytes used";
+    }
+}
+
+void FileExplorerModel::setRootPath(const QString &path) {
+    beginResetModel();
+    delete root;
+    pendingListings.clear();
+    root = new Node();
+    root->name = path;
+    root->path = path;
+    root->isDir = true;
+    endResetModel();
+
+    startListing(root);
+}
+
+QString FileExplorerModel::rootPath() const {
+    return root ? root->path : QString();
+}
+
+QString FileExplorerModel::filePath(const QModelIndex &index) const {
+    Node *node = nodeFromIndex(index);
+    return node && !node->placeholder ? node->path : QString();
+}
+
+bool FileExplorerModel::isDir(const QModelIndex &index) const {
+    Node *node = nodeFromIndex(index);
+    return node && node->isDir;
+}
+
+void FileExplorerModel::applyChanges(const QList<DirectoryChange> &changes) {
+    // Same order as QDir's default Name | IgnoreCase sort
+    auto listingOrder = [](const DirectoryEntry &a, const DirectoryEntry &b) {
+        return QString::compare(a.name, b.name, Qt::CaseInsensitive) < 0;
+    };
+
+    QStringList mergedPaths;
+    for (const DirectoryChange &change : changes) {
+        if (change.added.isEmpty() && change.removed.isEmpty()) {
+            continue;
+        }
+
+        Node *node = findNode(change.path);
+        if (!node || node->state == Node::Unlisted) {
+            // Not shown, so only the cached listing is stale
+            listingCache.remove(change.path);
+            continue;
+        }
+        if (node->state == Node::Listing) {
+            // The listing in flight may predate the change; list again after it
+            requestListing(node, false, 0);
+            continue;
+        }
+
+        // Rebuild the listing from the current children and the diff, then
+        // let mergeListing touch only the rows that differ
+        const QSet<QString> removed(change.removed.constBegin(), change.removed.constEnd());
+        QSet<QString> existing;
+        QList<DirectoryEntry> entries;
+        entries.reserve(node->children.size());
+        for (const Node *child : std::as_const(node->children)) {
+            if (!child->placeholder && !removed.contains(child->name)) {
+                entries.append(DirectoryEntry(child->name, child->isDir));
+                existing.insert(child->name);
+            }
+        }
+
+        QList<DirectoryEntry> added;
+        for (const DirectoryEntry &entry : change.added) {
+            if (existing.contains(entry.name)) {
+                // Replaced in place; only the type can have changed
+                for (DirectoryEntry &current : entries) {
+                    if (current.name == entry.name) {
+                        current.isDir = entry.isDir;
+                        break;
+                    }
+                }
+            } else {
+                existing.insert(entry.name);
+                added.append(entry);
+            }
+        }
+        std::sort(added.begin(), added.end(), listingOrder);
+
+        QList<DirectoryEntry> listing;
+        listing.reserve(entries.size() + added.size());
+        std::merge(entries.constBegin(), entries.constEnd(), added.constBegin(), added.constEnd(),
+                   std::back_inserter(listing), listingOrder);
+
+        // The mtime follows from the listing threads; until then the entry
+        // never matches, so a revalidation lists the directory again
+        listingCache.insert(node->path, -1, listing);
+        mergeListing(node, listing);
+        mergedPaths.append(node->path);
+    }
+
+    // Statting here would stall this thread on a slow mount
+    if (!mergedPaths.isEmpty()) {
+        listingPool.start([this, mergedPaths]() {
+            QList<qint64> modified;
+            modified.reserve(mergedPaths.size());
+            for (const QString &path : mergedPaths) {
+                modified.append(directoryModified(path));
+            }
+            QMetaObject::invokeMethod(this, [this, mergedPaths, modified]() {
+                for (int i = 0; i < mergedPaths.size(); ++i) {
+                    listingCache.setModified(mergedPaths[i], modified[i]);
+                }
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void FileExplorerModel::refresh() {
+    if (!root) {
+        return;
+    }
+
+    QList<Node*> stack = {root};
+    while (!stack.isEmpty()) {
+        Node *node = stack.takeLast();
+        if (node->state != Node::Listed) {
+            continue;
+        }
+        for (Node *child : std::as_const(node->children)) {
+            if (child->isDir) {
+                stack.append(child);
+            }
+        }
+        listingCache.remove(node->path);
+        requestListing(node, false, 0);
+    }
+}
+
+void FileExplorerModel::setCacheLimit(qint64 bytes) {
+    listingCache.setMaxBytes(bytes);
+}
+
+QList<DirectoryEntry> FileExplorerModel::listDirectory(const QString &path) {
+    TRACE_SCOPE("FileExplorerModel::listDirectory");
+    QDir dir(path);
+    dir.setFilter(QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
+
+    QList<DirectoryEntry> entries;
+    const QFileInfoList infos = dir.entryInfoList();
+    entries.reserve(infos.size());
+    for (const QFileInfo &fileInfo : infos) {
+        entries.append(DirectoryEntry(fileInfo.fileName(), fileInfo.isDir()));
+    }
+    return entries;
+}
+
+qint64 FileExplorerModel::directoryModified(const QString &path) {
+    return QFileInfo(path).lastModified().toMSecsSinceEpoch();
+}
+
+FileExplorerModel::Node *FileExplorerModel::findNode(const QString &path) const {
+    if (!root) {
+        return nullptr;
+    }
+    if (path == root->path) {
+        return root;
+    }
+
+    const QString prefix = root->path.endsWith('/') ? root->path : root->path + '/';
+    if (!path.startsWith(prefix)) {
+        return nullptr;
+    }
+
+    Node *node = root;
+    const QStringList components = path.mid(prefix.size()).split('/', Qt::SkipEmptyParts);
+    for (const QString &component : components) {
+        Node *next = nullptr;
+        for (Node *child : std::as_const(node->children)) {
+            if (!child->placeholder && child->name == component) {
+                next = child;
+                break;
+            }
+        }
+        if (!next) {
+            return nullptr;
+        }
+        node = next;
+    }
+    return node;
+}
+
+FileExplorerModel::Node *FileExplorerModel::nodeFromIndex(const QModelIndex &index) const {
+    if (!index.isValid()) {
+        return root;
+    }
+    return static_cast<Node*>(index.internalPointer());
+}
+
+QModelIndex FileExplorerModel::indexForNode(Node *node) const {
+    if (!node || node == root) {
+        return QModelIndex();
+    }
+    return createIndex(node->row, 0, node);
+}
+
+QModelIndex FileExplorerModel::index(int row, int column, const QModelIndex &parent) const {
+    Node *parentNode = nodeFromIndex(parent);
+    if (!parentNode || column != 0 || row < 0 || row >= parentNode->children.size()) {
+        return QModelIndex();
+    }
+    return createIndex(row, 0, parentNode->children[row]);
+}
+
+QModelIndex FileExplorerModel::parent(const QModelIndex &child) const {
+    Node *node = nodeFromIndex(child);
+    if (!node || node == root) {
+        return QModelIndex();
+    }
+    return indexForNode(node->parent);
+}
+
+int FileExplorerModel::rowCount(const QModelIndex &parent) const {
+    Node *node = nodeFromIndex(parent);
+    return node ? node->children.size() : 0;
+}
+
+int FileExplorerModel::columnCount(const QModelIndex &parent) const {
+    Q_UNUSED(parent);
+    return 1;
+}
+
+QVariant FileExplorerModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid()) {
+        return QVariant();
+    }
+    Node *node = nodeFromIndex(index);
+
+    if (role == Qt::DisplayRole) {
+        return node->placeholder ? QString("Loading...") : node->name;
+    } else if (role == Qt::UserRole) {
+        return filePath(index);
+    } else if (role == Qt::ForegroundRole && node->placeholder) {
+        return QColor(Qt::gray);
+    }
+    return QVariant();
+}
+
+QVariant FileExplorerModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (section == 0 && orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        return "Files";
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags FileExplorerModel::flags(const QModelIndex &index) const {
+    Node *node = nodeFromIndex(index);
+    if (!index.isValid() || node->placeholder) {
+        return Qt::NoItemFlags;
+    }
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled;
+}
+
+bool FileExplorerModel::hasChildren(const QModelIndex &parent) const {
+    Node *node = nodeFromIndex(parent);
+    if (!node || !node->isDir) {
+        return false;
+    }
+    // Unlisted directories show an expander until we know they are empty
+    return node->state != Node::Listed || !node->children.isEmpty();
+}
+
+bool FileExplorerModel::canFetchMore(const QModelIndex &parent) const {
+    Node *node = nodeFromIndex(parent);
+    return node && node->isDir && node->state == Node::Unlisted;
+}
+
+void FileExplorerModel::fetchMore(const QModelIndex &parent) {
+    Node *node = nodeFromIndex(parent);
+    if (node && node->isDir && node->state == Node::Unlisted) {
+        startListing(node);
+    }
+}
+
+QStringList FileExplorerModel::mimeTypes() const {
+    return {"text/uri-list"};
+}
+
+QMimeData *FileExplorerModel::mimeData(const QModelIndexList &indexes) const {
+    QMimeData *mimeData = new QMimeData();
+    QList<QUrl> urls;
+
+    for (const QModelIndex &index : indexes) {
+        QString path = filePath(index);
+        if (!path.isEmpty()) {
+            urls.append(QUrl::fromLocalFile(path));
+        }
+    }
+
+    if (!urls.isEmpty()) {
+        mimeData->setUrls(urls);
+    }
+
+    return mimeData;
+}
+
+void FileExplorerModel::startListing(Node *node) {
+    node->state = Node::Listing;
+
+    // A cached listing is shown right away and only revalidated in the
+    // background; otherwise a placeholder stands in until the listing arrives
+    QList<DirectoryEntry> cached;
+    qint64 cachedModified = 0;
+    const bool cacheHit = listingCache.lookup(node->path, cached, cachedModified);
+    if (cacheHit) {
+        mergeListing(node, cached);
+        node->state = Node::Listed;
+    } else {
+        Node *placeholder = new Node();
+        placeholder->placeholder = true;
+        placeholder->parent = node;
+        beginInsertRows(indexForNode(node), 0, 0);
+        node->children.prepend(placeholder);
+        endInsertRows();
+    }
+
+    requestListing(node, cacheHit, cachedModified);
+}
+
+void FileExplorerModel::requestListing(Node *node, bool cacheHit, qint64 cachedModified) {
+    const quint64 requestId = nextRequestId++;
+    node->listingRequest = requestId;
+    pendingListings.insert(requestId, node);
+
+    const QString path = node->path;
+    listingPool.start([this, requestId, path, cacheHit, cachedModified]() {
+        // Stat before listing so a change made while listing shows up next time
+        const qint64 modified = directoryModified(path);
+        if (cacheHit && modified == cachedModified) {
+            QMetaObject::invokeMethod(this, [this, requestId]() {
+                pendingListings.remove(requestId);
+            }, Qt::QueuedConnection);
+            return;
+        }
+
+        const QList<DirectoryEntry> entries = listDirectory(path);
+        QMetaObject::invokeMethod(this, [this, requestId, modified, entries]() {
+            applyListing(requestId, modified, entries);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void FileExplorerModel::applyListing(quint64 requestId, qint64 modified, const QList<DirectoryEntry> &entries) {
+    TRACE_SCOPE("FileExplorerModel::applyListing");
+    // The node is gone if the root changed while the listing was running, and
+    // a listing overtaken by a newer request for the same node is stale
+    Node *node = pendingListings.take(requestId);
+    if (!node || requestId != node->listingRequest) {
+        return;
+    }
+
+    listingCache.insert(node->path, modified, entries);
+    mergeListing(node, entries);
+    node->state = Node::Listed;
+    emit directoryListed(node->path);
+}
+
+void FileExplorerModel::mergeListing(Node *node, const QList<DirectoryEntry> &entries) {
+    const QModelIndex parentIndex = indexForNode(node);
+
+    QHash<QString, bool> listed;
+    listed.reserve(entries.size());
+    for (const DirectoryEntry &entry : entries) {
+        listed.insert(entry.name, entry.isDir);
+    }
+
+    // Drop the placeholder and children that vanished or changed type,
+    // one contiguous run at a time from the back
+    auto keep = [&listed](const Node *child) {
+        auto it = listed.constFind(child->name);
+        return !child->placeholder && it != listed.constEnd() && it.value() == child->isDir;
+    };
+    for (int last = node->children.size() - 1; last >= 0; --last) {
+        if (keep(node->children[last])) {
+            continue;
+        }
+        int first = last;
+        while (first > 0 && !keep(node->children[first - 1])) {
+            --first;
+        }
+        removeChildren(node, first, last);
+        last = first;
+    }
+
+    // The surviving children are in listing order, so new entries can be
+    // slotted in with a single merge walk
+    const QString prefix = node->path.endsWith('/') ? node->path : node->path + '/';
+    int row = 0;
+    int i = 0;
+    while (i < entries.size()) {
+        if (row < node->children.size() && node->children[row]->name == entries[i].name) {
+            ++row;
+            ++i;
+            continue;
+        }
+
+        int end = i;
+        while (end < entries.size()
+               && (row >= node->children.size() || entries[end].name != node->children[row]->name)) {
+            ++end;
+        }
+
+        beginInsertRows(parentIndex, row, row + (end - i) - 1);
+        for (int k = i; k < end; ++k) {
+            Node *child = new Node();
+            child->name = entries[k].name;
+            child->path = prefix + entries[k].name;
+            child->isDir = entries[k].isDir;
+            child->parent = node;
+            node->children.insert(row + (k - i), child);
+        }
+        for (int r = row; r < node->children.size(); ++r) {
+            node->children[r]->row = r;
+        }
+        endInsertRows();
+
+        row += end - i;
+        i = end;
+    }
+}
+
+void FileExplorerModel::removeChildren(Node *node, int first, int last) {
+    beginRemoveRows(indexForNode(node), first, last);
+
+    // Listings still running for anything in the removed subtrees are dropped
+    for (auto it = pendingListings.begin(); it != pendingListings.end();) {
+        const Node *pending = it.value();
+        while (pending && !(pending->parent == node && pending->row >= first && pending->row <= last)) {
+            pending = pending->parent;
+        }
+        if (pending) {
+            it = pendingListings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (int r = last; r >= first; --r) {
+        delete node->children.takeAt(r);
+    }
+    for (int r = first; r < node->children.size(); ++r) {
+        node->children[r]->row = r;
+    }
+    endRemoveRows();
+}
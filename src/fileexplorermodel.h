@@ -0,0 +1,94 @@
+#ifndef FILEEXPLORERMODEL_H
+#define FILEEXPLORERMODEL_H
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QThreadPool>
+#include <QtAlgorithms>
+#include "directorycache.h"
+#include "directorywatcher.h"
+
+// Lazy file explorer tree. A directory's children are only listed when the
+// view expands it (canFetchMore/fetchMore); the listing runs on a background
+// thread and a placeholder row is shown until it arrives. Listings seen
+// before are served from an LRU cache and revalidated against the
+// directory's mtime in the background. Changes reported by a
+// DirectoryWatcher are applied as diffs to the directories already listed.
+class FileExplorerModel : public QAbstractItemModel {
+    Q_OBJECT
+
+public:
+    explicit FileExplorerModel(QObject *parent = nullptr);
+    ~FileExplorerModel();
+
+    void setRootPath(const QString &path);
+    QString rootPath() const;
+    QString filePath(const QModelIndex &index) const;
+    bool isDir(const QModelIndex &index) const;
+
+    // Applies watcher diffs without re-listing; refresh() re-lists everything
+    // listed so far, for when the watcher lost events
+    void applyChanges(const QList<DirectoryChange> &changes);
+    void refresh();
+
+    void setCacheLimit(qint64 bytes);
+    const DirectoryCache &cache() const { return listingCache; }
+
+    // Blocking; called on the listing threads
+    static QList<DirectoryEntry> listDirectory(const QString &path);
+    static qint64 directoryModified(const QString &path);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    QStringList mimeTypes() const override;
+    QMimeData *mimeData(const QModelIndexList &indexes) const override;
+
+signals:
+    // A background listing of this directory has been merged into the tree
+    void directoryListed(const QString &path);
+
+private:
+    struct Node {
+        enum State { Unlisted, Listing, Listed };
+
+        QString name;
+        QString path;
+        bool isDir;
+        bool placeholder;
+        State state;
+        int row;
+        quint64 listingRequest;  // Latest listing requested; older ones are stale
+        Node *parent;
+        QList<Node*> children;
+
+        Node() : isDir(false), placeholder(false), state(Unlisted), row(0), listingRequest(0), parent(nullptr) {}
+        ~Node() { qDeleteAll(children); }
+    };
+
+    Node *nodeFromIndex(const QModelIndex &index) const;
+    QModelIndex indexForNode(Node *node) const;
+    Node *findNode(const QString &path) const;
+    void startListing(Node *node);
+    void requestListing(Node *node, bool cacheHit, qint64 cachedModified);
+    void applyListing(quint64 requestId, qint64 modified, const QList<DirectoryEntry> &entries);
+    void mergeListing(Node *node, const QList<DirectoryEntry> &entries);
+    void removeChildren(Node *node, int first, int last);
+
+    Node *root;
+    DirectoryCache listingCache;
+    QHash<quint64, Node*> pendingListings;
+    quint64 nextRequestId;
+    QThreadPool listingPool;
+};
+
+#endif // FILEEXPLORERMODEL_H
@@ -0,0 +1,207 @@
+#include "ioscheduler.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+
+namespace {
+
+// statfs f_type of network filesystems
+const quint32 NetworkFilesystems[] = {
+    0x6969,      // NFS
+    0x517B,      // SMB
+    0xFF534D42,  // CIFS
+    0xFE534D42,  // SMB2
+    0x00C36400,  // Ceph
+    0x5346414F,  // AFS
+    0x01021997,  // 9P
+};
+
+// Network mounts are latency bound, so a few requests in flight hide the
+// round trips without flooding the server
+const int NetworkConcurrency = 4;
+
+bool readsRotational(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return file.read(1) == "1";
+}
+
+} // namespace
+
+IoScheduler &IoScheduler::shared() {
+    static IoScheduler scheduler;
+    return scheduler;
+}
+
+IoScheduler::IoScheduler() {
+    // The per-device limits do the throttling; the pool only has to be big
+    // enough for several devices to run at their limits at once
+    pool.setMaxThreadCount(qMax(16, 4 * QThread::idealThreadCount()));
+}
+
+IoScheduler::~IoScheduler() {
+    pool.waitForDone();
+}
+
+quint64 IoScheduler::deviceOf(const QByteArray &path) {
+    struct stat st;
+    return stat(path.constData(), &st) == 0 ? quint64(st.st_dev) : 0;
+}
+
+IoScheduler::DeviceClass IoScheduler::classify(quint64 device, const QByteArray &path) {
+    struct statfs fs;
+    if (statfs(path.constData(), &fs) == 0) {
+        for (quint32 type : NetworkFilesystems) {
+            if (quint32(fs.f_type) == type) {
+                return Network;
+            }
+        }
+    }
+
+    // A partition's sysfs entry has no queue of its own; its disk's is one up
+    const QString sysfs = QString("/sys/dev/block/%1:%2/").arg(major(device)).arg(minor(device));
+    if (readsRotational(sysfs + "queue/rotational") || readsRotational(sysfs + "../queue/rotational")) {
+        return Rotational;
+    }
+    return SolidState;
+}
+
+int IoScheduler::concurrencyLimit(DeviceClass deviceClass) {
+    switch (deviceClass) {
+    case Rotational:
+        // One reader at a time; anything more makes the head seek between files
+        return 1;
+    case Network:
+        return NetworkConcurrency;
+    case SolidState:
+        break;
+    }
+    return qMax(4, QThread::idealThreadCount());
+}
+
+void IoScheduler::submit(const void *owner, quint64 device, const QByteArray &sortKey, const Job &job,
+                         Priority priority) {
+    quint64 epoch;
+    {
+        QMutexLocker locker(&mutex);
+        ++pending[owner];
+        epoch = cancels.value(owner);
+    }
+    enqueue(owner, epoch, device, sortKey, job, priority);
+}
+
+void IoScheduler::submitPath(const void *owner, const QByteArray &path, const Job &job, Priority priority) {
+    // Counted as pending from here on, so waitForDone() covers the lookup
+    quint64 epoch;
+    {
+        QMutexLocker locker(&mutex);
+        ++pending[owner];
+        epoch = cancels.value(owner);
+    }
+    pool.start([this, owner, epoch, path, job, priority]() {
+        enqueue(owner, epoch, deviceOf(path), path, job, priority);
+    });
+}
+
+void IoScheduler::enqueue(const void *owner, quint64 epoch, quint64 device, const QByteArray &sortKey,
+                          const Job &job, Priority priority) {
+    // Probing a new device reads statfs and sysfs, which can stall on a
+    // slow mount, so it happens before the lock is taken. Devices are never
+    // forgotten, so one seen here is still there below.
+    bool known;
+    {
+        QMutexLocker locker(&mutex);
+        known = devices.contains(device);
+    }
+    const DeviceClass deviceClass = known ? SolidState : classify(device, sortKey);
+
+    QMutexLocker locker(&mutex);
+    // The owner cancelled while the device was looked up
+    if (cancels.value(owner) != epoch) {
+        release(owner, 1);
+        return;
+    }
+
+    auto it = devices.find(device);
+    if (it == devices.end()) {
+        Device state;
+        state.deviceClass = deviceClass;
+        state.limit = concurrencyLimit(state.deviceClass);
+        state.running = 0;
+        it = devices.insert(device, state);
+    }
+
+    (priority == Urgent ? it->urgent : it->queue).insert({sortKey, Task{owner, job}});
+    dispatch(device, *it);
+}
+
+void IoScheduler::dispatch(quint64 device, Device &state) {
+    while (state.running < state.limit && (!state.urgent.empty() || !state.queue.empty())) {
+        std::multimap<QByteArray, Task> &queue = state.urgent.empty() ? state.queue : state.urgent;
+        auto next = queue.begin();
+        const Task task = std::move(next->second);
+        queue.erase(next);
+        ++state.running;
+
+        pool.start([this, device, task]() {
+            task.job();
+            finished(device, task.owner);
+        });
+    }
+}
+
+void IoScheduler::finished(quint64 device, const void *owner) {
+    QMutexLocker locker(&mutex);
+    auto it = devices.find(device);
+    --it->running;
+    dispatch(device, *it);
+    release(owner, 1);
+}
+
+void IoScheduler::release(const void *owner, int count) {
+    auto it = pending.find(owner);
+    if ((*it -= count) == 0) {
+        pending.erase(it);
+        cancels.remove(owner);
+        ownerDone.wakeAll();
+    }
+}
+
+void IoScheduler::cancel(const void *owner) {
+    QMutexLocker locker(&mutex);
+    if (!pending.contains(owner)) {
+        return;
+    }
+    // Jobs still having their device looked up are dropped once it is known
+    ++cancels[owner];
+
+    int dropped = 0;
+    for (Device &state : devices) {
+        for (std::multimap<QByteArray, Task> *queue : {&state.urgent, &state.queue}) {
+            for (auto it = queue->begin(); it != queue->end();) {
+                if (it->second.owner == owner) {
+                    it = queue->erase(it);
+                    ++dropped;
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    if (dropped > 0) {
+        release(owner, dropped);
+    }
+}
+
+void IoScheduler::waitForDone(const void *owner) {
+    QMutexLocker locker(&mutex);
+    while (pending.contains(owner)) {
+        ownerDone.wait(&mutex);
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef IOSCHEDULER_H
+#define IOSCHEDULER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <functional>
+#include <map>
+
+// Runs disk-bound jobs (directory listings, tag reads) with a concurrency
+// limit per underlying device instead of one global pool. Parallel reads
+// help SSDs and network mounts but make a spinning disk seek between files,
+// which is slower than reading them one after another. Each device's queue
+// is ordered by path, so a disk works through a directory tree roughly in
+// on-disk order. Urgent jobs have a queue of their own that a device drains
+// first, so a playback prefetch doesn't wait behind a library scan. Shared
+// by every client; jobs are tagged with their owner so one client can
+// cancel or wait for its own jobs.
+class IoScheduler {
+public:
+    enum DeviceClass {
+        SolidState,
+        Rotational,
+        Network
+    };
+
+    enum Priority {
+        Bulk,
+        Urgent
+    };
+
+    using Job = std::function<void()>;
+
+    static IoScheduler &shared();
+
+    // st_dev of the file or directory, 0 when it can't be stat'ed
+    static quint64 deviceOf(const QByteArray &path);
+
+    // The device class is probed from sortKey the first time a device is seen
+    void submit(const void *owner, quint64 device, const QByteArray &sortKey, const Job &job,
+                Priority priority = Bulk);
+    // Like submit(), but the device is looked up from path on a pool thread,
+    // so the caller never stats a file that may sit on a slow device
+    void submitPath(const void *owner, const QByteArray &path, const Job &job, Priority priority = Bulk);
+    // Drops the owner's queued jobs; running ones finish
+    void cancel(const void *owner);
+    // Waits until all of the owner's jobs, queued or running, have finished
+    void waitForDone(const void *owner);
+
+private:
+    struct Task {
+        const void *owner;
+        Job job;
+    };
+
+    struct Device {
+        DeviceClass deviceClass;
+        int limit;
+        int running;
+        std::multimap<QByteArray, Task> urgent;  // Dispatched before queue
+        std::multimap<QByteArray, Task> queue;
+    };
+
+    IoScheduler();
+    ~IoScheduler();
+    Q_DISABLE_COPY(IoScheduler)
+
+    static DeviceClass classify(quint64 device, const QByteArray &path);
+    static int concurrencyLimit(DeviceClass deviceClass);
+
+    // Adds the job to its device's queue, classifying a new device first;
+    // epoch is the owner's cancel count when the job was submitted
+    void enqueue(const void *owner, quint64 epoch, quint64 device, const QByteArray &sortKey,
+                 const Job &job, Priority priority);
+
+    // Called with mutex held
+    void dispatch(quint64 device, Device &state);
+    void release(const void *owner, int count);
+    void finished(quint64 device, const void *owner);
+
+    QThreadPool pool;
+
+    QMutex mutex;
+    QWaitCondition ownerDone;
+    QHash<quint64, Device> devices;
+    QHash<const void*, int> pending;  // Submitted and not yet finished jobs per owner
+    QHash<const void*, quint64> cancels;  // cancel() calls per owner with jobs pending
+};
+
+#endif // IOSCHEDULER_H
@@ -1,10 +1,17 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "startuptiming.h"
+#include "trace.h"
 
 int main(int argc, char *argv[]) {
+    StartupTiming::start(argc, argv);
+
     QApplication app(argc, argv);
+    StartupTiming::mark("application created");
+    TRACE_START();
 
     MainWindow window;
+    StartupTiming::mark("window constructed");
     window.show();
 
     return app.exec();
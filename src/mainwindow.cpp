@@ -1,56 +1,97 @@
 #include "mainwindow.h"
+#include "directoryscanner.h"
+#include "directorywatcher.h"
+#include "fileexplorermodel.h"
+#include "ioscheduler.h"
 #include "metadata.h"
+#include "metadataingestor.h"
 #include "mpris2.h"
+#include "playlistfiltermodel.h"
+#include "sessionsnapshot.h"
+#include "startuptiming.h"
+#include "trackprefetcher.h"
+#include "trace.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFileDialog>
 #include <QTableView>
 #include <QHeaderView>
-#include <QRandomGenerator>
-#include <QThreadPool>
 #include <QRunnable>
 #include <QApplication>
 #include <QStyle>
 #include <QSplitter>
-#include <QTreeWidget>
-#include <QTreeWidgetItem>
-#include <QFileSystemModel>
+#include <QTreeView>
 #include <QStandardPaths>
 #include <QDir>
+#include <QDirIterator>
+#include <QFile>
 #include <QKeyEvent>
 #include <QMouseEvent>
 #include <QDragEnterEvent>
 #include <QDropEvent>
+#include <QPaintEvent>
+#include <QShowEvent>
+#include <QWindow>
 #include <QMimeData>
 #include <QUrl>
 #include <QFont>
 #include <QMenu>
+#include <QAction>
 #include <QPainter>
 #include <QSettings>
 #include <QPushButton>
 #include <QScrollArea>
 #include <QScrollBar>
+#include <QTimer>
+#include <QDebug>
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), currentPlaylistIndex(0), isSeeking(false),
-      shuffleEnabled(false), repeatMode(RepeatOff) {
+    : QMainWindow(parent), currentPlaylistIndex(0), isSeeking(false), shownSecond(-1), shownSliderPixel(-1),
+      positionStatsEnabled(qEnvironmentVariableIsSet("SIMPLEPLAYER_UI_STATS")), positionTicks(0),
+      labelUpdates(0), sliderUpdates(0), restoredPosition(0),
+      cueRestoredTrack(false), startupPending(true), shuffleEnabled(false), repeatMode(RepeatOff),
+      mpris2(nullptr) {
     setWindowTitle("Music Player");
     setGeometry(100, 100, 1100, 700);
 
-    mediaPlayer = new QMediaPlayer(this);
-    audioOutput = new QAudioOutput(this);
-    mediaPlayer->setAudioOutput(audioOutput);
+    mediaPlayer = new PlaybackEngine(this);
+    if (positionStatsEnabled) {
+        positionStatsClock.start();
+    }
+
+    metadataIngestor = new MetadataIngestor(this);
+    directoryScanner = new DirectoryScanner(this);
+    trackPrefetcher = new TrackPrefetcher(this);
+    // Keeps the library cache current for watched folders; its tracks never
+    // reach the playlist
+    libraryIngestor = new MetadataIngestor(this);
+    remoteIngestor = new MetadataIngestor(this);
+    directoryWatcher = new DirectoryWatcher(this);
 
     setupUI();
     connectSignals();
     setupMediaControls();
     loadLastFolder();
-
-    // Initialize MPRIS2 for system media control integration
-    mpris2 = new Mpris2(this);
+    restoreSession();
+
+    // Closing the window, MPRIS Quit() and session logout all end up here,
+    // while the window and the player are still alive
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &MainWindow::saveSession);
+
+    // The explorer listing, folder watches and MPRIS registration run in
+    // finishStartup, once the first frame is on screen, or after a second if
+    // the window is never painted (e.g. started minimized)
+    QTimer::singleShot(1000, this, [this]() {
+        if (startupPending) {
+            startupPending = false;
+            finishStartup();
+        }
+    });
 }
 
 MainWindow::~MainWindow() {
+    IoScheduler::shared().cancel(this);
+    IoScheduler::shared().waitForDone(this);
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event) {
@@ -106,11 +147,11 @@ bool MainWindow::eventFilter(QObject *obj, QEvent *event) {
         if (event->type() == QEvent::MouseButtonPress) {
             QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
             if (mouseEvent->button() == Qt::LeftButton) {
-                QTreeWidgetItem *item = fileExplorer->itemAt(mouseEvent->pos());
-                if (item) {
+                QModelIndex index = fileExplorer->indexAt(mouseEvent->pos());
+                if (index.isValid()) {
                     // Store the item being dragged
                     draggedFiles.clear();
-                    QString filePath = item->data(0, Qt::UserRole).toString();
+                    QString filePath = fileExplorerModel->filePath(index);
                     if (!filePath.isEmpty() && !QFileInfo(filePath).isDir() && isAudioFile(filePath)) {
                         draggedFiles.append(filePath);
                     }
@@ -140,6 +181,7 @@ void MainWindow::dragEnterEvent(QDragEnterEvent *event) {
 void MainWindow::dropEvent(QDropEvent *event) {
     const QMimeData *mimeData = event->mimeData();
     QStringList files;
+    QStringList folders;
 
     // Check if files were dragged from internal file explorer event filter
     if (!draggedFiles.isEmpty()) {
@@ -152,7 +194,9 @@ void MainWindow::dropEvent(QDropEvent *event) {
             QString path = url.toLocalFile();
             if (!path.isEmpty()) {
                 QFileInfo fileInfo(path);
-                if (fileInfo.isFile() && isAudioFile(path)) {
+                if (fileInfo.isDir()) {
+                    folders.append(path);
+                } else if (fileInfo.isFile() && isAudioFile(path)) {
                     files.append(path);
                 }
             }
@@ -164,6 +208,69 @@ void MainWindow::dropEvent(QDropEvent *event) {
         nowPlayingLabel->setText(QString("Added %1 track(s) from drag & drop").arg(files.size()));
         event->acceptProposedAction();
     }
+    if (!folders.isEmpty()) {
+        loadFolders(folders);
+        event->acceptProposedAction();
+    }
+}
+
+void MainWindow::showEvent(QShowEvent *event) {
+    QMainWindow::showEvent(event);
+    updatePositionDisplay(mediaPlayer->position());
+}
+
+void MainWindow::changeEvent(QEvent *event) {
+    QMainWindow::changeEvent(event);
+    // Position ticks were skipped while minimized
+    if (event->type() == QEvent::WindowStateChange && !isMinimized()) {
+        updatePositionDisplay(mediaPlayer->position());
+    }
+}
+
+void MainWindow::paintEvent(QPaintEvent *event) {
+    QMainWindow::paintEvent(event);
+
+    if (startupPending) {
+        startupPending = false;
+        StartupTiming::mark("first paint");
+        // Queued so the frame is flushed before the deferred work starts
+        QTimer::singleShot(0, this, &MainWindow::finishStartup);
+    }
+}
+
+void MainWindow::finishStartup() {
+    if (StartupTiming::isEnabled()) {
+        connect(fileExplorerModel, &FileExplorerModel::directoryListed, this, [this](const QString &path) {
+            if (path == pathHistory[pathHistoryIndex]) {
+                StartupTiming::mark("explorer listed");
+                StartupTiming::report();
+            }
+        });
+    }
+
+    populateFileExplorer();
+    watchLibraryFolders();
+
+    if (cueRestoredTrack) {
+        cueRestoredTrack = false;
+        mediaPlayer->setSource(QUrl::fromLocalFile(playlistModel->getFilePath(currentPlaylistIndex)));
+    }
+
+    // Initialize MPRIS2 for system media control integration. Playlist
+    // edits can change the current track and what Next/Previous do.
+    mpris2 = new Mpris2(this, mediaPlayer, playlistModel);
+    connect(playlistModel, &PlaylistModel::rowsInserted, this, &MainWindow::updateMprisState);
+    connect(playlistModel, &PlaylistModel::rowsRemoved, this, &MainWindow::updateMprisState);
+    connect(playlistModel, &PlaylistModel::rowsReordered, this, &MainWindow::updateMprisState);
+    connect(playlistModel, &PlaylistModel::modelReset, this, &MainWindow::updateMprisState);
+    updateMprisState();
+
+    // The same edits can change which tracks play next
+    connect(playlistModel, &PlaylistModel::rowsInserted, this, &MainWindow::prefetchUpcomingTracks);
+    connect(playlistModel, &PlaylistModel::rowsRemoved, this, &MainWindow::prefetchUpcomingTracks);
+    connect(playlistModel, &PlaylistModel::rowsReordered, this, &MainWindow::prefetchUpcomingTracks);
+    connect(playlistModel, &PlaylistModel::modelReset, this, &MainWindow::prefetchUpcomingTracks);
+    StartupTiming::mark("interactive");
 }
 
 void MainWindow::setupUI() {
@@ -200,6 +307,21 @@ void MainWindow::setupUI() {
     progressLayout->addWidget(durationLabel);
     statusLayout->addLayout(progressLayout);
 
+    // Import progress with cancel, only shown while an import is running
+    QHBoxLayout *importLayout = new QHBoxLayout();
+    importProgressBar = new QProgressBar(this);
+    importProgressBar->setMaximumHeight(14);
+    importProgressBar->setFormat("Importing %v / %m");
+    cancelImportButton = new QPushButton(QApplication::style()->standardIcon(QStyle::SP_DialogCancelButton), "", this);
+    cancelImportButton->setToolTip("Cancel import");
+    cancelImportButton->setFlat(true);
+    cancelImportButton->setMaximumWidth(35);
+    importLayout->addWidget(importProgressBar);
+    importLayout->addWidget(cancelImportButton);
+    statusLayout->addLayout(importLayout);
+    importProgressBar->hide();
+    cancelImportButton->hide();
+
     mainLayout->addWidget(statusWidget);
 
     // Top control bar
@@ -330,24 +452,49 @@ void MainWindow::setupUI() {
     currentPathWidget->setMaximumHeight(28);
     explorerLayout->addWidget(currentPathWidget);
 
-    // File explorer pane with custom tree widget for proper MIME data handling
-    fileExplorer = new FileExplorerTree(this);
-    fileExplorer->setHeaderLabel("Files");
-    fileExplorer->setColumnCount(1);
+    // File explorer pane; the model lists directories lazily and encodes file paths in MIME data
+    fileExplorerModel = new FileExplorerModel(this);
+    QSettings settings("SimplePlayerQt", "SimplePlayerQt");
+    fileExplorerModel->setCacheLimit(settings.value("explorerCacheBytes", DirectoryCache::DefaultMaxBytes).toLongLong());
+    fileExplorer = new QTreeView(this);
+    fileExplorer->setModel(fileExplorerModel);
+    fileExplorer->setUniformRowHeights(true);
     fileExplorer->setDragEnabled(true);
     fileExplorer->setDefaultDropAction(Qt::CopyAction);
     fileExplorer->installEventFilter(this);  // Install event filter for drag tracking
     pathHistory.append(QStandardPaths::writableLocation(QStandardPaths::HomeLocation));
     pathHistoryIndex = 0;
-    populateFileExplorer();
     explorerLayout->addWidget(fileExplorer);
 
     splitter->addWidget(explorerWidget);
 
-    // Playlist table
+    // Playlist with search box
+    QWidget *playlistWidget = new QWidget(this);
+    QVBoxLayout *playlistLayout = new QVBoxLayout(playlistWidget);
+    playlistLayout->setContentsMargins(0, 0, 0, 0);
+    playlistLayout->setSpacing(3);
+
+    searchEdit = new QLineEdit(this);
+    searchEdit->setPlaceholderText("Search playlist (Ctrl+F)");
+    searchEdit->setClearButtonEnabled(true);
+    playlistLayout->addWidget(searchEdit);
+
+    QAction *findAction = new QAction(this);
+    findAction->setShortcut(QKeySequence::Find);
+    connect(findAction, &QAction::triggered, this, [this]() {
+        searchEdit->setFocus();
+        searchEdit->selectAll();
+    });
+    addAction(findAction);
+
     playlistModel = new PlaylistModel(this);
+    playlistFilter = new PlaylistFilterModel(playlistModel, this);
     playlistTable = new QTableView(this);
-    playlistTable->setModel(playlistModel);
+    playlistTable->setModel(playlistFilter);
+    // Fixed row heights keep the vertical header cheap when a filter
+    // resets a very long table
+    playlistTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    playlistTable->verticalHeader()->setDefaultSectionSize(22);
     playlistTable->setSelectionBehavior(QAbstractItemView::SelectRows);
     playlistTable->setSelectionMode(QAbstractItemView::SingleSelection);
     playlistTable->setAlternatingRowColors(true);
@@ -357,11 +504,16 @@ void MainWindow::setupUI() {
     playlistTable->setColumnWidth(PlaylistModel::ColumnTitle, 250);
     playlistTable->setColumnWidth(PlaylistModel::ColumnDuration, 60);
     playlistTable->horizontalHeader()->setStretchLastSection(false);
+    // Header clicks sort the playlist itself; no sort is applied until then
+    playlistTable->horizontalHeader()->setSectionsClickable(true);
+    playlistTable->horizontalHeader()->setSortIndicatorShown(true);
+    playlistTable->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
     playlistTable->setShowGrid(false);
     playlistTable->setAcceptDrops(true);
     playlistTable->setDropIndicatorShown(true);
     playlistTable->setDefaultDropAction(Qt::CopyAction);
-    splitter->addWidget(playlistTable);
+    playlistLayout->addWidget(playlistTable);
+    splitter->addWidget(playlistWidget);
 
     splitter->setStretchFactor(0, 1);
     splitter->setStretchFactor(1, 2);
@@ -378,10 +530,15 @@ void MainWindow::connectSignals() {
     connect(previousButton, &QPushButton::clicked, this, &MainWindow::onPreviousTrack);
 
     // Media player signals
-    connect(mediaPlayer, &QMediaPlayer::positionChanged, this, &MainWindow::onPositionChanged);
-    connect(mediaPlayer, &QMediaPlayer::durationChanged, this, &MainWindow::onDurationChanged);
-    connect(mediaPlayer, QOverload<QMediaPlayer::MediaStatus>::of(&QMediaPlayer::mediaStatusChanged),
-            this, &MainWindow::onMediaStatusChanged);
+    connect(mediaPlayer, &PlaybackEngine::positionChanged, this, &MainWindow::onPositionChanged);
+    connect(mediaPlayer, &PlaybackEngine::durationChanged, this, &MainWindow::onDurationChanged);
+    connect(mediaPlayer, &PlaybackEngine::mediaStatusChanged, this, &MainWindow::onMediaStatusChanged);
+    connect(mediaPlayer, &PlaybackEngine::nearEnd, this, &MainWindow::onTrackNearEnd);
+    connect(mediaPlayer, &PlaybackEngine::handoffMeasured, this, [this](qint64 latencyMs, bool prerolled) {
+        nowPlayingLabel->setToolTip(QString("Track change took %1 ms%2")
+                                        .arg(latencyMs)
+                                        .arg(prerolled ? " (gapless)" : ""));
+    });
 
     // Sliders
     connect(positionSlider, &QSlider::sliderMoved, this, &MainWindow::onSeek);
@@ -391,47 +548,209 @@ void MainWindow::connectSignals() {
     connect(playlistTable, &QTableView::doubleClicked, this, &MainWindow::onPlaylistDoubleClicked);
     connect(playlistTable, &QTableView::customContextMenuRequested, this, &MainWindow::onPlaylistContextMenu);
     playlistTable->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(playlistTable->horizontalHeader(), &QHeaderView::sortIndicatorChanged, playlistFilter, &PlaylistFilterModel::sort);
+
+    // Search filters as the user types; the current track stays selected if it matches
+    connect(searchEdit, &QLineEdit::textChanged, this, [this](const QString &text) {
+        playlistFilter->setFilterText(text);
+        selectPlaylistRow(currentPlaylistIndex);
+    });
 
     // Mode controls
     connect(shuffleButton, &QPushButton::clicked, this, &MainWindow::onShuffleClicked);
     connect(repeatButton, &QPushButton::clicked, this, &MainWindow::onRepeatClicked);
 
     // File explorer double click to add to playlist or navigate
-    connect(fileExplorer, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem *item) {
-        QString filePath = item->data(0, Qt::UserRole).toString();
+    connect(fileExplorer, &QTreeView::doubleClicked, this, [this](const QModelIndex &index) {
+        QString filePath = fileExplorerModel->filePath(index);
         if (!filePath.isEmpty()) {
             QFileInfo fileInfo(filePath);
             if (fileInfo.isDir()) {
                 navigateToPath(filePath);
             } else if (isAudioFile(filePath)) {
-                Metadata metadata = MetadataReader::readMetadata(filePath);
-                playlistModel->addTrack(metadata);
+                loadMetadataForFiles({filePath});
                 nowPlayingLabel->setText("Added: " + fileInfo.fileName());
             }
         }
     });
 
+    // Watch directories while they are expanded in the explorer
+    connect(fileExplorer, &QTreeView::expanded, this, [this](const QModelIndex &index) {
+        const QString path = fileExplorerModel->filePath(index);
+        if (!path.isEmpty()) {
+            directoryWatcher->addPath(path);
+            explorerWatches.append(path);
+        }
+    });
+    connect(fileExplorer, &QTreeView::collapsed, this, [this](const QModelIndex &index) {
+        const QString path = fileExplorerModel->filePath(index);
+        if (explorerWatches.removeOne(path)) {
+            directoryWatcher->removePath(path);
+        }
+    });
+    connect(directoryWatcher, &DirectoryWatcher::directoriesChanged, this, &MainWindow::onDirectoriesChanged);
+    connect(directoryWatcher, &DirectoryWatcher::overflowed, fileExplorerModel, &FileExplorerModel::refresh);
+
     // Navigation controls
     connect(backButton, &QPushButton::clicked, this, &MainWindow::onNavigateBack);
     connect(forwardButton, &QPushButton::clicked, this, &MainWindow::onNavigateForward);
     connect(upButton, &QPushButton::clicked, this, &MainWindow::onNavigateUp);
+
+    // Keep the shuffle order and current index in step with playlist edits
+    connect(playlistModel, &PlaylistModel::rowsInserted, this, &MainWindow::onPlaylistRowsInserted);
+    connect(playlistModel, &PlaylistModel::rowsRemoved, this, &MainWindow::onPlaylistRowsRemoved);
+    connect(playlistModel, &PlaylistModel::rowsReordered, this, &MainWindow::onPlaylistRowsReordered);
+    connect(playlistModel, &PlaylistModel::modelReset, this, [this]() {
+        currentPlaylistIndex = 0;
+        if (shuffleEnabled) {
+            shuffleOrder.reset(playlistModel->rowCount());
+        }
+    });
+
+    // Metadata import
+    connect(metadataIngestor, &MetadataIngestor::tracksReady, playlistModel, &PlaylistModel::appendTracks);
+    connect(metadataIngestor, &MetadataIngestor::progressChanged, this, &MainWindow::onImportProgress);
+    connect(metadataIngestor, &MetadataIngestor::finished, this, &MainWindow::onImportFinished);
+    connect(cancelImportButton, &QPushButton::clicked, metadataIngestor, &MetadataIngestor::cancel);
+
+    // Folder import: found files go straight to the ingestor while the walk continues
+    connect(directoryScanner, &DirectoryScanner::filesFound, metadataIngestor, &MetadataIngestor::enqueue);
+    connect(directoryScanner, &DirectoryScanner::finished, this, [this](bool cancelled) {
+        if (cancelled || !metadataIngestor->isBusy()) {
+            onImportFinished(cancelled);
+        }
+    });
+    connect(cancelImportButton, &QPushButton::clicked, directoryScanner, &DirectoryScanner::cancel);
+
+    connect(remoteIngestor, &MetadataIngestor::tracksReady, this, &MainWindow::onRemoteTracksRead);
 }
 
 bool MainWindow::isAudioFile(const QString &filename) {
-    QStringList audioExtensions = {".mp3", ".flac", ".ogg", ".wav", ".m4a", ".aac", ".wma"};
-    return std::any_of(audioExtensions.begin(), audioExtensions.end(),
-                      [&filename](const QString &ext) {
-                          return filename.endsWith(ext, Qt::CaseInsensitive);
-                      });
+    return MetadataReader::isAudioFile(filename);
 }
 
 void MainWindow::loadMetadataForFiles(const QStringList &files) {
+    QStringList audioFiles;
     for (const QString &file : files) {
         if (isAudioFile(file)) {
-            Metadata metadata = MetadataReader::readMetadata(file);
-            playlistModel->addTrack(metadata);
+            audioFiles.append(file);
         }
     }
+
+    // Tags are read on worker threads; tracks arrive through tracksReady
+    metadataIngestor->enqueue(audioFiles);
+}
+
+void MainWindow::loadFolders(const QStringList &folders) {
+    directoryScanner->scan(folders);
+    nowPlayingLabel->setText(folders.size() == 1
+                             ? "Scanning " + QFileInfo(folders.first()).fileName()
+                             : QString("Scanning %1 folders").arg(folders.size()));
+    importProgressBar->setRange(0, 0);  // Busy until the first files are found
+    importProgressBar->show();
+    cancelImportButton->show();
+}
+
+void MainWindow::onImportProgress(int done, int total) {
+    importProgressBar->setRange(0, total);
+    importProgressBar->setValue(done);
+    importProgressBar->show();
+    cancelImportButton->show();
+}
+
+void MainWindow::onImportFinished(bool cancelled) {
+    playlistModel->flushPendingTracks();
+    // The ingestor can catch up with a folder walk that is still going
+    if (!cancelled && directoryScanner->isBusy()) {
+        return;
+    }
+    importProgressBar->hide();
+    cancelImportButton->hide();
+
+    if (cancelled) {
+        nowPlayingLabel->setText("Import cancelled");
+    }
+}
+
+void MainWindow::onDirectoriesChanged(const QList<DirectoryChange> &changes) {
+    fileExplorerModel->applyChanges(changes);
+
+    // Library folders: read finished files into the cache, forget removed ones
+    QStringList completedFiles;
+    QStringList removedFiles;
+    for (const DirectoryChange &change : changes) {
+        if (!libraryDirectories.contains(change.path)) {
+            continue;
+        }
+        const QString prefix = change.path.endsWith('/') ? change.path : change.path + '/';
+
+        for (const QString &name : change.completed) {
+            if (isAudioFile(name)) {
+                completedFiles.append(prefix + name);
+            }
+        }
+        for (const QString &name : change.removed) {
+            const QString path = prefix + name;
+            if (isAudioFile(name)) {
+                removedFiles.append(path);
+            }
+
+            // A directory moved away keeps its watch; drop it and its subtree
+            if (!libraryDirectories.contains(path)) {
+                continue;
+            }
+            for (auto it = libraryDirectories.begin(); it != libraryDirectories.end();) {
+                if (*it == path || it->startsWith(path + '/')) {
+                    directoryWatcher->removePath(*it);
+                    it = libraryDirectories.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (const DirectoryEntry &entry : change.added) {
+            if (entry.isDir) {
+                watchLibraryTree(prefix + entry.name);
+            }
+        }
+    }
+
+    libraryIngestor->forget(removedFiles);
+    libraryIngestor->enqueue(completedFiles);
+}
+
+void MainWindow::watchLibraryFolders() {
+    QSettings settings("SimplePlayerQt", "SimplePlayerQt");
+    const QStringList folders = settings.value("libraryFolders").toStringList();
+    // Missing folders are skipped by the walk, off this thread
+    for (const QString &folder : folders) {
+        watchLibraryTree(QDir(folder).absolutePath());
+    }
+}
+
+void MainWindow::watchLibraryTree(const QString &path) {
+    // inotify is not recursive, so every directory below gets its own watch;
+    // the walk, and the stat that finds its disk, run off the GUI thread,
+    // queued behind other work on that disk
+    IoScheduler::shared().submitPath(this, QFile::encodeName(path), [this, path]() {
+        if (!QFileInfo(path).isDir()) {
+            return;
+        }
+        QStringList directories = {path};
+        QDirIterator it(path, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            directories.append(it.next());
+        }
+
+        QMetaObject::invokeMethod(this, [this, directories]() {
+            for (const QString &directory : directories) {
+                if (!libraryDirectories.contains(directory)) {
+                    libraryDirectories.insert(directory);
+                    directoryWatcher->addPath(directory);
+                }
+            }
+        }, Qt::QueuedConnection);
+    });
 }
 
 void MainWindow::onAddToPlaylist() {
@@ -445,16 +764,29 @@ void MainWindow::onAddToPlaylist() {
     }
 }
 
+void MainWindow::onAddFolder() {
+    QString folder = QFileDialog::getExistingDirectory(this, "Add Music Folder", pathHistory[pathHistoryIndex]);
+    if (!folder.isEmpty()) {
+        loadFolders({folder});
+    }
+}
+
 void MainWindow::onRemoveFromPlaylist() {
-    int row = playlistTable->currentIndex().row();
+    int row = playlistFilter->mapToSource(playlistTable->currentIndex()).row();
     if (row >= 0) {
-        playlistModel->removeTrack(row);
+        removePlaylistRow(row);
+    }
+}
 
-        if (row == currentPlaylistIndex && row < playlistModel->rowCount()) {
-            playTrackAtIndex(row);
-        } else if (currentPlaylistIndex >= playlistModel->rowCount()) {
-            currentPlaylistIndex = playlistModel->rowCount() - 1;
-        }
+void MainWindow::removePlaylistRow(int row) {
+    // currentPlaylistIndex follows the removal through rowsRemoved
+    bool wasCurrent = row == currentPlaylistIndex;
+    playlistModel->removeTrack(row);
+
+    if (wasCurrent && row < playlistModel->rowCount()) {
+        playTrackAtIndex(row);
+    } else if (currentPlaylistIndex >= playlistModel->rowCount()) {
+        currentPlaylistIndex = playlistModel->rowCount() - 1;
     }
 }
 
@@ -462,11 +794,56 @@ void MainWindow::onClearPlaylist() {
     playlistModel->clear();
     mediaPlayer->stop();
     currentPlaylistIndex = 0;
-    shuffledIndices.clear();
+    shuffleOrder.clear();
     nowPlayingLabel->setText("No track playing");
     nowPlayingLabel->setText("Playlist cleared");
 }
 
+void MainWindow::onPlaylistRowsInserted(const QModelIndex &parent, int first, int last) {
+    Q_UNUSED(parent);
+    const int count = last - first + 1;
+
+    if (shuffleEnabled) {
+        // New tracks go somewhere after the current one so they still get played
+        int fromPosition = 0;
+        if (!mediaPlayer->source().isEmpty() && currentPlaylistIndex < shuffleOrder.size()) {
+            fromPosition = shuffleOrder.positionOf(currentPlaylistIndex) + 1;
+        }
+        shuffleOrder.insertRows(first, count, fromPosition);
+    }
+
+    if (first <= currentPlaylistIndex && currentPlaylistIndex < playlistModel->rowCount() - count) {
+        currentPlaylistIndex += count;
+    }
+}
+
+void MainWindow::onPlaylistRowsRemoved(const QModelIndex &parent, int first, int last) {
+    Q_UNUSED(parent);
+    const int count = last - first + 1;
+    if (shuffleEnabled) {
+        shuffleOrder.removeRows(first, count);
+    }
+
+    // Rows after the removed range move up; a removed current track is
+    // replaced by whatever now sits in its row
+    if (currentPlaylistIndex > last) {
+        currentPlaylistIndex -= count;
+    } else if (currentPlaylistIndex >= first) {
+        currentPlaylistIndex = first;
+    }
+}
+
+void MainWindow::onPlaylistRowsReordered(const QList<int> &newRows) {
+    // The current track keeps playing from its new row, and shuffle keeps
+    // its play order
+    if (currentPlaylistIndex >= 0 && currentPlaylistIndex < newRows.size()) {
+        currentPlaylistIndex = newRows[currentPlaylistIndex];
+    }
+    if (shuffleEnabled && shuffleOrder.size() == newRows.size()) {
+        shuffleOrder.remapRows(newRows);
+    }
+}
+
 void MainWindow::onPlayClicked() {
     if (mediaPlayer->playbackState() == QMediaPlayer::PlayingState) {
         return;
@@ -508,21 +885,76 @@ void MainWindow::onNextTrack() {
 void MainWindow::onPreviousTrack() {
     if (playlistModel->rowCount() == 0) return;
 
-    currentPlaylistIndex = (currentPlaylistIndex - 1 + playlistModel->rowCount()) % playlistModel->rowCount();
+    if (shuffleEnabled && currentPlaylistIndex < shuffleOrder.size()) {
+        // Step back through the shuffle order rather than the table
+        int currentPos = shuffleOrder.positionOf(currentPlaylistIndex);
+        currentPlaylistIndex = shuffleOrder.rowAt((currentPos - 1 + shuffleOrder.size()) % shuffleOrder.size());
+    } else {
+        currentPlaylistIndex = (currentPlaylistIndex - 1 + playlistModel->rowCount()) % playlistModel->rowCount();
+    }
     playTrackAtIndex(currentPlaylistIndex);
 }
 
+// Background playback target: while the window is minimized, hidden or
+// covered, position ticks cost one visibility check and nothing is
+// repainted. While visible, the time label changes at most once a second
+// and the slider only when its handle moves a pixel.
+static const qint64 PositionStatsIntervalMs = 10000;
+
 void MainWindow::onPositionChanged(qint64 position) {
+    if (positionStatsEnabled) {
+        ++positionTicks;
+        if (positionStatsClock.elapsed() >= PositionStatsIntervalMs) {
+            reportPositionDisplayStats();
+        }
+    }
+
+    // Showing the window again brings the display up to date
+    if (isPositionDisplayExposed()) {
+        updatePositionDisplay(position);
+    }
+}
+
+bool MainWindow::isPositionDisplayExposed() const {
+    const QWindow *window = windowHandle();
+    return window && window->isExposed() && !isMinimized();
+}
+
+void MainWindow::updatePositionDisplay(qint64 position) {
+    const qint64 second = position / 1000;
+    if (second != shownSecond) {
+        shownSecond = second;
+        currentTimeLabel->setText(formatTime(position));
+        ++labelUpdates;
+    }
+
     if (!isSeeking) {
-        positionSlider->blockSignals(true);
-        positionSlider->setValue(position);
-        positionSlider->blockSignals(false);
+        const int pixel = QStyle::sliderPositionFromValue(positionSlider->minimum(), positionSlider->maximum(),
+                                                          int(position), positionSlider->width());
+        if (pixel != shownSliderPixel) {
+            shownSliderPixel = pixel;
+            positionSlider->blockSignals(true);
+            positionSlider->setValue(position);
+            positionSlider->blockSignals(false);
+            ++sliderUpdates;
+        }
     }
-    currentTimeLabel->setText(formatTime(position));
+}
+
+void MainWindow::reportPositionDisplayStats() {
+    const double seconds = positionStatsClock.restart() / 1000.0;
+    qDebug().nospace() << "Position updates per second: " << positionTicks / seconds
+                       << " ticks, " << labelUpdates / seconds << " label, "
+                       << sliderUpdates / seconds << " slider"
+                       << (isPositionDisplayExposed() ? "" : " (window not exposed)");
+    positionTicks = 0;
+    labelUpdates = 0;
+    sliderUpdates = 0;
 }
 
 void MainWindow::onDurationChanged(qint64 duration) {
     positionSlider->setRange(0, duration);
+    shownSliderPixel = -1;
     durationLabel->setText(formatTime(duration));
 }
 
@@ -533,7 +965,7 @@ void MainWindow::onSeek(int position) {
 }
 
 void MainWindow::onVolumeChanged(int volume) {
-    audioOutput->setVolume(volume / 100.0);
+    mediaPlayer->setVolume(volume / 100.0);
 
     // Update volume icon based on volume level
     QStyle *style = QApplication::style();
@@ -557,12 +989,15 @@ void MainWindow::onVolumeChanged(int volume) {
 
 void MainWindow::onPlaylistDoubleClicked(const QModelIndex &index) {
     if (index.isValid()) {
-        playTrackAtIndex(index.row());
+        playTrackAtIndex(playlistFilter->mapToSource(index).row());
     }
 }
 
 void MainWindow::onMediaStatusChanged(QMediaPlayer::MediaStatus status) {
-    if (status == QMediaPlayer::EndOfMedia) {
+    if (status == QMediaPlayer::LoadedMedia && restoredPosition > 0) {
+        mediaPlayer->setPosition(restoredPosition);
+        restoredPosition = 0;
+    } else if (status == QMediaPlayer::EndOfMedia) {
         if (repeatMode == RepeatOne) {
             mediaPlayer->setPosition(0);
             mediaPlayer->play();
@@ -572,47 +1007,146 @@ void MainWindow::onMediaStatusChanged(QMediaPlayer::MediaStatus status) {
     }
 }
 
+void MainWindow::onTrackNearEnd() {
+    // Open the next track ahead of time; playTrackAtIndex then only swaps
+    // players. If the next track changes meanwhile it is simply loaded cold.
+    if (repeatMode == RepeatOne) {
+        return;
+    }
+    int nextIndex = peekNextTrackIndex();
+    if (nextIndex >= 0) {
+        mediaPlayer->prepareNext(QUrl::fromLocalFile(playlistModel->getFilePath(nextIndex)));
+    }
+}
+
 void MainWindow::onShuffleClicked() {
     shuffleEnabled = !shuffleEnabled;
     updateShuffleButton();
 
     if (shuffleEnabled) {
-        shuffledIndices.clear();
-        for (int i = 0; i < playlistModel->rowCount(); ++i) {
-            shuffledIndices.append(i);
-        }
-        for (int i = shuffledIndices.size() - 1; i > 0; --i) {
-            int j = QRandomGenerator::global()->bounded(i + 1);
-            shuffledIndices.swapItemsAt(i, j);
-        }
+        // The current track leads so every other track is still ahead
+        const bool playing = !mediaPlayer->source().isEmpty();
+        shuffleOrder.reset(playlistModel->rowCount(), playing ? currentPlaylistIndex : -1);
     } else {
-        shuffledIndices.clear();
+        shuffleOrder.clear();
     }
+    updateMprisState();
+    prefetchUpcomingTracks();
 }
 
 void MainWindow::onRepeatClicked() {
     repeatMode = (RepeatMode)((repeatMode + 1) % 3);
     updateRepeatButton();
+    updateMprisState();
+    prefetchUpcomingTracks();
+}
+
+void MainWindow::onRemoteVolume(int volume) {
+    volumeSlider->setValue(volume);
+}
+
+void MainWindow::onRemoteShuffle(bool shuffle) {
+    if (shuffle != shuffleEnabled) {
+        shuffleButton->click();
+    }
+}
+
+void MainWindow::onRemoteRepeatMode(int mode) {
+    repeatMode = RepeatMode(qBound(0, mode, int(RepeatOne)));
+    updateRepeatButton();
+    updateMprisState();
+    prefetchUpcomingTracks();
+}
+
+void MainWindow::onRemoteOpenUri(const QString &uri) {
+    onRemoteAddTrack(uri, playlistModel->rowCount(), true);
+}
+
+void MainWindow::onRemoteAddTrack(const QString &uri, int row, bool play) {
+    const QUrl url(uri);
+    if (!url.isLocalFile() || !isAudioFile(url.toLocalFile()) || !QFileInfo::exists(url.toLocalFile())) {
+        return;
+    }
+    // The row goes in at once so the caller's position still holds; the
+    // tags follow from the ingestor, cache and quarantine included
+    row = qBound(0, row, playlistModel->rowCount());
+    playlistModel->insertTrack(row, MetadataReader::fromFileName(url.toLocalFile()));
+    remoteIngestor->enqueue({url.toLocalFile()});
+    if (play) {
+        playTrackAtIndex(row);
+    }
+}
+
+void MainWindow::onRemoteTracksRead(const QList<Metadata> &tracks) {
+    playlistModel->updateTracks(tracks);
+
+    // The now playing line and MPRIS metadata still show the filename
+    if (mediaPlayer->source().isEmpty() || currentPlaylistIndex >= playlistModel->rowCount()) {
+        return;
+    }
+    const Metadata metadata = playlistModel->getTrack(currentPlaylistIndex);
+    for (const Metadata &track : tracks) {
+        if (track.filePath == metadata.filePath) {
+            nowPlayingLabel->setText(QString("Now Playing: %1 - %2")
+                                        .arg(metadata.artist)
+                                        .arg(metadata.title));
+            updateMprisState();
+            break;
+        }
+    }
+}
+
+void MainWindow::onRemoteRemoveTrack(int row) {
+    if (row >= 0 && row < playlistModel->rowCount()) {
+        removePlaylistRow(row);
+    }
+}
+
+void MainWindow::onRemotePlayRow(int row) {
+    playTrackAtIndex(row);
+}
+
+void MainWindow::updateMprisState() {
+    if (!mpris2) {
+        return;
+    }
+
+    const bool loaded = !mediaPlayer->source().isEmpty() && currentPlaylistIndex < playlistModel->rowCount();
+    mpris2->updateMetadata(loaded ? playlistModel->getTrack(currentPlaylistIndex) : Metadata(), loaded ? currentPlaylistIndex : -1);
+    mpris2->updateShuffle(shuffleEnabled);
+    mpris2->updateLoopStatus(repeatMode == RepeatOne ? "Track" : repeatMode == RepeatAll ? "Playlist" : "None");
+
+    const bool hasTracks = playlistModel->rowCount() > 0;
+    mpris2->updateNavigation(peekNextTrackIndex() >= 0, hasTracks, hasTracks);
 }
 
 int MainWindow::getNextTrackIndex() {
+    int nextIndex = peekNextTrackIndex();
+    if (nextIndex >= 0) {
+        currentPlaylistIndex = nextIndex;
+    }
+    return nextIndex;
+}
+
+int MainWindow::peekNextTrackIndex() const {
+    return nextTrackIndexAfter(currentPlaylistIndex);
+}
+
+int MainWindow::nextTrackIndexAfter(int row) const {
     if (playlistModel->rowCount() == 0) return -1;
 
-    if (shuffleEnabled) {
-        int currentPos = shuffledIndices.indexOf(currentPlaylistIndex);
-        if (currentPos >= 0 && currentPos < shuffledIndices.size() - 1) {
-            currentPlaylistIndex = shuffledIndices[currentPos + 1];
-            return currentPlaylistIndex;
+    if (shuffleEnabled && !shuffleOrder.isEmpty()) {
+        int currentPos = row < shuffleOrder.size() ? shuffleOrder.positionOf(row) : -1;
+        if (currentPos >= 0 && currentPos < shuffleOrder.size() - 1) {
+            return shuffleOrder.rowAt(currentPos + 1);
         } else if (repeatMode == RepeatAll) {
-            currentPlaylistIndex = shuffledIndices[0];
-            return currentPlaylistIndex;
+            return shuffleOrder.rowAt(0);
         }
         return -1;
     } else {
-        if (currentPlaylistIndex < playlistModel->rowCount() - 1) {
-            return ++currentPlaylistIndex;
+        if (row < playlistModel->rowCount() - 1) {
+            return row + 1;
         } else if (repeatMode == RepeatAll) {
-            currentPlaylistIndex = 0;
             return 0;
         }
         return -1;
@@ -620,19 +1154,52 @@ int MainWindow::getNextTrackIndex() {
 }
 
 void MainWindow::playTrackAtIndex(int index) {
+    TRACE_SCOPE("MainWindow::playTrackAtIndex");
     if (index >= 0 && index < playlistModel->rowCount()) {
         currentPlaylistIndex = index;
         QString filePath = playlistModel->getFilePath(index);
         Metadata metadata = playlistModel->getTrack(index);
 
+        trackPrefetcher->trackStarted(filePath);
         mediaPlayer->setSource(QUrl::fromLocalFile(filePath));
-        playlistTable->selectRow(index);
-        playlistTable->scrollTo(playlistTable->currentIndex(), QAbstractItemView::PositionAtCenter);
+        selectPlaylistRow(index);
 
         nowPlayingLabel->setText(QString("Now Playing: %1 - %2")
                                     .arg(metadata.artist)
                                     .arg(metadata.title));
         mediaPlayer->play();
+        updateMprisState();
+        prefetchUpcomingTracks();
+    }
+}
+
+// How many of the tracks ahead are kept in the page cache
+static const int PrefetchTrackCount = 2;
+
+void MainWindow::prefetchUpcomingTracks() {
+    // Repeat One replays a file that is already cached
+    QStringList upcoming;
+    if (!mediaPlayer->source().isEmpty() && repeatMode != RepeatOne) {
+        int row = currentPlaylistIndex;
+        for (int i = 0; i < PrefetchTrackCount; ++i) {
+            row = nextTrackIndexAfter(row);
+            if (row < 0 || row == currentPlaylistIndex) {
+                break;
+            }
+            upcoming.append(playlistModel->getFilePath(row));
+        }
+    }
+    trackPrefetcher->prefetch(upcoming);
+}
+
+void MainWindow::selectPlaylistRow(int row) {
+    // Playlist rows are only in the table while they match the search
+    QModelIndex index = playlistFilter->mapFromSource(playlistModel->index(row, 0));
+    if (index.isValid()) {
+        playlistTable->selectRow(index.row());
+        playlistTable->scrollTo(index, QAbstractItemView::PositionAtCenter);
+    } else {
+        playlistTable->clearSelection();
     }
 }
 
@@ -703,34 +1270,42 @@ void MainWindow::onNavigateUp() {
 }
 
 void MainWindow::onPlaylistContextMenu(const QPoint &pos) {
-    QModelIndex index = playlistTable->indexAt(pos);
-    if (!index.isValid()) {
-        return;
-    }
+    QModelIndex index = playlistFilter->mapToSource(playlistTable->indexAt(pos));
 
     QMenu contextMenu(this);
+    QAction *addFilesAction = contextMenu.addAction("Add Files...");
+    QAction *addFolderAction = contextMenu.addAction("Add Folder...");
+    contextMenu.addSeparator();
     QAction *removeAction = contextMenu.addAction("Remove");
+    removeAction->setEnabled(index.isValid());
     contextMenu.addSeparator();
     QAction *clearAction = contextMenu.addAction("Clear All");
 
     QAction *selectedAction = contextMenu.exec(playlistTable->mapToGlobal(pos));
 
-    if (selectedAction == removeAction) {
-        playlistModel->removeTrack(index.row());
-        if (index.row() == currentPlaylistIndex && index.row() < playlistModel->rowCount()) {
-            playTrackAtIndex(index.row());
-        } else if (currentPlaylistIndex >= playlistModel->rowCount()) {
-            currentPlaylistIndex = playlistModel->rowCount() - 1;
-        }
+    if (selectedAction == addFilesAction) {
+        onAddToPlaylist();
+    } else if (selectedAction == addFolderAction) {
+        onAddFolder();
+    } else if (selectedAction == removeAction) {
+        removePlaylistRow(index.row());
     } else if (selectedAction == clearAction) {
         onClearPlaylist();
     }
 }
 
 void MainWindow::populateFileExplorer() {
-    fileExplorer->clear();
+    TRACE_SCOPE("MainWindow::populateFileExplorer");
     QString currentPath = pathHistory[pathHistoryIndex];
-    populateDirectoryTree(fileExplorer->invisibleRootItem(), currentPath, 0);
+
+    // The old tree's expanded directories go away with it
+    for (const QString &path : std::as_const(explorerWatches)) {
+        directoryWatcher->removePath(path);
+    }
+    explorerWatches = {currentPath};
+    directoryWatcher->addPath(currentPath);
+
+    fileExplorerModel->setRootPath(currentPath);
     updateNavigationButtons();
 
     // Update the path display with clickable breadcrumbs
@@ -786,30 +1361,6 @@ void MainWindow::populateFileExplorer() {
     }
 }
 
-void MainWindow::populateDirectoryTree(QTreeWidgetItem *parent, const QString &dirPath, int depth) {
-    // Limit depth to avoid too deep recursion
-    if (depth > 2) return;
-
-    QDir dir(dirPath);
-    dir.setFilter(QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
-
-    QFileInfoList entries = dir.entryInfoList();
-
-    for (const QFileInfo &fileInfo : entries) {
-        QTreeWidgetItem *item = new QTreeWidgetItem(parent);
-        item->setText(0, fileInfo.fileName());
-        item->setData(0, Qt::UserRole, fileInfo.filePath());
-
-        if (fileInfo.isDir()) {
-            // Add directory
-            populateDirectoryTree(item, fileInfo.filePath(), depth + 1);
-        } else if (isAudioFile(fileInfo.filePath())) {
-            // Mark audio files with icon or styling
-            item->setText(0, fileInfo.fileName());
-        }
-    }
-}
-
 void MainWindow::updateNavigationButtons() {
     backButton->setEnabled(pathHistoryIndex > 0);
     forwardButton->setEnabled(pathHistoryIndex < pathHistory.size() - 1);
@@ -857,7 +1408,6 @@ void MainWindow::loadLastFolder() {
     pathHistory.clear();
     pathHistory.append(lastFolder);
     pathHistoryIndex = 0;
-    populateFileExplorer();
 }
 
 void MainWindow::saveLastFolder() {
@@ -868,6 +1418,53 @@ void MainWindow::saveLastFolder() {
     }
 }
 
+void MainWindow::restoreSession() {
+    TrackStore tracks;
+    SessionState state;
+    if (!SessionSnapshot::load(SessionSnapshot::defaultPath(), tracks, state) || tracks.size() == 0) {
+        return;
+    }
+
+    playlistModel->setTrackStore(std::move(tracks));
+    const int rowCount = playlistModel->rowCount();
+
+    repeatMode = RepeatMode(qBound(0, state.repeatMode, int(RepeatOne)));
+    updateRepeatButton();
+
+    shuffleEnabled = state.shuffleEnabled;
+    shuffleButton->setChecked(shuffleEnabled);
+    updateShuffleButton();
+    if (shuffleEnabled && (state.shuffleOrder.size() != rowCount || !shuffleOrder.assign(state.shuffleOrder))) {
+        shuffleOrder.reset(rowCount);
+    }
+
+    // The track is cued up paused where it was left once startup finishes
+    currentPlaylistIndex = qBound(0, state.currentIndex, rowCount - 1);
+    restoredPosition = state.position;
+    cueRestoredTrack = true;
+    selectPlaylistRow(currentPlaylistIndex);
+
+    Metadata metadata = playlistModel->getTrack(currentPlaylistIndex);
+    nowPlayingLabel->setText(QString("Restored %1 tracks - %2 - %3")
+                                .arg(rowCount)
+                                .arg(metadata.artist)
+                                .arg(metadata.title));
+}
+
+void MainWindow::saveSession() {
+    playlistModel->flushPendingTracks();
+
+    SessionState state;
+    state.currentIndex = currentPlaylistIndex;
+    state.shuffleEnabled = shuffleEnabled;
+    state.repeatMode = repeatMode;
+    state.position = mediaPlayer->source().isEmpty() ? 0 : mediaPlayer->position();
+    if (shuffleEnabled) {
+        state.shuffleOrder = shuffleOrder.rows();
+    }
+    SessionSnapshot::save(SessionSnapshot::defaultPath(), playlistModel->trackStore(), state);
+}
+
 void MainWindow::onPathClicked(const QString &path) {
     // Navigate to the clicked path component
     // Remove any forward history when navigating to a new path
@@ -2,44 +2,29 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QMediaPlayer>
-#include <QAudioOutput>
 #include <QSlider>
 #include <QPushButton>
 #include <QLabel>
+#include <QLineEdit>
+#include <QProgressBar>
 #include <QTableWidget>
-#include <QTreeWidget>
-#include <QMimeData>
+#include <QTreeView>
 #include <QDBusConnection>
+#include <QElapsedTimer>
+#include <QSet>
 #include <QSettings>
+#include "playbackengine.h"
 #include "playlistmodel.h"
+#include "shuffleorder.h"
 
 class Mpris2;
-
-// Custom tree widget that properly encodes file paths in MIME data
-class FileExplorerTree : public QTreeWidget {
-public:
-    FileExplorerTree(QWidget *parent = nullptr) : QTreeWidget(parent) {}
-
-protected:
-    QMimeData* mimeData(const QList<QTreeWidgetItem*> &items) const override {
-        QMimeData *mimeData = new QMimeData();
-        QList<QUrl> urls;
-
-        for (QTreeWidgetItem *item : items) {
-            QString filePath = item->data(0, Qt::UserRole).toString();
-            if (!filePath.isEmpty()) {
-                urls.append(QUrl::fromLocalFile(filePath));
-            }
-        }
-
-        if (!urls.isEmpty()) {
-            mimeData->setUrls(urls);
-        }
-
-        return mimeData;
-    }
-};
+class MetadataIngestor;
+class FileExplorerModel;
+class PlaylistFilterModel;
+class DirectoryWatcher;
+class DirectoryScanner;
+class TrackPrefetcher;
+struct DirectoryChange;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -58,6 +43,9 @@ protected:
     void keyPressEvent(QKeyEvent *event) override;
     void dragEnterEvent(QDragEnterEvent *event) override;
     void dropEvent(QDropEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void changeEvent(QEvent *event) override;
     bool eventFilter(QObject *obj, QEvent *event) override;
 
 private slots:
@@ -70,7 +58,10 @@ private slots:
     void onVolumeChanged(int volume);
     void onPlaylistDoubleClicked(const QModelIndex &index);
     void onMediaStatusChanged(QMediaPlayer::MediaStatus status);
+    void onTrackNearEnd();
+    void finishStartup();
     void onAddToPlaylist();
+    void onAddFolder();
     void onRemoveFromPlaylist();
     void onClearPlaylist();
     void onShuffleClicked();
@@ -81,28 +72,56 @@ private slots:
     void onNavigateForward();
     void onNavigateUp();
     void onPlaylistContextMenu(const QPoint &pos);
+    void onImportProgress(int done, int total);
+    void onImportFinished(bool cancelled);
+    void onPlaylistRowsInserted(const QModelIndex &parent, int first, int last);
+    void onPlaylistRowsRemoved(const QModelIndex &parent, int first, int last);
+    void onPlaylistRowsReordered(const QList<int> &newRows);
+    void onDirectoriesChanged(const QList<DirectoryChange> &changes);
+
+    // MPRIS property writes, OpenUri and TrackList edits
+    void onRemoteVolume(int volume);
+    void onRemoteShuffle(bool shuffle);
+    void onRemoteRepeatMode(int mode);
+    void onRemoteOpenUri(const QString &uri);
+    void onRemoteAddTrack(const QString &uri, int row, bool play);
+    void onRemoteRemoveTrack(int row);
+    void onRemotePlayRow(int row);
+    void onRemoteTracksRead(const QList<Metadata> &tracks);
 
 private:
     void setupUI();
     void connectSignals();
     QString formatTime(qint64 milliseconds);
+    bool isPositionDisplayExposed() const;
+    void updatePositionDisplay(qint64 position);
+    void reportPositionDisplayStats();
     bool isAudioFile(const QString &filename);
     void updateShuffleButton();
     void updateRepeatButton();
     int getNextTrackIndex();
+    int peekNextTrackIndex() const;
+    int nextTrackIndexAfter(int row) const;
+    void prefetchUpcomingTracks();
     void playTrackAtIndex(int index);
+    void selectPlaylistRow(int row);
+    void removePlaylistRow(int row);
     void loadMetadataForFiles(const QStringList &files);
+    void loadFolders(const QStringList &folders);
     void populateFileExplorer();
-    void populateDirectoryTree(QTreeWidgetItem *parent, const QString &dirPath, int depth);
     void updateNavigationButtons();
     void navigateToPath(const QString &path);
     void setupMediaControls();
     void loadLastFolder();
     void saveLastFolder();
     void onPathClicked(const QString &path);
+    void watchLibraryFolders();
+    void restoreSession();
+    void saveSession();
+    void watchLibraryTree(const QString &path);
+    void updateMprisState();
 
-    QMediaPlayer *mediaPlayer;
-    QAudioOutput *audioOutput;
+    PlaybackEngine *mediaPlayer;
 
     // Control buttons
     QPushButton *playButton;
@@ -126,23 +145,58 @@ private:
     QLabel *durationLabel;
     QLabel *nowPlayingLabel;
 
+    // Import progress (for status bar)
+    QProgressBar *importProgressBar;
+    QPushButton *cancelImportButton;
+
     // Playlist table
     QTableView *playlistTable;
     PlaylistModel *playlistModel;
+    PlaylistFilterModel *playlistFilter;  // The table shows the playlist through the search filter
+    QLineEdit *searchEdit;
+    MetadataIngestor *metadataIngestor;
+    DirectoryScanner *directoryScanner;
+    TrackPrefetcher *trackPrefetcher;
 
     // File explorer
-    QTreeWidget *fileExplorer;
+    QTreeView *fileExplorer;
+    FileExplorerModel *fileExplorerModel;
     QPushButton *backButton;
     QPushButton *forwardButton;
     QPushButton *upButton;
     QWidget *currentPathWidget;
 
+    // Live updates for the explorer's root and expanded directories, and for
+    // every directory under the configured library folders
+    DirectoryWatcher *directoryWatcher;
+    QStringList explorerWatches;
+    QSet<QString> libraryDirectories;
+    MetadataIngestor *libraryIngestor;
+
+    // Reads tags for tracks added over MPRIS, which go into the playlist
+    // straight away with filename metadata
+    MetadataIngestor *remoteIngestor;
+
     QStringList pathHistory;
     int pathHistoryIndex;
 
-    QList<int> shuffledIndices;
+    ShuffleOrder shuffleOrder;
     int currentPlaylistIndex;
     bool isSeeking;
+
+    // Position display: redrawn only when the shown second or the slider's
+    // pixel changes, and not at all while the window can't be seen
+    qint64 shownSecond;
+    int shownSliderPixel;
+    // Per-second rates, logged when SIMPLEPLAYER_UI_STATS is set
+    bool positionStatsEnabled;
+    QElapsedTimer positionStatsClock;
+    int positionTicks;
+    int labelUpdates;
+    int sliderUpdates;
+    qint64 restoredPosition;  // Applied once the restored track has loaded
+    bool cueRestoredTrack;
+    bool startupPending;      // Until the first frame has been painted
     bool shuffleEnabled;
     RepeatMode repeatMode;
 
@@ -1,37 +1,52 @@
 #include "metadata.h"
+#include "tagparser.h"
+#include "trace.h"
 #include <QMediaMetaData>
 #include <QMediaPlayer>
 #include <QAudioDecoder>
 #include <QFile>
 #include <QFileInfo>
 #include <QEventLoop>
+#include <QTimer>
 #include <QUrl>
+#include <algorithm>
+#include <iterator>
 
-Metadata MetadataReader::readMetadata(const QString &filePath) {
+// How often a waiting read checks whether it has been cancelled
+static const int CancelPollMs = 50;
+
+Metadata MetadataReader::readMetadata(const QString &filePath, int timeoutMs, const CancelCheck &cancelled, bool *ok) {
+    TRACE_SCOPE("MetadataReader::readMetadata");
     Metadata metadata;
     metadata.filePath = filePath;
 
-    // Use QMediaPlayer to read metadata
-    QMediaPlayer player;
-    player.setSource(QUrl::fromLocalFile(filePath));
+    // Parse tags and stream headers natively; only start a multimedia
+    // pipeline for files the parser doesn't understand
+    bool read = true;
+    if (!TagParser::parse(filePath, metadata)) {
+        metadata = Metadata();
+        metadata.filePath = filePath;
+        read = readWithMediaPlayer(metadata, timeoutMs, cancelled);
+    }
 
-    // Wait for metadata to be loaded
-    QEventLoop loop;
-    QObject::connect(&player, &QMediaPlayer::durationChanged, &loop, &QEventLoop::quit);
-    loop.exec();
+    applyFallbacks(metadata);
+    if (ok) {
+        *ok = read;
+    }
+    return metadata;
+}
 
-    // Extract metadata
-    metadata.title = player.metaData().value(QMediaMetaData::Title).toString();
-    metadata.artist = player.metaData().value(QMediaMetaData::ContributingArtist).toString();
-    metadata.album = player.metaData().value(QMediaMetaData::AlbumTitle).toString();
-    metadata.genre = player.metaData().value(QMediaMetaData::Genre).toString();
-    metadata.duration = player.duration();
-    metadata.trackNumber = player.metaData().value(QMediaMetaData::TrackNumber).toInt();
-    metadata.year = player.metaData().value(QMediaMetaData::Date).toString().left(4).toInt();
+Metadata MetadataReader::fromFileName(const QString &filePath) {
+    Metadata metadata;
+    metadata.filePath = filePath;
+    applyFallbacks(metadata);
+    return metadata;
+}
 
+void MetadataReader::applyFallbacks(Metadata &metadata) {
     // Use filename as fallback for title
     if (metadata.title.isEmpty()) {
-        QFileInfo fileInfo(filePath);
+        QFileInfo fileInfo(metadata.filePath);
         metadata.title = fileInfo.baseName();
     }
 
@@ -42,6 +57,71 @@ Metadata MetadataReader::readMetadata(const QString &filePath) {
     if (metadata.album.isEmpty()) {
         metadata.album = "Unknown Album";
     }
+}
 
-    return metadata;
+bool MetadataReader::isAudioFile(const QString &filePath) {
+    static const char *const audioExtensions[] = {".mp3", ".flac", ".ogg", ".wav", ".m4a", ".aac", ".wma"};
+    return std::any_of(std::begin(audioExtensions), std::end(audioExtensions),
+                       [&filePath](const char *ext) {
+                           return filePath.endsWith(QLatin1String(ext), Qt::CaseInsensitive);
+                       });
+}
+
+bool MetadataReader::readWithMediaPlayer(Metadata &metadata, int timeoutMs, const CancelCheck &cancelled) {
+    TRACE_SCOPE("MetadataReader::readWithMediaPlayer");
+    // Use QMediaPlayer to read metadata
+    QMediaPlayer player;
+    QEventLoop loop;
+    bool loaded = false;
+
+    // Wait for metadata to be loaded. A broken or unsupported file may never
+    // report a duration, so errors, the deadline and cancellation end the
+    // wait as well.
+    QObject::connect(&player, &QMediaPlayer::durationChanged, &loop, [&loop, &loaded]() {
+        loaded = true;
+        loop.quit();
+    });
+    QObject::connect(&player, &QMediaPlayer::mediaStatusChanged, &loop,
+                     [&loop, &loaded](QMediaPlayer::MediaStatus status) {
+        if (status == QMediaPlayer::LoadedMedia) {
+            loaded = true;
+            loop.quit();
+        } else if (status == QMediaPlayer::InvalidMedia) {
+            loop.quit();
+        }
+    });
+    QObject::connect(&player, &QMediaPlayer::errorOccurred, &loop, &QEventLoop::quit);
+
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    QObject::connect(&deadline, &QTimer::timeout, &loop, &QEventLoop::quit);
+    deadline.start(timeoutMs);
+
+    QTimer cancelPoll;
+    if (cancelled) {
+        QObject::connect(&cancelPoll, &QTimer::timeout, &loop, [&loop, &cancelled]() {
+            if (cancelled()) {
+                loop.quit();
+            }
+        });
+        cancelPoll.start(CancelPollMs);
+    }
+
+    player.setSource(QUrl::fromLocalFile(metadata.filePath));
+    if (!loaded && player.error() == QMediaPlayer::NoError && !(cancelled && cancelled())) {
+        loop.exec();
+    }
+    if (!loaded) {
+        return false;
+    }
+
+    // Extract metadata
+    metadata.title = player.metaData().value(QMediaMetaData::Title).toString();
+    metadata.artist = player.metaData().value(QMediaMetaData::ContributingArtist).toString();
+    metadata.album = player.metaData().value(QMediaMetaData::AlbumTitle).toString();
+    metadata.genre = player.metaData().value(QMediaMetaData::Genre).toString();
+    metadata.duration = player.duration();
+    metadata.trackNumber = player.metaData().value(QMediaMetaData::TrackNumber).toInt();
+    metadata.year = player.metaData().value(QMediaMetaData::Date).toString().left(4).toInt();
+    return true;
 }
@@ -3,6 +3,7 @@
 
 #include <QString>
 #include <QVariant>
+#include <functional>
 
 struct Metadata {
     QString filePath;
@@ -19,10 +20,24 @@ struct Metadata {
 
 class MetadataReader {
 public:
-    static Metadata readMetadata(const QString &filePath);
+    // How long a file the tag parser can't read may keep a media player busy
+    static const int DefaultTimeoutMs = 5000;
+    // Polled while a read waits on the media player; true abandons the read
+    using CancelCheck = std::function<bool()>;
+
+    // A file that can't be read before the deadline, or at all, gets the
+    // fallback metadata of fromFileName() and sets ok to false
+    static Metadata readMetadata(const QString &filePath, int timeoutMs = DefaultTimeoutMs,
+                                 const CancelCheck &cancelled = CancelCheck(), bool *ok = nullptr);
+    // Title from the file name, placeholder artist and album
+    static Metadata fromFileName(const QString &filePath);
+    // By extension only; safe to call from any thread
+    static bool isAudioFile(const QString &filePath);
 
 private:
     MetadataReader() {}
+    static bool readWithMediaPlayer(Metadata &metadata, int timeoutMs, const CancelCheck &cancelled);
+    static void applyFallbacks(Metadata &metadata);
 };
 
 #endif // METADATA_H
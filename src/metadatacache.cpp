@@ -0,0 +1,228 @@
+#include "metadatacache.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStandardPaths>
+#include <QThread>
+
+static const int SchemaVersion = 1;
+
+MetadataCache::ThreadConnection::~ThreadConnection() {
+    // Runs when the owning thread exits; the queries must go before the connection
+    delete lookupQuery;
+    delete quarantineQuery;
+    QSqlDatabase::removeDatabase(name);
+}
+
+MetadataCache::MetadataCache(const QString &databasePath)
+    : databasePath(databasePath), valid(false) {
+    QDir().mkpath(QFileInfo(databasePath).absolutePath());
+
+    ThreadConnection *conn = connection();
+    if (!conn) {
+        return;
+    }
+
+    QSqlDatabase db = QSqlDatabase::database(conn->name);
+    QSqlQuery query(db);
+    query.exec("PRAGMA user_version");
+    const int version = query.next() ? query.value(0).toInt() : 0;
+    if (version != SchemaVersion) {
+        query.exec("DROP TABLE IF EXISTS tracks");
+    }
+
+    const bool created = query.exec(
+        "CREATE TABLE IF NOT EXISTS tracks ("
+        " path TEXT PRIMARY KEY,"
+        " size INTEGER NOT NULL,"
+        " mtime INTEGER NOT NULL,"
+        " title TEXT, artist TEXT, album TEXT, genre TEXT,"
+        " duration INTEGER, track_number INTEGER, year INTEGER)")
+        && query.exec("CREATE INDEX IF NOT EXISTS tracks_path_size_mtime ON tracks (path, size, mtime)")
+        && query.exec(
+            "CREATE TABLE IF NOT EXISTS quarantine ("
+            " path TEXT PRIMARY KEY,"
+            " size INTEGER NOT NULL,"
+            " mtime INTEGER NOT NULL)")
+        && query.exec(QString("PRAGMA user_version = %1").arg(SchemaVersion));
+    if (!created) {
+        qWarning() << "Failed to create metadata cache schema:" << query.lastError().text();
+        return;
+    }
+    valid = true;
+}
+
+QString MetadataCache::defaultPath() {
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+           + "/SimplePlayerQt/library.db";
+}
+
+MetadataCache::ThreadConnection *MetadataCache::connection() {
+    if (connections.hasLocalData()) {
+        return connections.localData();
+    }
+
+    const QString name = QString("metadatacache-%1-%2")
+                             .arg(quintptr(this), 0, 16)
+                             .arg(quintptr(QThread::currentThread()), 0, 16);
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+    db.setDatabaseName(databasePath);
+    if (!db.open()) {
+        qWarning() << "Failed to open metadata cache" << databasePath << ":" << db.lastError().text();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+        return nullptr;
+    }
+
+    // WAL lets the import workers read while the GUI thread writes
+    QSqlQuery pragma(db);
+    pragma.exec("PRAGMA journal_mode = WAL");
+    pragma.exec("PRAGMA synchronous = NORMAL");
+    pragma.exec("PRAGMA busy_timeout = 2000");
+
+    ThreadConnection *conn = new ThreadConnection();
+    conn->name = name;
+    conn->lookupQuery = new QSqlQuery(db);
+    conn->lookupQuery->prepare(
+        "SELECT title, artist, album, genre, duration, track_number, year"
+        " FROM tracks WHERE path = ? AND size = ? AND mtime = ?");
+    conn->quarantineQuery = new QSqlQuery(db);
+    conn->quarantineQuery->prepare("SELECT 1 FROM quarantine WHERE path = ? AND size = ? AND mtime = ?");
+    connections.setLocalData(conn);
+    return conn;
+}
+
+bool MetadataCache::lookup(const QString &filePath, qint64 size, qint64 modified, Metadata &metadata) {
+    if (!valid) {
+        return false;
+    }
+    ThreadConnection *conn = connection();
+    if (!conn) {
+        return false;
+    }
+
+    QSqlQuery *query = conn->lookupQuery;
+    query->addBindValue(filePath);
+    query->addBindValue(size);
+    query->addBindValue(modified);
+    if (!query->exec() || !query->next()) {
+        query->finish();
+        return false;
+    }
+
+    metadata.filePath = filePath;
+    metadata.title = query->value(0).toString();
+    metadata.artist = query->value(1).toString();
+    metadata.album = query->value(2).toString();
+    metadata.genre = query->value(3).toString();
+    metadata.duration = query->value(4).toLongLong();
+    metadata.trackNumber = query->value(5).toInt();
+    metadata.year = query->value(6).toInt();
+    query->finish();
+    return true;
+}
+
+void MetadataCache::store(const QList<CacheEntry> &entries) {
+    if (!valid || entries.isEmpty()) {
+        return;
+    }
+    ThreadConnection *conn = connection();
+    if (!conn) {
+        return;
+    }
+
+    // One transaction per batch; replacing the row also drops a stale entry
+    QSqlDatabase db = QSqlDatabase::database(conn->name);
+    db.transaction();
+    QSqlQuery query(db);
+    query.prepare(
+        "INSERT OR REPLACE INTO tracks"
+        " (path, size, mtime, title, artist, album, genre, duration, track_number, year)"
+        " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    for (const CacheEntry &entry : entries) {
+        const Metadata &metadata = entry.metadata;
+        query.addBindValue(metadata.filePath);
+        query.addBindValue(entry.size);
+        query.addBindValue(entry.modified);
+        query.addBindValue(metadata.title);
+        query.addBindValue(metadata.artist);
+        query.addBindValue(metadata.album);
+        query.addBindValue(metadata.genre);
+        query.addBindValue(metadata.duration);
+        query.addBindValue(metadata.trackNumber);
+        query.addBindValue(metadata.year);
+        if (!query.exec()) {
+            qWarning() << "Failed to cache metadata for" << metadata.filePath << ":" << query.lastError().text();
+        }
+    }
+    db.commit();
+}
+
+void MetadataCache::remove(const QStringList &filePaths) {
+    if (!valid || filePaths.isEmpty()) {
+        return;
+    }
+    ThreadConnection *conn = connection();
+    if (!conn) {
+        return;
+    }
+
+    QSqlDatabase db = QSqlDatabase::database(conn->name);
+    db.transaction();
+    QSqlQuery query(db);
+    QSqlQuery quarantineQuery(db);
+    query.prepare("DELETE FROM tracks WHERE path = ?");
+    quarantineQuery.prepare("DELETE FROM quarantine WHERE path = ?");
+    for (const QString &filePath : filePaths) {
+        query.addBindValue(filePath);
+        query.exec();
+        quarantineQuery.addBindValue(filePath);
+        quarantineQuery.exec();
+    }
+    db.commit();
+}
+
+bool MetadataCache::isQuarantined(const QString &filePath, qint64 size, qint64 modified) {
+    if (!valid) {
+        return false;
+    }
+    ThreadConnection *conn = connection();
+    if (!conn) {
+        return false;
+    }
+
+    QSqlQuery *query = conn->quarantineQuery;
+    query->addBindValue(filePath);
+    query->addBindValue(size);
+    query->addBindValue(modified);
+    const bool found = query->exec() && query->next();
+    query->finish();
+    return found;
+}
+
+void MetadataCache::quarantine(const QList<CacheEntry> &entries) {
+    if (!valid || entries.isEmpty()) {
+        return;
+    }
+    ThreadConnection *conn = connection();
+    if (!conn) {
+        return;
+    }
+
+    QSqlDatabase db = QSqlDatabase::database(conn->name);
+    db.transaction();
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO quarantine (path, size, mtime) VALUES (?, ?, ?)");
+    for (const CacheEntry &entry : entries) {
+        query.addBindValue(entry.metadata.filePath);
+        query.addBindValue(entry.size);
+        query.addBindValue(entry.modified);
+        if (!query.exec()) {
+            qWarning() << "Failed to quarantine" << entry.metadata.filePath << ":" << query.lastError().text();
+        }
+    }
+    db.commit();
+}
@@ -0,0 +1,58 @@
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QThreadStorage>
+#include "metadata.h"
+
+class QSqlQuery;
+
+// A metadata record together with the file state it was read from
+struct CacheEntry {
+    Metadata metadata;
+    qint64 size;
+    qint64 modified;  // mtime in ms since epoch
+
+    CacheEntry() : size(0), modified(0) {}
+};
+
+// Persistent SQLite library of already-read metadata, keyed by path, size
+// and mtime so a changed file is never served from the cache. Files that
+// could not be read are quarantined under the same key, so they are not
+// probed again until they change. Lookups may run on any thread; each
+// thread gets its own connection.
+class MetadataCache {
+public:
+    explicit MetadataCache(const QString &databasePath = defaultPath());
+
+    static QString defaultPath();
+
+    bool isValid() const { return valid; }
+    bool lookup(const QString &filePath, qint64 size, qint64 modified, Metadata &metadata);
+    void store(const QList<CacheEntry> &entries);
+    void remove(const QStringList &filePaths);
+
+    bool isQuarantined(const QString &filePath, qint64 size, qint64 modified);
+    // Only the path, size and mtime of the entries are kept
+    void quarantine(const QList<CacheEntry> &entries);
+
+private:
+    struct ThreadConnection {
+        QString name;
+        QSqlQuery *lookupQuery;
+        QSqlQuery *quarantineQuery;
+
+        ThreadConnection() : lookupQuery(nullptr), quarantineQuery(nullptr) {}
+        ~ThreadConnection();
+    };
+
+    ThreadConnection *connection();
+
+    QString databasePath;
+    QThreadStorage<ThreadConnection*> connections;
+    bool valid;
+};
+
+#endif // METADATACACHE_H
@@ -0,0 +1,165 @@
+#include "metadataingestor.h"
+#include "ioscheduler.h"
+#include "trace.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+// How often finished records are handed to the GUI thread
+static const int FlushIntervalMs = 50;
+
+MetadataIngestor::MetadataIngestor(QObject *parent)
+    : QObject(parent), nextToEmit(0), completed(0), total(0), generation(0) {
+    flushTimer.setInterval(FlushIntervalMs);
+    connect(&flushTimer, &QTimer::timeout, this, &MetadataIngestor::flush);
+}
+
+MetadataIngestor::~MetadataIngestor() {
+    ++generation;
+    IoScheduler::shared().cancel(this);
+    IoScheduler::shared().waitForDone(this);
+}
+
+void MetadataIngestor::enqueue(const QStringList &files) {
+    if (files.isEmpty()) {
+        return;
+    }
+
+    const quint64 currentGeneration = generation;
+    int firstSlot;
+    {
+        QMutexLocker locker(&mutex);
+        firstSlot = results.size();
+        results.resize(firstSlot + files.size());
+        ready.resize(firstSlot + files.size(), false);
+    }
+    total += files.size();
+
+    // The device lookup is a stat, which can stall on a sleeping disk or
+    // a network mount, so it is left to the scheduler's threads
+    for (int i = 0; i < files.size(); ++i) {
+        const int slot = firstSlot + i;
+        const QString filePath = files[i];
+        IoScheduler::shared().submitPath(this, QFile::encodeName(filePath), [this, currentGeneration, slot, filePath]() {
+            readFile(currentGeneration, slot, filePath);
+        });
+    }
+
+    if (!flushTimer.isActive()) {
+        flushTimer.start();
+    }
+    emit progressChanged(completed, total);
+}
+
+void MetadataIngestor::cancel() {
+    if (!isBusy()) {
+        return;
+    }
+
+    // Workers still running check the generation and drop their result
+    ++generation;
+    IoScheduler::shared().cancel(this);
+    reset();
+    emit finished(true);
+}
+
+bool MetadataIngestor::isBusy() const {
+    return total > 0;
+}
+
+void MetadataIngestor::forget(const QStringList &files) {
+    if (!files.isEmpty()) {
+        metadataCache.remove(files);
+    }
+}
+
+void MetadataIngestor::readFile(quint64 fileGeneration, int slot, const QString &filePath) {
+    TRACE_SCOPE("MetadataIngestor::readFile");
+    if (generation != fileGeneration) {
+        return;
+    }
+
+    // An unchanged file is served from the library without being opened
+    const QFileInfo fileInfo(filePath);
+    CacheEntry entry;
+    entry.size = fileInfo.size();
+    entry.modified = fileInfo.lastModified().toMSecsSinceEpoch();
+    bool cached = fileInfo.exists()
+                  && metadataCache.lookup(filePath, entry.size, entry.modified, entry.metadata);
+    // A file that failed before is not probed again until it changes
+    if (!cached && fileInfo.exists() && metadataCache.isQuarantined(filePath, entry.size, entry.modified)) {
+        entry.metadata = MetadataReader::fromFileName(filePath);
+        cached = true;
+    }
+
+    bool ok = true;
+    if (!cached) {
+        entry.metadata = MetadataReader::readMetadata(filePath, MetadataReader::DefaultTimeoutMs,
+                                                      [this, fileGeneration]() {
+            return generation != fileGeneration;
+        }, &ok);
+    }
+
+    QMutexLocker locker(&mutex);
+    // Also drops reads that were cut short by cancelling
+    if (generation != fileGeneration) {
+        return;
+    }
+    if (!cached && fileInfo.exists()) {
+        (ok ? cacheMisses : failures).append(entry);
+    }
+    results[slot] = std::move(entry.metadata);
+    ready[slot] = true;
+    ++completed;
+}
+
+void MetadataIngestor::flush() {
+    QList<Metadata> batch;
+    QList<CacheEntry> misses;
+    QList<CacheEntry> failed;
+    int done;
+    {
+        QMutexLocker locker(&mutex);
+        // Only hand out the contiguous finished prefix so the playlist keeps import order
+        while (nextToEmit < results.size() && ready[nextToEmit]) {
+            batch.append(std::move(results[nextToEmit]));
+            results[nextToEmit] = Metadata();
+            ++nextToEmit;
+        }
+        misses.swap(cacheMisses);
+        failed.swap(failures);
+        done = completed;
+    }
+
+    // Newly read files are written back in one transaction per flush
+    metadataCache.store(misses);
+    for (const CacheEntry &entry : std::as_const(failed)) {
+        qWarning() << "Could not read metadata from" << entry.metadata.filePath << "; using the file name";
+    }
+    metadataCache.quarantine(failed);
+
+    if (!batch.isEmpty()) {
+        emit tracksReady(batch);
+    }
+    emit progressChanged(done, total);
+
+    if (done == total) {
+        reset();
+        emit finished(false);
+    }
+}
+
+void MetadataIngestor::reset() {
+    flushTimer.stop();
+
+    QMutexLocker locker(&mutex);
+    results.clear();
+    ready.clear();
+    cacheMisses.clear();
+    failures.clear();
+    nextToEmit = 0;
+    completed = 0;
+    total = 0;
+}
@@ -0,0 +1,61 @@
+#ifndef METADATAINGESTOR_H
+#define METADATAINGESTOR_H
+
+#include <QObject>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+#include <QTimer>
+#include <atomic>
+#include "metadata.h"
+#include "metadatacache.h"
+
+// Reads metadata for imported files through the I/O scheduler, queued per
+// device so a spinning disk is read one file at a time, and streams the
+// results back to the GUI thread in import order, one batch per flush. Files
+// already in the library cache are served from it without being opened.
+// Each read is bounded by a deadline and abandoned when the import is
+// cancelled; files that fail get filename metadata and are quarantined.
+class MetadataIngestor : public QObject {
+    Q_OBJECT
+
+public:
+    explicit MetadataIngestor(QObject *parent = nullptr);
+    ~MetadataIngestor();
+
+    void enqueue(const QStringList &files);
+    void cancel();
+    bool isBusy() const;
+
+    // Drops files that no longer exist from the library cache
+    void forget(const QStringList &files);
+
+signals:
+    void tracksReady(const QList<Metadata> &tracks);
+    void progressChanged(int done, int total);
+    void finished(bool cancelled);
+
+private slots:
+    void flush();
+
+private:
+    void readFile(quint64 generation, int slot, const QString &filePath);
+    void reset();
+
+    MetadataCache metadataCache;
+    QTimer flushTimer;
+
+    // Guarded by mutex; one slot per enqueued file, in import order
+    QMutex mutex;
+    QList<Metadata> results;
+    QList<bool> ready;
+    QList<CacheEntry> cacheMisses;
+    QList<CacheEntry> failures;
+    int nextToEmit;
+    int completed;
+    int total;
+
+    std::atomic<quint64> generation;
+};
+
+#endif // METADATAINGESTOR_H
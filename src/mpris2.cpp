@@ -1,13 +1,65 @@
 #include "mpris2.h"
 #include "mainwindow.h"
+#include "playbackengine.h"
+#include "playlistmodel.h"
 #include <QDBusConnection>
 #include <QDBusError>
+#include <QDBusMessage>
 #include <QDBusMetaType>
 #include <QDebug>
 #include <QCoreApplication>
 #include <QMediaPlayer>
+#include <QUrl>
 #include <cstdio>
 
+namespace {
+
+const char ObjectPath[] = "/org/mpris/MediaPlayer2";
+const char PlayerInterface[] = "org.mpris.MediaPlayer2.Player";
+const char NoTrackPath[] = "/org/mpris/MediaPlayer2/TrackList/NoTrack";
+const char TrackPathPrefix[] = "/org/simpleplayerqt/Track/";
+
+// Tracks publishes at most this many rows, starting this far before the
+// current track
+const int MaxPublishedTracks = 500;
+const int PublishedLead = 20;
+// Larger edits to the published rows are announced as TrackListReplaced
+const int MaxIncrementalChanges = 16;
+
+QString playbackStatusName(QMediaPlayer::PlaybackState state) {
+    switch (state) {
+    case QMediaPlayer::PlayingState:
+        return "Playing";
+    case QMediaPlayer::PausedState:
+        return "Paused";
+    default:
+        return "Stopped";
+    }
+}
+
+QVariantMap metadataMap(const Metadata &metadata, const QDBusObjectPath &trackId) {
+    QVariantMap map;
+    map.insert("mpris:trackid", QVariant::fromValue(trackId));
+    map.insert("mpris:length", metadata.duration * 1000);
+    map.insert("xesam:url", QUrl::fromLocalFile(metadata.filePath).toString());
+    map.insert("xesam:title", metadata.title);
+    if (!metadata.artist.isEmpty()) {
+        map.insert("xesam:artist", QStringList{metadata.artist});
+    }
+    if (!metadata.album.isEmpty()) {
+        map.insert("xesam:album", metadata.album);
+    }
+    if (!metadata.genre.isEmpty()) {
+        map.insert("xesam:genre", QStringList{metadata.genre});
+    }
+    if (metadata.trackNumber > 0) {
+        map.insert("xesam:trackNumber", metadata.trackNumber);
+    }
+    return map;
+}
+
+} // namespace
+
 // Mpris2RootAdaptor implementation
 Mpris2RootAdaptor::Mpris2RootAdaptor(QObject *parent)
     : QDBusAbstractAdaptor(parent) {
@@ -23,100 +75,229 @@ void Mpris2RootAdaptor::Quit() {
 }
 
 // Mpris2PlayerAdaptor implementation
-Mpris2PlayerAdaptor::Mpris2PlayerAdaptor(QObject *parent)
-    : QDBusAbstractAdaptor(parent), m_mainWindow(nullptr) {
+Mpris2PlayerAdaptor::Mpris2PlayerAdaptor(Mpris2 *parent, MainWindow *mainWindow, PlaybackEngine *player)
+    : QDBusAbstractAdaptor(parent), m_mpris(parent), m_mainWindow(mainWindow), m_player(player) {
     setAutoRelaySignals(true);
 }
 
-void Mpris2PlayerAdaptor::setMainWindow(MainWindow *mw) {
-    m_mainWindow = mw;
-}
-
 void Mpris2PlayerAdaptor::Play() {
-    if (m_mainWindow) {
-        // For MPRIS2, Play should toggle play/pause when called from media keys
-        QMetaObject::invokeMethod(m_mainWindow, "onPauseClicked", Qt::QueuedConnection);
-    }
+    QMetaObject::invokeMethod(m_mainWindow, "onPlayClicked", Qt::QueuedConnection);
 }
 
 void Mpris2PlayerAdaptor::Pause() {
-    if (m_mainWindow) {
-        QMetaObject::invokeMethod(m_mainWindow, "onPauseClicked", Qt::QueuedConnection);
+    if (m_player->playbackState() == QMediaPlayer::PlayingState) {
+        m_player->pause();
     }
 }
 
 void Mpris2PlayerAdaptor::PlayPause() {
-    if (m_mainWindow) {
+    if (m_player->playbackState() == QMediaPlayer::StoppedState) {
+        QMetaObject::invokeMethod(m_mainWindow, "onPlayClicked", Qt::QueuedConnection);
+    } else {
         QMetaObject::invokeMethod(m_mainWindow, "onPauseClicked", Qt::QueuedConnection);
     }
 }
 
 void Mpris2PlayerAdaptor::Stop() {
-    if (m_mainWindow) {
-        QMetaObject::invokeMethod(m_mainWindow, "onStopClicked", Qt::QueuedConnection);
-    }
+    QMetaObject::invokeMethod(m_mainWindow, "onStopClicked", Qt::QueuedConnection);
 }
 
 void Mpris2PlayerAdaptor::Next() {
-    if (m_mainWindow) {
-        QMetaObject::invokeMethod(m_mainWindow, "onNextTrack", Qt::QueuedConnection);
-    }
+    QMetaObject::invokeMethod(m_mainWindow, "onNextTrack", Qt::QueuedConnection);
 }
 
 void Mpris2PlayerAdaptor::Previous() {
-    if (m_mainWindow) {
-        QMetaObject::invokeMethod(m_mainWindow, "onPreviousTrack", Qt::QueuedConnection);
-    }
+    QMetaObject::invokeMethod(m_mainWindow, "onPreviousTrack", Qt::QueuedConnection);
 }
 
 void Mpris2PlayerAdaptor::Seek(qint64 Offset) {
-    if (m_mainWindow) {
-        // Seek by offset
+    if (!CanSeek()) {
+        return;
+    }
+
+    // MPRIS times are in microseconds; seeking past the end skips the track
+    const qint64 target = m_player->position() + Offset / 1000;
+    if (target >= m_player->duration()) {
+        Next();
+    } else {
+        m_player->setPosition(qMax<qint64>(0, target));
     }
 }
 
 void Mpris2PlayerAdaptor::SetPosition(const QDBusObjectPath &TrackId, qint64 Position) {
-    if (m_mainWindow) {
-        // Set position
+    // Requests for a track that is no longer current are ignored, as are
+    // positions outside the track
+    const qint64 target = Position / 1000;
+    if (!CanSeek() || TrackId != m_mpris->currentTrackId() || target < 0 || target > m_player->duration()) {
+        return;
     }
+    m_player->setPosition(target);
 }
 
 void Mpris2PlayerAdaptor::OpenUri(const QString &Uri) {
-    if (m_mainWindow) {
-        // Open URI
-    }
+    QMetaObject::invokeMethod(m_mainWindow, "onRemoteOpenUri", Qt::QueuedConnection, Q_ARG(QString, Uri));
 }
 
 QString Mpris2PlayerAdaptor::PlaybackStatus() const {
-    return "Stopped";
+    return m_mpris->playerProperty("PlaybackStatus").toString();
+}
+
+QString Mpris2PlayerAdaptor::LoopStatus() const {
+    return m_mpris->playerProperty("LoopStatus").toString();
+}
+
+void Mpris2PlayerAdaptor::SetLoopStatus(const QString &loopStatus) {
+    int repeatMode;
+    if (loopStatus == "None") {
+        repeatMode = MainWindow::RepeatOff;
+    } else if (loopStatus == "Playlist") {
+        repeatMode = MainWindow::RepeatAll;
+    } else if (loopStatus == "Track") {
+        repeatMode = MainWindow::RepeatOne;
+    } else {
+        return;
+    }
+    QMetaObject::invokeMethod(m_mainWindow, "onRemoteRepeatMode", Qt::QueuedConnection, Q_ARG(int, repeatMode));
+}
+
+bool Mpris2PlayerAdaptor::Shuffle() const {
+    return m_mpris->playerProperty("Shuffle").toBool();
+}
+
+void Mpris2PlayerAdaptor::SetShuffle(bool shuffle) {
+    QMetaObject::invokeMethod(m_mainWindow, "onRemoteShuffle", Qt::QueuedConnection, Q_ARG(bool, shuffle));
 }
 
 QVariantMap Mpris2PlayerAdaptor::Metadata() const {
-    return QVariantMap();
+    return m_mpris->playerProperty("Metadata").toMap();
 }
 
 double Mpris2PlayerAdaptor::Volume() const {
-    return 0.5;
+    return m_mpris->playerProperty("Volume").toDouble();
 }
 
 void Mpris2PlayerAdaptor::SetVolume(double volume) {
-    if (m_mainWindow) {
-        // Set volume
-    }
+    // Through the volume slider, so the window shows the new level
+    const int percent = qRound(qBound(0.0, volume, 1.0) * 100);
+    QMetaObject::invokeMethod(m_mainWindow, "onRemoteVolume", Qt::QueuedConnection, Q_ARG(int, percent));
 }
 
 qint64 Mpris2PlayerAdaptor::Position() const {
-    return 0;
+    // Read on demand; position is never announced through PropertiesChanged
+    return m_player->position() * 1000;
+}
+
+bool Mpris2PlayerAdaptor::CanGoNext() const {
+    return m_mpris->playerProperty("CanGoNext").toBool();
+}
+
+bool Mpris2PlayerAdaptor::CanGoPrevious() const {
+    return m_mpris->playerProperty("CanGoPrevious").toBool();
+}
+
+bool Mpris2PlayerAdaptor::CanPlay() const {
+    return m_mpris->playerProperty("CanPlay").toBool();
+}
+
+bool Mpris2PlayerAdaptor::CanPause() const {
+    return m_mpris->playerProperty("CanPause").toBool();
+}
+
+bool Mpris2PlayerAdaptor::CanSeek() const {
+    return m_mpris->playerProperty("CanSeek").toBool();
+}
+
+// Mpris2TrackListAdaptor implementation
+Mpris2TrackListAdaptor::Mpris2TrackListAdaptor(Mpris2 *parent, MainWindow *mainWindow)
+    : QDBusAbstractAdaptor(parent), m_mpris(parent), m_mainWindow(mainWindow) {
+    setAutoRelaySignals(true);
+}
+
+QList<QDBusObjectPath> Mpris2TrackListAdaptor::Tracks() const {
+    return m_mpris->publishedTracks();
+}
+
+QList<QVariantMap> Mpris2TrackListAdaptor::GetTracksMetadata(const QList<QDBusObjectPath> &TrackIds) {
+    return m_mpris->tracksMetadata(TrackIds);
+}
+
+// Edits resolve the track id and apply right away. None of the main
+// window's handlers read tags or run an event loop (AddTrack inserts
+// filename metadata and queues the tag read), so the row can't go stale
+// before it is used
+
+void Mpris2TrackListAdaptor::AddTrack(const QString &Uri, const QDBusObjectPath &AfterTrack, bool SetAsCurrent) {
+    int row = 0;
+    if (AfterTrack.path() != NoTrackPath) {
+        row = m_mpris->rowOfTrack(AfterTrack);
+        if (row < 0) {
+            return;
+        }
+        ++row;
+    }
+    QMetaObject::invokeMethod(m_mainWindow, "onRemoteAddTrack", Qt::DirectConnection,
+                              Q_ARG(QString, Uri), Q_ARG(int, row), Q_ARG(bool, SetAsCurrent));
+}
+
+void Mpris2TrackListAdaptor::RemoveTrack(const QDBusObjectPath &TrackId) {
+    const int row = m_mpris->rowOfTrack(TrackId);
+    if (row >= 0) {
+        QMetaObject::invokeMethod(m_mainWindow, "onRemoteRemoveTrack", Qt::DirectConnection, Q_ARG(int, row));
+    }
+}
+
+void Mpris2TrackListAdaptor::GoTo(const QDBusObjectPath &TrackId) {
+    const int row = m_mpris->rowOfTrack(TrackId);
+    if (row >= 0) {
+        QMetaObject::invokeMethod(m_mainWindow, "onRemotePlayRow", Qt::DirectConnection, Q_ARG(int, row));
+    }
 }
 
 // Mpris2 implementation
-Mpris2::Mpris2(MainWindow *mainWindow)
-    : QObject(mainWindow), m_mainWindow(mainWindow), m_dbusConnection(QDBusConnection::sessionBus()) {
+Mpris2::Mpris2(MainWindow *mainWindow, PlaybackEngine *player, PlaylistModel *playlist)
+    : QObject(mainWindow), m_mainWindow(mainWindow), m_player(player), m_playlist(playlist),
+      m_dbusConnection(QDBusConnection::sessionBus()), m_nextTrackId(0), m_trackRowsStale(true),
+      m_windowStart(0), m_windowEnd(0), m_seekPosition(-1), m_flushPending(false) {
+    qDBusRegisterMetaType<QList<QVariantMap>>();
+
+    // Starting values; nothing is announced for these
+    m_metadata.insert("mpris:trackid", QVariant::fromValue(QDBusObjectPath(NoTrackPath)));
+    m_playerProperties.insert("PlaybackStatus", playbackStatusName(player->playbackState()));
+    m_playerProperties.insert("LoopStatus", QString("None"));
+    m_playerProperties.insert("Shuffle", false);
+    m_playerProperties.insert("Metadata", m_metadata);
+    m_playerProperties.insert("Volume", double(player->volume()));
+    m_playerProperties.insert("CanGoNext", false);
+    m_playerProperties.insert("CanGoPrevious", false);
+    m_playerProperties.insert("CanPlay", false);
+    m_playerProperties.insert("CanPause", false);
+    m_playerProperties.insert("CanSeek", false);
+
+    // Only discrete events are followed; steady playback sends nothing
+    connect(player, &PlaybackEngine::playbackStateChanged, this, &Mpris2::onPlaybackStateChanged);
+    connect(player, &PlaybackEngine::durationChanged, this, &Mpris2::onDurationChanged);
+    connect(player, &PlaybackEngine::seeked, this, &Mpris2::onSeeked);
+    connect(player, &PlaybackEngine::volumeChanged, this, [this](float volume) {
+        updatePlayerProperty("Volume", double(volume));
+    });
 
     // Create adaptors - these must be children of this object for ExportAdaptors to work
     m_rootAdaptor = new Mpris2RootAdaptor(this);
-    m_playerAdaptor = new Mpris2PlayerAdaptor(this);
-    m_playerAdaptor->setMainWindow(mainWindow);
+    m_playerAdaptor = new Mpris2PlayerAdaptor(this, mainWindow, player);
+    m_trackListAdaptor = new Mpris2TrackListAdaptor(this, mainWindow);
+
+    // Track ids for the rows already in the playlist. These connections
+    // come before MainWindow's, so ids are current when it reports state.
+    m_trackIds.resize(playlist->rowCount());
+    for (int row = 0; row < m_trackIds.size(); ++row) {
+        m_trackIds[row] = m_nextTrackId++;
+    }
+    m_windowEnd = qMin<int>(m_trackIds.size(), MaxPublishedTracks);
+    connect(playlist, &PlaylistModel::rowsInserted, this, &Mpris2::onRowsInserted);
+    connect(playlist, &PlaylistModel::rowsRemoved, this, &Mpris2::onRowsRemoved);
+    connect(playlist, &PlaylistModel::rowsReordered, this, &Mpris2::onRowsReordered);
+    connect(playlist, &PlaylistModel::modelReset, this, &Mpris2::onModelReset);
+    connect(playlist, &PlaylistModel::dataChanged, this, &Mpris2::onDataChanged);
 
     RegisterService();
 }
@@ -127,7 +308,6 @@ Mpris2::~Mpris2() {
 
 bool Mpris2::RegisterService() {
     const QString serviceName = "org.mpris.MediaPlayer2.simpleplayerqt";
-    const QString objectPath = "/org/mpris/MediaPlayer2";
 
     // Check if D-Bus connection is valid
     if (!m_dbusConnection.isConnected()) {
@@ -136,8 +316,8 @@ bool Mpris2::RegisterService() {
     }
 
     // Register the D-Bus object
-    if (!m_dbusConnection.registerObject(objectPath, this, QDBusConnection::ExportAdaptors)) {
-        qWarning() << "Failed to register D-Bus object at" << objectPath;
+    if (!m_dbusConnection.registerObject(ObjectPath, this, QDBusConnection::ExportAdaptors)) {
+        qWarning() << "Failed to register D-Bus object at" << ObjectPath;
         return false;
     }
 
@@ -153,15 +333,254 @@ bool Mpris2::RegisterService() {
 
 void Mpris2::UnregisterService() {
     const QString serviceName = "org.mpris.MediaPlayer2.simpleplayerqt";
-    const QString objectPath = "/org/mpris/MediaPlayer2";
-    m_dbusConnection.unregisterObject(objectPath);
+    m_dbusConnection.unregisterObject(ObjectPath);
     m_dbusConnection.unregisterService(serviceName);
 }
 
-void Mpris2::updateMetadata() {
-    // Update metadata signals
+QDBusObjectPath Mpris2::currentTrackId() const {
+    return m_metadata.value("mpris:trackid").value<QDBusObjectPath>();
 }
 
-void Mpris2::updatePlaybackStatus() {
-    // Update playback status signals
+void Mpris2::updateMetadata(const Metadata &metadata, int trackIndex) {
+    QVariantMap map;
+    if (trackIndex < 0 || trackIndex >= m_trackIds.size()) {
+        trackIndex = -1;
+        map.insert("mpris:trackid", QVariant::fromValue(QDBusObjectPath(NoTrackPath)));
+    } else {
+        map = metadataMap(metadata, trackPath(trackIndex));
+    }
+
+    // The player's own duration wins once it is known
+    const bool sameTrack = map.value("mpris:trackid") == m_metadata.value("mpris:trackid");
+    if (sameTrack && m_metadata.contains("mpris:length") && m_player->duration() > 0) {
+        map.insert("mpris:length", m_player->duration() * 1000);
+    }
+
+    m_metadata = map;
+    updatePlayerProperty("Metadata", m_metadata);
+    updatePlayerProperty("CanSeek", trackIndex >= 0);
+    updatePlayerProperty("CanPause", trackIndex >= 0);
+
+    // Keep the current track, and some of what follows it, in Tracks
+    if (trackIndex >= 0
+        && (trackIndex < m_windowStart || trackIndex >= m_windowEnd
+            || (m_windowEnd < m_trackIds.size() && trackIndex >= m_windowEnd - PublishedLead))) {
+        replaceTrackList(trackIndex - PublishedLead);
+    }
+}
+
+void Mpris2::updateShuffle(bool shuffle) {
+    updatePlayerProperty("Shuffle", shuffle);
+}
+
+void Mpris2::updateLoopStatus(const QString &loopStatus) {
+    updatePlayerProperty("LoopStatus", loopStatus);
+}
+
+void Mpris2::updateNavigation(bool canGoNext, bool canGoPrevious, bool canPlay) {
+    updatePlayerProperty("CanGoNext", canGoNext);
+    updatePlayerProperty("CanGoPrevious", canGoPrevious);
+    updatePlayerProperty("CanPlay", canPlay);
+}
+
+void Mpris2::onPlaybackStateChanged(QMediaPlayer::PlaybackState state) {
+    updatePlayerProperty("PlaybackStatus", playbackStatusName(state));
+}
+
+void Mpris2::onDurationChanged(qint64 duration) {
+    if (duration <= 0 || !m_metadata.contains("mpris:length") || m_metadata.value("mpris:length").toLongLong() == duration * 1000) {
+        return;
+    }
+    m_metadata.insert("mpris:length", duration * 1000);
+    updatePlayerProperty("Metadata", m_metadata);
+}
+
+void Mpris2::onSeeked(qint64 position) {
+    // A slider drag seeks many times per turn; clients only need the last
+    m_seekPosition = position;
+    scheduleFlush();
+}
+
+void Mpris2::updatePlayerProperty(const QString &name, const QVariant &value) {
+    if (m_playerProperties.value(name) == value) {
+        return;
+    }
+    m_playerProperties.insert(name, value);
+    if (!m_changedProperties.contains(name)) {
+        m_changedProperties.append(name);
+    }
+    scheduleFlush();
+}
+
+void Mpris2::scheduleFlush() {
+    if (!m_flushPending) {
+        m_flushPending = true;
+        QMetaObject::invokeMethod(this, &Mpris2::flushChanges, Qt::QueuedConnection);
+    }
+}
+
+void Mpris2::flushChanges() {
+    m_flushPending = false;
+
+    if (!m_changedProperties.isEmpty()) {
+        QVariantMap changed;
+        for (const QString &name : std::as_const(m_changedProperties)) {
+            changed.insert(name, m_playerProperties.value(name));
+        }
+        m_changedProperties.clear();
+
+        QDBusMessage signal = QDBusMessage::createSignal(ObjectPath, "org.freedesktop.DBus.Properties", "PropertiesChanged");
+        signal << QString(PlayerInterface) << changed << QStringList();
+        m_dbusConnection.send(signal);
+    }
+
+    if (m_seekPosition >= 0) {
+        emit m_playerAdaptor->Seeked(m_seekPosition * 1000);
+        m_seekPosition = -1;
+    }
+}
+
+QDBusObjectPath Mpris2::trackPath(int row) const {
+    return QDBusObjectPath(TrackPathPrefix + QString::number(m_trackIds[row]));
+}
+
+QVariantMap Mpris2::trackMetadata(int row) const {
+    return metadataMap(m_playlist->getTrack(row), trackPath(row));
+}
+
+int Mpris2::rowOfTrack(const QDBusObjectPath &trackId) const {
+    const QString path = trackId.path();
+    if (!path.startsWith(TrackPathPrefix)) {
+        return -1;
+    }
+    bool ok = false;
+    const quint32 id = QStringView(path).mid(int(sizeof(TrackPathPrefix)) - 1).toUInt(&ok);
+    if (!ok) {
+        return -1;
+    }
+
+    if (m_trackRowsStale) {
+        m_trackRows.clear();
+        m_trackRows.reserve(m_trackIds.size());
+        for (int row = 0; row < m_trackIds.size(); ++row) {
+            m_trackRows.insert(m_trackIds[row], row);
+        }
+        m_trackRowsStale = false;
+    }
+    return m_trackRows.value(id, -1);
+}
+
+QList<QDBusObjectPath> Mpris2::publishedTracks() const {
+    QList<QDBusObjectPath> tracks;
+    tracks.reserve(m_windowEnd - m_windowStart);
+    for (int row = m_windowStart; row < m_windowEnd; ++row) {
+        tracks.append(trackPath(row));
+    }
+    return tracks;
+}
+
+QList<QVariantMap> Mpris2::tracksMetadata(const QList<QDBusObjectPath> &trackIds) const {
+    // Unknown ids are skipped, as the spec asks
+    QList<QVariantMap> metadata;
+    metadata.reserve(trackIds.size());
+    for (const QDBusObjectPath &trackId : trackIds) {
+        const int row = rowOfTrack(trackId);
+        if (row >= 0) {
+            metadata.append(trackMetadata(row));
+        }
+    }
+    return metadata;
+}
+
+void Mpris2::replaceTrackList(int firstRow) {
+    m_windowStart = qBound(0, firstRow, int(m_trackIds.size()));
+    m_windowEnd = qMin<int>(m_trackIds.size(), m_windowStart + MaxPublishedTracks);
+    emit m_trackListAdaptor->TrackListReplaced(publishedTracks(), currentTrackId());
+}
+
+void Mpris2::onRowsInserted(const QModelIndex &parent, int first, int last) {
+    Q_UNUSED(parent);
+    const int count = last - first + 1;
+    m_trackIds.insert(first, count, 0);
+    for (int row = first; row <= last; ++row) {
+        m_trackIds[row] = m_nextTrackId++;
+    }
+    m_trackRowsStale = true;
+
+    // Rows before the window move it; rows after it, or appended to a full
+    // window, aren't published
+    if (first < m_windowStart) {
+        m_windowStart += count;
+        m_windowEnd += count;
+        return;
+    }
+    if (first > m_windowEnd || (first == m_windowEnd && m_windowEnd - m_windowStart >= MaxPublishedTracks)) {
+        return;
+    }
+    if (count > MaxIncrementalChanges || m_windowEnd - m_windowStart + count > MaxPublishedTracks) {
+        replaceTrackList(m_windowStart);
+        return;
+    }
+
+    m_windowEnd += count;
+    for (int row = first; row <= last; ++row) {
+        const QDBusObjectPath afterTrack = row > 0 ? trackPath(row - 1) : QDBusObjectPath(NoTrackPath);
+        emit m_trackListAdaptor->TrackAdded(trackMetadata(row), afterTrack);
+    }
+}
+
+void Mpris2::onRowsRemoved(const QModelIndex &parent, int first, int last) {
+    Q_UNUSED(parent);
+    const int count = last - first + 1;
+
+    // Published tracks among the removed rows
+    QList<QDBusObjectPath> removed;
+    for (int row = qMax(first, m_windowStart); row < qMin(last + 1, m_windowEnd); ++row) {
+        removed.append(trackPath(row));
+    }
+
+    m_trackIds.remove(first, count);
+    m_trackRowsStale = true;
+    auto shift = [first, last, count](int row) {
+        return row > last ? row - count : qMin(row, first);
+    };
+    m_windowStart = shift(m_windowStart);
+    m_windowEnd = shift(m_windowEnd);
+
+    if (removed.size() > MaxIncrementalChanges) {
+        replaceTrackList(m_windowStart);
+        return;
+    }
+    for (const QDBusObjectPath &trackId : std::as_const(removed)) {
+        emit m_trackListAdaptor->TrackRemoved(trackId);
+    }
+}
+
+void Mpris2::onRowsReordered(const QList<int> &newRows) {
+    // Ids move with their rows; the published window is taken afresh
+    QList<quint32> reordered(m_trackIds.size());
+    for (int row = 0; row < m_trackIds.size(); ++row) {
+        reordered[newRows[row]] = m_trackIds[row];
+    }
+    m_trackIds = std::move(reordered);
+    m_trackRowsStale = true;
+
+    const int currentRow = rowOfTrack(currentTrackId());
+    replaceTrackList(currentRow >= 0 ? currentRow - PublishedLead : 0);
+}
+
+void Mpris2::onModelReset() {
+    m_trackIds.resize(m_playlist->rowCount());
+    for (int row = 0; row < m_trackIds.size(); ++row) {
+        m_trackIds[row] = m_nextTrackId++;
+    }
+    m_trackRowsStale = true;
+    replaceTrackList(0);
+}
+
+void Mpris2::onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+    // Only published tracks are announced; clients fetch the rest when asked
+    for (int row = qMax(topLeft.row(), m_windowStart); row < qMin(bottomRight.row() + 1, m_windowEnd); ++row) {
+        emit m_trackListAdaptor->TrackMetadataChanged(trackPath(row), trackMetadata(row));
+    }
 }
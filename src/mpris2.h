@@ -5,10 +5,16 @@
 #include <QDBusConnection>
 #include <QDBusAbstractAdaptor>
 #include <QDBusObjectPath>
+#include <QHash>
 #include <QMediaPlayer>
+#include <QStringList>
 #include <QVariantMap>
+#include "metadata.h"
 
 class MainWindow;
+class Mpris2;
+class PlaybackEngine;
+class PlaylistModel;
 
 // MPRIS2 Root Interface Adaptor
 class Mpris2RootAdaptor : public QDBusAbstractAdaptor {
@@ -38,7 +44,7 @@ private:
     void SetFullscreen(bool) {}
     bool CanSetFullscreen() const { return false; }
     bool CanRaise() const { return true; }
-    bool HasTrackList() const { return false; }
+    bool HasTrackList() const { return true; }
     QString Identity() const { return "SimplePlayerQt"; }
     QString DesktopEntry() const { return "simpleplayerqt"; }
     QStringList SupportedUriSchemes() const { return {"file"}; }
@@ -47,17 +53,19 @@ private:
     }
 };
 
-// MPRIS2 Player Interface Adaptor
+// MPRIS2 Player Interface Adaptor. Property reads come from the state
+// Mpris2 keeps; method calls are forwarded to the main window or player.
 class Mpris2PlayerAdaptor : public QDBusAbstractAdaptor {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "org.mpris.MediaPlayer2.Player")
 
 public:
-    Mpris2PlayerAdaptor(QObject *parent);
-    void setMainWindow(MainWindow *mw);
+    Mpris2PlayerAdaptor(Mpris2 *parent, MainWindow *mainWindow, PlaybackEngine *player);
 
     Q_PROPERTY(QString PlaybackStatus READ PlaybackStatus)
+    Q_PROPERTY(QString LoopStatus READ LoopStatus WRITE SetLoopStatus)
     Q_PROPERTY(double Rate READ Rate WRITE SetRate)
+    Q_PROPERTY(bool Shuffle READ Shuffle WRITE SetShuffle)
     Q_PROPERTY(QVariantMap Metadata READ Metadata)
     Q_PROPERTY(double Volume READ Volume WRITE SetVolume)
     Q_PROPERTY(qint64 Position READ Position)
@@ -86,21 +94,59 @@ public slots:
 
 private:
     QString PlaybackStatus() const;
+    QString LoopStatus() const;
+    void SetLoopStatus(const QString &loopStatus);
     double Rate() const { return 1.0; }
     void SetRate(double) {}
+    bool Shuffle() const;
+    void SetShuffle(bool shuffle);
     QVariantMap Metadata() const;
     double Volume() const;
     void SetVolume(double volume);
     qint64 Position() const;
     double MinimumRate() const { return 1.0; }
     double MaximumRate() const { return 1.0; }
-    bool CanGoNext() const { return true; }
-    bool CanGoPrevious() const { return true; }
-    bool CanPlay() const { return true; }
-    bool CanPause() const { return true; }
-    bool CanSeek() const { return true; }
+    bool CanGoNext() const;
+    bool CanGoPrevious() const;
+    bool CanPlay() const;
+    bool CanPause() const;
+    bool CanSeek() const;
     bool CanControl() const { return true; }
 
+    Mpris2 *m_mpris;
+    MainWindow *m_mainWindow;
+    PlaybackEngine *m_player;
+};
+
+// MPRIS2 TrackList Interface Adaptor. Track ids and the published window
+// of the playlist are kept by Mpris2.
+class Mpris2TrackListAdaptor : public QDBusAbstractAdaptor {
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.mpris.MediaPlayer2.TrackList")
+
+public:
+    Mpris2TrackListAdaptor(Mpris2 *parent, MainWindow *mainWindow);
+
+    Q_PROPERTY(QList<QDBusObjectPath> Tracks READ Tracks)
+    Q_PROPERTY(bool CanEditTracks READ CanEditTracks)
+
+signals:
+    void TrackListReplaced(const QList<QDBusObjectPath> &Tracks, const QDBusObjectPath &CurrentTrack);
+    void TrackAdded(const QVariantMap &Metadata, const QDBusObjectPath &AfterTrack);
+    void TrackRemoved(const QDBusObjectPath &TrackId);
+    void TrackMetadataChanged(const QDBusObjectPath &TrackId, const QVariantMap &Metadata);
+
+public slots:
+    QList<QVariantMap> GetTracksMetadata(const QList<QDBusObjectPath> &TrackIds);
+    void AddTrack(const QString &Uri, const QDBusObjectPath &AfterTrack, bool SetAsCurrent);
+    void RemoveTrack(const QDBusObjectPath &TrackId);
+    void GoTo(const QDBusObjectPath &TrackId);
+
+private:
+    QList<QDBusObjectPath> Tracks() const;
+    bool CanEditTracks() const { return true; }
+
+    Mpris2 *m_mpris;
     MainWindow *m_mainWindow;
 };
 
@@ -108,17 +154,70 @@ class Mpris2 : public QObject {
     Q_OBJECT
 
 public:
-    Mpris2(MainWindow *mainWindow);
+    Mpris2(MainWindow *mainWindow, PlaybackEngine *player, PlaylistModel *playlist);
     ~Mpris2();
 
-    void updateMetadata();
-    void updatePlaybackStatus();
+    // MainWindow reports its state here whenever it may have changed.
+    // Only values that differ from the last announced ones are queued, and
+    // PropertiesChanged goes out at most once per event-loop turn.
+    void updateMetadata(const Metadata &metadata, int trackIndex);
+    void updateShuffle(bool shuffle);
+    void updateLoopStatus(const QString &loopStatus);
+    void updateNavigation(bool canGoNext, bool canGoPrevious, bool canPlay);
+
+    // Current player property values, as last announced
+    QVariant playerProperty(const QString &name) const { return m_playerProperties.value(name); }
+    QDBusObjectPath currentTrackId() const;
+
+    // TrackList. Every playlist row gets an object path that follows it
+    // through inserts, removals and sorting. Tracks only lists a window of
+    // rows around the current track, so a huge playlist never turns into a
+    // huge message; metadata is served for whichever ids are asked for.
+    QList<QDBusObjectPath> publishedTracks() const;
+    QList<QVariantMap> tracksMetadata(const QList<QDBusObjectPath> &trackIds) const;
+    int rowOfTrack(const QDBusObjectPath &trackId) const;  // -1 if unknown
+
+private slots:
+    void onPlaybackStateChanged(QMediaPlayer::PlaybackState state);
+    void onDurationChanged(qint64 duration);
+    void onSeeked(qint64 position);
+    void flushChanges();
+    void onRowsInserted(const QModelIndex &parent, int first, int last);
+    void onRowsRemoved(const QModelIndex &parent, int first, int last);
+    void onRowsReordered(const QList<int> &newRows);
+    void onModelReset();
+    void onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
 
 private:
+    void updatePlayerProperty(const QString &name, const QVariant &value);
+    void scheduleFlush();
+    QDBusObjectPath trackPath(int row) const;
+    QVariantMap trackMetadata(int row) const;
+    // Publishes up to MaxPublishedTracks rows from firstRow on and
+    // announces them with TrackListReplaced
+    void replaceTrackList(int firstRow);
+
     MainWindow *m_mainWindow;
+    PlaybackEngine *m_player;
+    PlaylistModel *m_playlist;
     QDBusConnection m_dbusConnection;
     Mpris2RootAdaptor *m_rootAdaptor;
     Mpris2PlayerAdaptor *m_playerAdaptor;
+    Mpris2TrackListAdaptor *m_trackListAdaptor;
+
+    // Row -> track id; the reverse lookup is rebuilt lazily after edits
+    QList<quint32> m_trackIds;
+    quint32 m_nextTrackId;
+    mutable QHash<quint32, int> m_trackRows;
+    mutable bool m_trackRowsStale;
+    int m_windowStart;  // Published rows are [m_windowStart, m_windowEnd)
+    int m_windowEnd;
+
+    QVariantMap m_playerProperties;
+    QVariantMap m_metadata;
+    QStringList m_changedProperties;
+    qint64 m_seekPosition;  // -1 when no Seeked is queued
+    bool m_flushPending;
 
     bool RegisterService();
     void UnregisterService();
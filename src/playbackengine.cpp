@@ -0,0 +1,230 @@
+#include "playbackengine.h"
+#include "streamplayer.h"
+#include "trace.h"
+#include <QSettings>
+
+PlaybackEngine::PlaybackEngine(QObject *parent)
+    : QObject(parent), stream(nullptr), active(nullptr), standby(nullptr), activeOutput(nullptr),
+      standbyOutput(nullptr), nearEndSent(false), endingTrack(false), handoffPending(false),
+      pendingPrerolled(false), handoffLatency(-1), handoffPrerolled(false) {
+    QSettings settings("SimplePlayerQt", "SimplePlayerQt");
+    if (settings.value("playback/engine").toString() == "stream") {
+        // The fade has to fit between nearEnd() and the end of the track,
+        // with time left to decode the start of the next one
+        const int bufferMs = qBound(50, settings.value("playback/bufferMs", StreamPlayer::DefaultBufferMs).toInt(), 5000);
+        const int crossfadeMs = qBound(0, settings.value("playback/crossfadeMs", 0).toInt(), int(PrerollMs) - 1000);
+        stream = new StreamPlayer(bufferMs, crossfadeMs, this);
+        connectStream();
+        return;
+    }
+
+    active = new QMediaPlayer(this);
+    standby = new QMediaPlayer(this);
+    activeOutput = new QAudioOutput(this);
+    standbyOutput = new QAudioOutput(this);
+    active->setAudioOutput(activeOutput);
+    standby->setAudioOutput(standbyOutput);
+
+    connectPlayer(active);
+    connectPlayer(standby);
+}
+
+void PlaybackEngine::connectPlayer(QMediaPlayer *player) {
+    // Both players stay connected; only the active one is heard from
+    connect(player, &QMediaPlayer::positionChanged, this, [this, player](qint64 position) {
+        if (player == active) {
+            onPosition(position, player->duration());
+        }
+    });
+    connect(player, &QMediaPlayer::durationChanged, this, [this, player](qint64 duration) {
+        if (player == active) {
+            emit durationChanged(duration);
+        }
+    });
+    connect(player, &QMediaPlayer::playbackStateChanged, this, [this, player](QMediaPlayer::PlaybackState state) {
+        if (player == active) {
+            emit playbackStateChanged(state);
+        }
+    });
+    connect(player, &QMediaPlayer::mediaStatusChanged, this, [this, player](QMediaPlayer::MediaStatus status) {
+        if (player == active) {
+            onMediaStatus(status);
+        }
+    });
+    connect(player, &QMediaPlayer::errorOccurred, this, [this, player]() {
+        if (player == standby) {
+            cancelPrepared();
+        }
+    });
+}
+
+void PlaybackEngine::connectStream() {
+    connect(stream, &StreamPlayer::positionChanged, this, [this](qint64 position) {
+        onPosition(position, stream->duration());
+    });
+    connect(stream, &StreamPlayer::durationChanged, this, &PlaybackEngine::durationChanged);
+    connect(stream, &StreamPlayer::playbackStateChanged, this, &PlaybackEngine::playbackStateChanged);
+    connect(stream, &StreamPlayer::mediaStatusChanged, this, &PlaybackEngine::onMediaStatus);
+}
+
+void PlaybackEngine::onPosition(qint64 position, qint64 duration) {
+    if (handoffPending && position > 0) {
+        handoffPending = false;
+        handoffLatency = handoffTimer.elapsed();
+        handoffPrerolled = pendingPrerolled;
+        emit handoffMeasured(handoffLatency, handoffPrerolled);
+    }
+    if (!nearEndSent && duration > 0 && duration - position <= PrerollMs) {
+        nearEndSent = true;
+        emit nearEnd();
+    }
+    emit positionChanged(position);
+}
+
+void PlaybackEngine::onMediaStatus(QMediaPlayer::MediaStatus status) {
+    if (status != QMediaPlayer::EndOfMedia) {
+        emit mediaStatusChanged(status);
+        return;
+    }
+
+    // A setSource() made while handling the end of the track is a track
+    // change, and its latency gets measured
+    handoffTimer.start();
+    endingTrack = true;
+    emit mediaStatusChanged(status);
+    endingTrack = false;
+}
+
+QUrl PlaybackEngine::source() const {
+    return stream ? stream->source() : active->source();
+}
+
+QUrl PlaybackEngine::preparedSource() const {
+    return stream ? stream->preparedSource() : prepared;
+}
+
+void PlaybackEngine::play() {
+    if (stream) {
+        stream->play();
+    } else {
+        active->play();
+    }
+}
+
+void PlaybackEngine::pause() {
+    if (stream) {
+        stream->pause();
+    } else {
+        active->pause();
+    }
+}
+
+qint64 PlaybackEngine::position() const {
+    return stream ? stream->position() : active->position();
+}
+
+qint64 PlaybackEngine::duration() const {
+    return stream ? stream->duration() : active->duration();
+}
+
+QMediaPlayer::PlaybackState PlaybackEngine::playbackState() const {
+    return stream ? stream->playbackState() : active->playbackState();
+}
+
+QMediaPlayer::MediaStatus PlaybackEngine::mediaStatus() const {
+    return stream ? stream->mediaStatus() : active->mediaStatus();
+}
+
+float PlaybackEngine::volume() const {
+    return stream ? stream->volume() : activeOutput->volume();
+}
+
+void PlaybackEngine::setSource(const QUrl &source) {
+    TRACE_SCOPE("PlaybackEngine::setSource");
+    handoffPending = endingTrack;
+    nearEndSent = false;
+
+    if (stream) {
+        // A prepared track is already decoding, and at the end of a track
+        // already fading in
+        pendingPrerolled = !stream->preparedSource().isEmpty() && source == stream->preparedSource();
+        stream->setSource(source);
+        return;
+    }
+
+    if (!prepared.isEmpty() && source == prepared) {
+        // The next track is already open and prerolled; swapping players is
+        // all the track change costs
+        std::swap(active, standby);
+        std::swap(activeOutput, standbyOutput);
+        prepared.clear();
+        standby->stop();
+        standby->setSource(QUrl());
+        pendingPrerolled = true;
+
+        emit durationChanged(active->duration());
+        emit positionChanged(active->position());
+        emit mediaStatusChanged(active->mediaStatus());
+        return;
+    }
+
+    cancelPrepared();
+    pendingPrerolled = false;
+    active->setSource(source);
+}
+
+void PlaybackEngine::prepareNext(const QUrl &source) {
+    if (stream) {
+        stream->prepareNext(source);
+        return;
+    }
+    if (source == prepared || source == active->source()) {
+        return;
+    }
+
+    // Opening paused makes the backend load and decode up to the first frame
+    prepared = source;
+    standby->setSource(source);
+    standby->pause();
+}
+
+void PlaybackEngine::stop() {
+    handoffPending = false;
+    if (stream) {
+        stream->stop();
+        return;
+    }
+    cancelPrepared();
+    active->stop();
+}
+
+void PlaybackEngine::setPosition(qint64 position) {
+    if (stream) {
+        stream->setPosition(position);
+    } else {
+        active->setPosition(position);
+    }
+    emit seeked(position);
+}
+
+void PlaybackEngine::setVolume(float volume) {
+    if (qFuzzyCompare(this->volume(), volume)) {
+        return;
+    }
+    if (stream) {
+        stream->setVolume(volume);
+    } else {
+        activeOutput->setVolume(volume);
+        standbyOutput->setVolume(volume);
+    }
+    emit volumeChanged(volume);
+}
+
+void PlaybackEngine::cancelPrepared() {
+    if (prepared.isEmpty()) {
+        return;
+    }
+    prepared.clear();
+    standby->stop();
+    standby->setSource(QUrl());
+}
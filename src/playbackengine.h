@@ -0,0 +1,92 @@
+#ifndef PLAYBACKENGINE_H
+#define PLAYBACKENGINE_H
+
+#include <QAudioOutput>
+#include <QElapsedTimer>
+#include <QMediaPlayer>
+#include <QObject>
+#include <QUrl>
+
+class StreamPlayer;
+
+// Player facade with gapless track changes. Two QMediaPlayers take turns:
+// while one plays, the other can be handed the next track (prepareNext) and
+// prerolled paused, so that setSource() with that URL only has to swap
+// players and start playback. Signals are forwarded from whichever player
+// is active.
+//
+// With playback/engine set to "stream" in the settings, a StreamPlayer
+// takes the players' place: its own decode and output threads, a
+// playback/bufferMs deep ring between them, and prepared tracks crossfaded
+// in over playback/crossfadeMs.
+class PlaybackEngine : public QObject {
+    Q_OBJECT
+
+public:
+    // nearEnd() fires once per track when this much is left
+    static const qint64 PrerollMs = 5000;
+
+    explicit PlaybackEngine(QObject *parent = nullptr);
+
+    QUrl source() const;
+    void setSource(const QUrl &source);
+    void prepareNext(const QUrl &source);
+    QUrl preparedSource() const;
+
+    void play();
+    void pause();
+    void stop();
+
+    qint64 position() const;
+    // Emits seeked(); playback moving on by itself only emits positionChanged()
+    void setPosition(qint64 position);
+    qint64 duration() const;
+    QMediaPlayer::PlaybackState playbackState() const;
+    QMediaPlayer::MediaStatus mediaStatus() const;
+
+    float volume() const;
+    void setVolume(float volume);
+
+    // Time from the end of one track to the first position update of the
+    // next, for the most recent track change
+    qint64 lastHandoffLatency() const { return handoffLatency; }
+    bool lastHandoffWasPrerolled() const { return handoffPrerolled; }
+
+signals:
+    void positionChanged(qint64 position);
+    void durationChanged(qint64 duration);
+    void mediaStatusChanged(QMediaPlayer::MediaStatus status);
+    void playbackStateChanged(QMediaPlayer::PlaybackState state);
+    void nearEnd();
+    void handoffMeasured(qint64 latencyMs, bool prerolled);
+    void seeked(qint64 position);
+    void volumeChanged(float volume);
+
+private:
+    void connectPlayer(QMediaPlayer *player);
+    void connectStream();
+    void cancelPrepared();
+    // Shared by both engines, for the track being played
+    void onPosition(qint64 position, qint64 duration);
+    void onMediaStatus(QMediaPlayer::MediaStatus status);
+
+    StreamPlayer *stream;  // Replaces the players below when set
+
+    QMediaPlayer *active;
+    QMediaPlayer *standby;
+    QAudioOutput *activeOutput;
+    QAudioOutput *standbyOutput;
+    QUrl prepared;
+    bool nearEndSent;
+    bool endingTrack;  // Inside the EndOfMedia notification
+
+    // Handoff measurement: started when a track ends, stopped by the next
+    // track's first position update
+    QElapsedTimer handoffTimer;
+    bool handoffPending;
+    bool pendingPrerolled;
+    qint64 handoffLatency;
+    bool handoffPrerolled;
+};
+
+#endif // PLAYBACKENGINE_H
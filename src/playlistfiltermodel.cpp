@@ -0,0 +1,305 @@
+#include "playlistfiltermodel.h"
+#include <algorithm>
+
+// Rows appended while a filter is active are matched in batches
+static const int NewRowsIntervalMs = 100;
+
+PlaylistFilterModel::PlaylistFilterModel(PlaylistModel *playlist, QObject *parent)
+    : QAbstractProxyModel(parent), playlist(playlist), checkedRows(0), resetting(false), removing(false) {
+    QAbstractProxyModel::setSourceModel(playlist);
+
+    newRowsTimer.setSingleShot(true);
+    newRowsTimer.setInterval(NewRowsIntervalMs);
+    connect(&newRowsTimer, &QTimer::timeout, this, &PlaylistFilterModel::filterNewRows);
+
+    connect(playlist, &QAbstractItemModel::rowsAboutToBeInserted, this, &PlaylistFilterModel::onRowsAboutToBeInserted);
+    connect(playlist, &QAbstractItemModel::rowsInserted, this, &PlaylistFilterModel::onRowsInserted);
+    connect(playlist, &QAbstractItemModel::rowsAboutToBeRemoved, this, &PlaylistFilterModel::onRowsAboutToBeRemoved);
+    connect(playlist, &QAbstractItemModel::rowsRemoved, this, &PlaylistFilterModel::onRowsRemoved);
+    connect(playlist, &QAbstractItemModel::dataChanged, this, &PlaylistFilterModel::onDataChanged);
+    connect(playlist, &QAbstractItemModel::headerDataChanged, this, &QAbstractItemModel::headerDataChanged);
+    connect(playlist, &QAbstractItemModel::layoutAboutToBeChanged, this, &PlaylistFilterModel::onLayoutAboutToBeChanged);
+    connect(playlist, &QAbstractItemModel::layoutChanged, this, &PlaylistFilterModel::onLayoutChanged);
+    connect(playlist, &QAbstractItemModel::modelAboutToBeReset, this, [this]() {
+        beginResetModel();
+    });
+    connect(playlist, &QAbstractItemModel::modelReset, this, [this]() {
+        refilter();
+        endResetModel();
+    });
+}
+
+void PlaylistFilterModel::setFilterText(const QString &text) {
+    const QString simplified = text.simplified();
+    if (simplified == filter) {
+        return;
+    }
+
+    beginResetModel();
+    filter = simplified;
+    refilter();
+    endResetModel();
+}
+
+void PlaylistFilterModel::refilter() {
+    newRowsTimer.stop();
+    rows.clear();
+    proxyRows.clear();
+    checkedRows = 0;
+    if (!isFiltering()) {
+        return;
+    }
+
+    rows = playlist->search(filter);
+    checkedRows = playlist->rowCount();
+    proxyRows = QList<int>(checkedRows, -1);
+    for (int i = 0; i < rows.size(); ++i) {
+        proxyRows[rows[i]] = i;
+    }
+}
+
+int PlaylistFilterModel::lowerBound(int sourceRow) const {
+    return std::lower_bound(rows.constBegin(), rows.constEnd(), sourceRow) - rows.constBegin();
+}
+
+QModelIndex PlaylistFilterModel::mapToSource(const QModelIndex &proxyIndex) const {
+    if (!proxyIndex.isValid()) {
+        return QModelIndex();
+    }
+    const int row = isFiltering() ? rows.value(proxyIndex.row(), -1) : proxyIndex.row();
+    return playlist->index(row, proxyIndex.column());
+}
+
+QModelIndex PlaylistFilterModel::mapFromSource(const QModelIndex &sourceIndex) const {
+    if (!sourceIndex.isValid()) {
+        return QModelIndex();
+    }
+    const int row = isFiltering() ? proxyRows.value(sourceIndex.row(), -1) : sourceIndex.row();
+    if (row < 0) {
+        return QModelIndex();
+    }
+    return createIndex(row, sourceIndex.column());
+}
+
+QModelIndex PlaylistFilterModel::index(int row, int column, const QModelIndex &parent) const {
+    if (parent.isValid() || row < 0 || column < 0 || row >= rowCount() || column >= columnCount()) {
+        return QModelIndex();
+    }
+    return createIndex(row, column);
+}
+
+QModelIndex PlaylistFilterModel::parent(const QModelIndex &child) const {
+    Q_UNUSED(child);
+    return QModelIndex();
+}
+
+int PlaylistFilterModel::rowCount(const QModelIndex &parent) const {
+    if (parent.isValid()) {
+        return 0;
+    }
+    return isFiltering() ? rows.size() : playlist->rowCount();
+}
+
+int PlaylistFilterModel::columnCount(const QModelIndex &parent) const {
+    if (parent.isValid()) {
+        return 0;
+    }
+    return playlist->columnCount();
+}
+
+void PlaylistFilterModel::onRowsAboutToBeInserted(const QModelIndex &parent, int first, int last) {
+    Q_UNUSED(parent);
+    if (!isFiltering()) {
+        beginInsertRows(QModelIndex(), first, last);
+    } else if (first < playlist->rowCount()) {
+        // Only appends are matched incrementally
+        resetting = true;
+        beginResetModel();
+    }
+}
+
+void PlaylistFilterModel::onRowsInserted(const QModelIndex &parent, int first, int last) {
+    Q_UNUSED(parent);
+    Q_UNUSED(first);
+    Q_UNUSED(last);
+    if (!isFiltering()) {
+        endInsertRows();
+        return;
+    }
+    if (resetting) {
+        resetting = false;
+        refilter();
+        endResetModel();
+        return;
+    }
+
+    proxyRows.resize(playlist->rowCount(), -1);
+    if (!newRowsTimer.isActive()) {
+        newRowsTimer.start();
+    }
+}
+
+void PlaylistFilterModel::filterNewRows() {
+    if (!isFiltering()) {
+        return;
+    }
+
+    const QList<int> matches = playlist->search(filter, checkedRows);
+    checkedRows = playlist->rowCount();
+    if (matches.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), rows.size(), rows.size() + matches.size() - 1);
+    for (int row : matches) {
+        proxyRows[row] = rows.size();
+        rows.append(row);
+    }
+    endInsertRows();
+}
+
+void PlaylistFilterModel::onRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last) {
+    Q_UNUSED(parent);
+    if (!isFiltering()) {
+        beginRemoveRows(QModelIndex(), first, last);
+        return;
+    }
+
+    // Matching rows are ascending, so the removed ones form one proxy range
+    const int proxyFirst = lowerBound(first);
+    const int proxyLast = lowerBound(last + 1) - 1;
+    if (proxyFirst <= proxyLast) {
+        removing = true;
+        beginRemoveRows(QModelIndex(), proxyFirst, proxyLast);
+    }
+}
+
+void PlaylistFilterModel::onRowsRemoved(const QModelIndex &parent, int first, int last) {
+    Q_UNUSED(parent);
+    if (!isFiltering()) {
+        endRemoveRows();
+        return;
+    }
+
+    const int count = last - first + 1;
+    const int proxyFirst = lowerBound(first);
+    const int proxyEnd = lowerBound(last + 1);
+    rows.remove(proxyFirst, proxyEnd - proxyFirst);
+    proxyRows.remove(first, count);
+    for (int i = proxyFirst; i < rows.size(); ++i) {
+        rows[i] -= count;
+        proxyRows[rows[i]] = i;
+    }
+    checkedRows -= qMax(0, qMin(last + 1, checkedRows) - first);
+
+    if (removing) {
+        removing = false;
+        endRemoveRows();
+    }
+}
+
+void PlaylistFilterModel::onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles) {
+    if (!isFiltering()) {
+        emit dataChanged(index(topLeft.row(), topLeft.column()), index(bottomRight.row(), bottomRight.column()), roles);
+        return;
+    }
+
+    // New text can make a row match or stop matching. Rows not checked yet
+    // are matched by filterNewRows() with their new text anyway.
+    const int first = topLeft.row();
+    const int last = qMin(bottomRight.row(), checkedRows - 1);
+    if (first <= last) {
+        const QList<int> matches = playlist->search(filter, first, last);
+        int nextMatch = 0;
+        // Runs of neighbouring rows that appear or disappear go in one step
+        int runFirst = -1;
+        bool runShows = false;
+        for (int row = first; row <= last + 1; ++row) {
+            bool changed = false;
+            bool matching = false;
+            if (row <= last) {
+                matching = nextMatch < matches.size() && matches[nextMatch] == row;
+                if (matching) {
+                    ++nextMatch;
+                }
+                changed = matching != (proxyRows[row] >= 0);
+            }
+            if (runFirst >= 0 && (!changed || matching != runShows)) {
+                if (runShows) {
+                    showRows(runFirst, row - 1);
+                } else {
+                    hideRows(runFirst, row - 1);
+                }
+                runFirst = -1;
+            }
+            if (changed && runFirst < 0) {
+                runFirst = row;
+                runShows = matching;
+            }
+        }
+    }
+
+    const int proxyFirst = lowerBound(topLeft.row());
+    const int proxyLast = lowerBound(bottomRight.row() + 1) - 1;
+    if (proxyFirst <= proxyLast) {
+        emit dataChanged(index(proxyFirst, topLeft.column()), index(proxyLast, bottomRight.column()), roles);
+    }
+}
+
+void PlaylistFilterModel::showRows(int first, int last) {
+    const int proxyFirst = lowerBound(first);
+    const int count = last - first + 1;
+    beginInsertRows(QModelIndex(), proxyFirst, proxyFirst + count - 1);
+    rows.insert(proxyFirst, count, 0);
+    for (int i = 0; i < count; ++i) {
+        rows[proxyFirst + i] = first + i;
+    }
+    for (int i = proxyFirst; i < rows.size(); ++i) {
+        proxyRows[rows[i]] = i;
+    }
+    endInsertRows();
+}
+
+void PlaylistFilterModel::hideRows(int first, int last) {
+    // Neighbouring source rows that are all shown are neighbours here too
+    const int proxyFirst = proxyRows[first];
+    const int count = last - first + 1;
+    beginRemoveRows(QModelIndex(), proxyFirst, proxyFirst + count - 1);
+    rows.remove(proxyFirst, count);
+    for (int row = first; row <= last; ++row) {
+        proxyRows[row] = -1;
+    }
+    for (int i = proxyFirst; i < rows.size(); ++i) {
+        proxyRows[rows[i]] = i;
+    }
+    endRemoveRows();
+}
+
+void PlaylistFilterModel::onLayoutAboutToBeChanged() {
+    emit layoutAboutToBeChanged();
+
+    // Remember where each persistent index points in the playlist so it can
+    // be mapped back once the playlist has moved its rows
+    const QModelIndexList persistent = persistentIndexList();
+    for (const QModelIndex &proxyIndex : persistent) {
+        layoutProxyIndexes.append(proxyIndex);
+        layoutSourceIndexes.append(QPersistentModelIndex(mapToSource(proxyIndex)));
+    }
+}
+
+void PlaylistFilterModel::onLayoutChanged() {
+    if (isFiltering()) {
+        refilter();
+    }
+
+    QModelIndexList newIndexes;
+    newIndexes.reserve(layoutSourceIndexes.size());
+    for (const QPersistentModelIndex &sourceIndex : std::as_const(layoutSourceIndexes)) {
+        newIndexes.append(mapFromSource(sourceIndex));
+    }
+    changePersistentIndexList(layoutProxyIndexes, newIndexes);
+    layoutProxyIndexes.clear();
+    layoutSourceIndexes.clear();
+
+    emit layoutChanged();
+}
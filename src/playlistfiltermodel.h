@@ -0,0 +1,65 @@
+#ifndef PLAYLISTFILTERMODEL_H
+#define PLAYLISTFILTERMODEL_H
+
+#include <QAbstractProxyModel>
+#include <QList>
+#include <QPersistentModelIndex>
+#include <QTimer>
+#include "playlistmodel.h"
+
+// Search filter over the playlist. Matching rows come from
+// PlaylistModel::search, so a keystroke costs one pass over compact records
+// rather than a data() call per row. Without a filter the proxy maps rows
+// one to one and forwards the playlist's changes as they are.
+class PlaylistFilterModel : public QAbstractProxyModel {
+    Q_OBJECT
+
+public:
+    explicit PlaylistFilterModel(PlaylistModel *playlist, QObject *parent = nullptr);
+
+    void setFilterText(const QString &text);
+    QString filterText() const { return filter; }
+    bool isFiltering() const { return !filter.isEmpty(); }
+
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+
+private slots:
+    void onRowsAboutToBeInserted(const QModelIndex &parent, int first, int last);
+    void onRowsInserted(const QModelIndex &parent, int first, int last);
+    void onRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void onRowsRemoved(const QModelIndex &parent, int first, int last);
+    void onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles);
+    void onLayoutAboutToBeChanged();
+    void onLayoutChanged();
+    void filterNewRows();
+
+private:
+    void refilter();
+    // First proxy row whose source row is at least sourceRow
+    int lowerBound(int sourceRow) const;
+    // Adds or drops the source rows first to last, which are all hidden or
+    // all shown, after their text changed
+    void showRows(int first, int last);
+    void hideRows(int first, int last);
+
+    PlaylistModel *playlist;
+    QString filter;
+
+    // Only used while filtering
+    QList<int> rows;        // Proxy row -> source row, ascending
+    QList<int> proxyRows;   // Source row -> proxy row, -1 when filtered out
+    int checkedRows;        // Source rows matched so far; appended rows wait for newRowsTimer
+    QTimer newRowsTimer;
+    bool resetting;
+    bool removing;
+
+    QList<QPersistentModelIndex> layoutSourceIndexes;
+    QModelIndexList layoutProxyIndexes;
+};
+
+#endif // PLAYLISTFILTERMODEL_H
@@ -1,13 +1,113 @@
 #include "playlistmodel.h"
+#include "trace.h"
+#include <QSize>
+#include <algorithm>
+#include <numeric>
+
+// Flush buffered appends once per frame, or earlier when this many are queued
+static const int PendingFlushIntervalMs = 16;
+static const int MaxPendingTracks = 4096;
+
+// Longer durations and higher track numbers are formatted on demand
+static const int MaxCachedDurationSeconds = 6 * 60 * 60;
+static const int MaxCachedTrackNumber = 999;
+
+// Sorts below this size stay on the calling thread
+static const int ParallelSortThreshold = 32768;
+static const int SortKeysPerTask = 1024;
+
+static QString formatDuration(qint64 seconds) {
+    qint64 minutes = seconds / 60;
+    seconds %= 60;
+    return QString("%1:%2").arg(minutes).arg(seconds, 2, 10, QChar('0'));
+}
+
+// Case-insensitive, with digit runs compared by value ("Track 2" before
+// "Track 10"). Each thread builds its own.
+static QCollator makeSortCollator() {
+    QCollator collator;
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    collator.setNumericMode(true);
+    return collator;
+}
+
+// Sorts one chunk per pool thread, then merges neighbouring chunks in
+// pairs. less must be a strict total order, so the result is the same
+// however the items were split.
+template <typename T, typename Less>
+static void parallelSort(QList<T> &items, Less less, QThreadPool &pool) {
+    const int chunks = qBound(1, int(items.size() / ParallelSortThreshold), pool.maxThreadCount());
+    T *data = items.data();
+    if (chunks == 1) {
+        std::sort(data, data + items.size(), less);
+        return;
+    }
+
+    QList<qsizetype> bounds(chunks + 1);
+    for (int i = 0; i <= chunks; ++i) {
+        bounds[i] = items.size() * i / chunks;
+    }
+
+    for (int i = 0; i < chunks; ++i) {
+        pool.start([data, bounds, less, i]() {
+            std::sort(data + bounds[i], data + bounds[i + 1], less);
+        });
+    }
+    pool.waitForDone();
+
+    for (int width = 1; width < chunks; width *= 2) {
+        for (int i = 0; i + width < chunks; i += 2 * width) {
+            const int end = qMin(i + 2 * width, chunks);
+            pool.start([data, bounds, less, i, width, end]() {
+                std::inplace_merge(data + bounds[i], data + bounds[i + width], data + bounds[end], less);
+            });
+        }
+        pool.waitForDone();
+    }
+}
+
+namespace {
+
+enum SortKey {
+    KeyNone,
+    KeyTrack,
+    KeyArtist,
+    KeyAlbum,
+    KeyTitle,
+    KeyDuration
+};
+
+// Keys per column, most significant first. Only the first follows the
+// requested order; the tie-breakers always ascend.
+const SortKey sortKeyChains[PlaylistModel::ColumnCount][4] = {
+    {KeyTrack, KeyArtist, KeyAlbum, KeyTitle},    // ColumnTrack
+    {KeyArtist, KeyAlbum, KeyTrack, KeyTitle},    // ColumnArtist
+    {KeyAlbum, KeyTrack, KeyTitle, KeyNone},      // ColumnAlbum
+    {KeyTitle, KeyArtist, KeyAlbum, KeyNone},     // ColumnTitle
+    {KeyDuration, KeyArtist, KeyAlbum, KeyTrack}  // ColumnDuration
+};
+
+// One row's keys packed into two integers, so comparing rows never touches
+// strings. The row breaks ties, which keeps the sort stable.
+struct SortEntry {
+    quint64 major;
+    quint64 minor;
+    int row;
+};
+
+} // namespace
 
 PlaylistModel::PlaylistModel(QObject *parent)
     : QAbstractTableModel(parent) {
+    pendingFlushTimer.setSingleShot(true);
+    pendingFlushTimer.setInterval(PendingFlushIntervalMs);
+    connect(&pendingFlushTimer, &QTimer::timeout, this, &PlaylistModel::flushPendingTracks);
 }
 
 int PlaylistModel::rowCount(const QModelIndex &parent) const {
     if (parent.isValid())
         return 0;
-    return playlist.size();
+    return tracks.size();
 }
 
 int PlaylistModel::columnCount(const QModelIndex &parent) const {
@@ -17,33 +117,51 @@ int PlaylistModel::columnCount(const QModelIndex &parent) const {
 }
 
 QVariant PlaylistModel::data(const QModelIndex &index, int role) const {
-    if (!index.isValid() || index.row() >= playlist.size())
+    if (!index.isValid() || index.row() >= tracks.size())
         return QVariant();
 
-    const Metadata &metadata = playlist[index.row()];
+    const TrackRecord &record = tracks.record(index.row());
+
+    // Per-column answers that never depend on the row
+    static const QVariant alignments[ColumnCount] = {
+        int(Qt::AlignCenter), QVariant(), QVariant(), QVariant(), int(Qt::AlignCenter)
+    };
+    // Matches the column widths MainWindow sets up, so resize-to-contents
+    // never has to measure text
+    static const QVariant sizeHints[ColumnCount] = {
+        QSize(35, 22), QSize(150, 22), QSize(150, 22), QSize(250, 22), QSize(60, 22)
+    };
 
     if (role == Qt::DisplayRole) {
         switch (index.column()) {
         case ColumnTrack:
-            return metadata.trackNumber > 0 ? QString::number(metadata.trackNumber) : "-";
+            if (record.trackNumber < trackNumberTexts.size()) {
+                return trackNumberTexts[record.trackNumber];
+            }
+            return QString::number(record.trackNumber);
         case ColumnArtist:
-            return metadata.artist;
+            return tracks.text(record.artist);
         case ColumnAlbum:
-            return metadata.album;
+            return tracks.text(record.album);
         case ColumnTitle:
-            return metadata.title;
+            return tracks.text(record.title);
         case ColumnDuration: {
-            qint64 seconds = metadata.duration / 1000;
-            qint64 minutes = seconds / 60;
-            seconds %= 60;
-            return QString("%1:%2").arg(minutes).arg(seconds, 2, 10, QChar('0'));
+            const quint32 seconds = record.duration / 1000;
+            if (seconds < quint32(durationTexts.size())) {
+                return durationTexts[seconds];
+            }
+            return formatDuration(seconds);
         }
         default:
             return QVariant();
         }
     } else if (role == Qt::TextAlignmentRole) {
-        if (index.column() == ColumnTrack || index.column() == ColumnDuration) {
-            return Qt::AlignCenter;
+        if (index.column() < ColumnCount) {
+            return alignments[index.column()];
+        }
+    } else if (role == Qt::SizeHintRole) {
+        if (index.column() < ColumnCount) {
+            return sizeHints[index.column()];
         }
     }
 
@@ -70,42 +188,344 @@ QVariant PlaylistModel::headerData(int section, Qt::Orientation orientation, int
     return QVariant();
 }
 
+void PlaylistModel::sort(int column, Qt::SortOrder order) {
+    TRACE_SCOPE("PlaylistModel::sort");
+    if (column < 0 || column >= ColumnCount) {
+        return;
+    }
+    flushPendingTracks();
+    if (tracks.size() < 2) {
+        return;
+    }
+    updateTextRanks();
+
+    const SortKey *keys = sortKeyChains[column];
+    auto keyValue = [this](const TrackRecord &record, SortKey key) -> quint32 {
+        switch (key) {
+        case KeyTrack:
+            return record.trackNumber;
+        case KeyArtist:
+            return textRanks[record.artist];
+        case KeyAlbum:
+            return textRanks[record.album];
+        case KeyTitle:
+            return textRanks[record.title];
+        case KeyDuration:
+            return record.duration;
+        default:
+            return 0;
+        }
+    };
+    // Descending only flips the primary key
+    const quint32 flip = order == Qt::DescendingOrder ? 0xFFFFFFFFu : 0;
+
+    QList<SortEntry> entries(tracks.size());
+    for (int row = 0; row < tracks.size(); ++row) {
+        const TrackRecord &record = tracks.record(row);
+        entries[row].major = (quint64(keyValue(record, keys[0]) ^ flip) << 32) | keyValue(record, keys[1]);
+        entries[row].minor = (quint64(keyValue(record, keys[2])) << 32) | keyValue(record, keys[3]);
+        entries[row].row = row;
+    }
+    parallelSort(entries, [](const SortEntry &a, const SortEntry &b) {
+        if (a.major != b.major) {
+            return a.major < b.major;
+        }
+        if (a.minor != b.minor) {
+            return a.minor < b.minor;
+        }
+        return a.row < b.row;
+    }, sortPool);
+
+    QList<int> oldRows(tracks.size());
+    QList<int> newRows(tracks.size());
+    bool moved = false;
+    for (int i = 0; i < entries.size(); ++i) {
+        oldRows[i] = entries[i].row;
+        newRows[entries[i].row] = i;
+        moved = moved || entries[i].row != i;
+    }
+    if (!moved) {
+        return;
+    }
+
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    tracks.reorder(oldRows);
+
+    const QModelIndexList oldIndexes = persistentIndexList();
+    QModelIndexList newIndexes;
+    newIndexes.reserve(oldIndexes.size());
+    for (const QModelIndex &oldIndex : oldIndexes) {
+        newIndexes.append(index(newRows[oldIndex.row()], oldIndex.column()));
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit rowsReordered(newRows);
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void PlaylistModel::updateTextRanks() {
+    const StringPool &texts = tracks.texts();
+    if (textRanks.size() == texts.size()) {
+        return;
+    }
+
+    // Sort keys for the strings added since the last sort, split across
+    // the pool
+    const int first = textSortKeys.size();
+    const int count = texts.size() - first;
+    const int tasks = qBound(1, count / SortKeysPerTask, sortPool.maxThreadCount());
+    QList<QList<QCollatorSortKey>> parts(tasks);
+    for (int i = 0; i < tasks; ++i) {
+        const int begin = first + qint64(count) * i / tasks;
+        const int end = first + qint64(count) * (i + 1) / tasks;
+        QList<QCollatorSortKey> *part = &parts[i];
+        sortPool.start([&texts, part, begin, end]() {
+            const QCollator collator = makeSortCollator();
+            part->reserve(end - begin);
+            for (int id = begin; id < end; ++id) {
+                part->append(collator.sortKey(texts.string(id)));
+            }
+        });
+    }
+    sortPool.waitForDone();
+    for (const QList<QCollatorSortKey> &part : std::as_const(parts)) {
+        textSortKeys.append(part);
+    }
+
+    // Every string's place in collation order; strings that collate equal
+    // ("Beatles" and "beatles") share a rank
+    const QList<QCollatorSortKey> &sortKeys = textSortKeys;
+    QList<quint32> ids(texts.size());
+    std::iota(ids.begin(), ids.end(), 0u);
+    parallelSort(ids, [&sortKeys](quint32 a, quint32 b) {
+        const int order = sortKeys.at(a).compare(sortKeys.at(b));
+        return order != 0 ? order < 0 : a < b;
+    }, sortPool);
+
+    textRanks.resize(texts.size());
+    for (int i = 0; i < ids.size(); ++i) {
+        const bool tied = i > 0 && sortKeys.at(ids[i - 1]).compare(sortKeys.at(ids[i])) == 0;
+        textRanks[ids[i]] = tied ? textRanks[ids[i - 1]] : quint32(i);
+    }
+}
+
 void PlaylistModel::addTrack(const Metadata &metadata) {
-    beginInsertRows(QModelIndex(), playlist.size(), playlist.size());
-    playlist.append(metadata);
+    flushPendingTracks();
+    beginInsertRows(QModelIndex(), tracks.size(), tracks.size());
+    appendToStore(metadata);
     endInsertRows();
 }
 
 void PlaylistModel::addTracks(const QList<Metadata> &metadataList) {
-    beginInsertRows(QModelIndex(), playlist.size(), playlist.size() + metadataList.size() - 1);
-    playlist.append(metadataList);
+    TRACE_SCOPE("PlaylistModel::addTracks");
+    flushPendingTracks();
+    if (metadataList.isEmpty()) {
+        return;
+    }
+    beginInsertRows(QModelIndex(), tracks.size(), tracks.size() + metadataList.size() - 1);
+    tracks.reserve(tracks.size() + metadataList.size());
+    for (const Metadata &metadata : metadataList) {
+        appendToStore(metadata);
+    }
     endInsertRows();
+    TRACE_COUNTER("playlist rows", tracks.size());
+}
+
+void PlaylistModel::insertTrack(int row, const Metadata &metadata) {
+    flushPendingTracks();
+    row = qBound(0, row, tracks.size());
+    beginInsertRows(QModelIndex(), row, row);
+    tracks.insert(row, metadata);
+    extendDisplayTables(tracks.record(row));
+    endInsertRows();
+}
+
+void PlaylistModel::updateTracks(const QList<Metadata> &metadataList) {
+    flushPendingTracks();
+    if (metadataList.isEmpty()) {
+        return;
+    }
+
+    // Rows are matched by path, as they may have moved since the files were
+    // queued. The paths are resolved to pool ids up front so the scan only
+    // compares integers; a path that isn't pooled is in no row.
+    auto pathKey = [](quint32 directory, quint32 fileName) {
+        return (quint64(directory) << 32) | fileName;
+    };
+    QHash<quint64, const Metadata*> byPath;
+    for (const Metadata &metadata : metadataList) {
+        quint32 directory, fileName;
+        if (tracks.findPath(metadata.filePath, directory, fileName)) {
+            byPath.insert(pathKey(directory, fileName), &metadata);
+        }
+    }
+    if (byPath.isEmpty()) {
+        return;
+    }
+
+    // Changed rows are reported as contiguous ranges
+    int firstChanged = -1;
+    for (int row = 0; row <= tracks.size(); ++row) {
+        auto it = byPath.constEnd();
+        if (row < tracks.size()) {
+            const TrackRecord &record = tracks.record(row);
+            it = byPath.constFind(pathKey(record.directory, record.fileName));
+        }
+        if (it == byPath.constEnd()) {
+            if (firstChanged >= 0) {
+                emit dataChanged(index(firstChanged, 0), index(row - 1, ColumnCount - 1));
+                firstChanged = -1;
+            }
+            continue;
+        }
+        tracks.replace(row, **it);
+        extendDisplayTables(tracks.record(row));
+        if (firstChanged < 0) {
+            firstChanged = row;
+        }
+    }
 }
 
 void PlaylistModel::removeTrack(int row) {
-    if (row >= 0 && row < playlist.size()) {
+    if (row >= 0 && row < tracks.size()) {
         beginRemoveRows(QModelIndex(), row, row);
-        playlist.removeAt(row);
+        tracks.remove(row);
         endRemoveRows();
     }
 }
 
 void PlaylistModel::clear() {
+    pendingFlushTimer.stop();
+    pendingTracks.clear();
+
+    beginResetModel();
+    tracks.clear();
+    searchIndex.clear();
+    textSortKeys.clear();
+    textRanks.clear();
+    endResetModel();
+}
+
+QList<int> PlaylistModel::search(const QString &query, int firstRow, int lastRow) {
+    TRACE_SCOPE("PlaylistModel::search");
+    const QStringList words = query.simplified().toCaseFolded().split(' ', Qt::SkipEmptyParts);
+    searchIndex.update(tracks.texts());
+
+    // One bit per distinct string and word; rows then only compare ids
+    QList<QBitArray> wordMatches;
+    wordMatches.reserve(words.size());
+    for (const QString &word : words) {
+        QBitArray matches(searchIndex.size());
+        searchIndex.match(word, matches);
+        wordMatches.append(matches);
+    }
+
+    QList<int> rows;
+    const int endRow = lastRow < 0 ? tracks.size() : qMin(lastRow + 1, tracks.size());
+    for (int row = qMax(0, firstRow); row < endRow; ++row) {
+        const TrackRecord &record = tracks.record(row);
+        bool matched = true;
+        for (const QBitArray &matches : std::as_const(wordMatches)) {
+            if (!matches.testBit(record.title) && !matches.testBit(record.artist)
+                && !matches.testBit(record.album) && !matches.testBit(record.genre)) {
+                matched = false;
+                break;
+            }
+        }
+        if (matched) {
+            rows.append(row);
+        }
+    }
+    return rows;
+}
+
+void PlaylistModel::setTrackStore(TrackStore store) {
+    pendingFlushTimer.stop();
+    pendingTracks.clear();
+
     beginResetModel();
-    playlist.clear();
+    tracks = std::move(store);
+    // Restored rows need the same shared texts as added ones
+    for (const TrackRecord &record : tracks.allRecords()) {
+        extendDisplayTables(record);
+    }
+    searchIndex.clear();
+    textSortKeys.clear();
+    textRanks.clear();
     endResetModel();
 }
 
+void PlaylistModel::appendTrack(Metadata metadata) {
+    pendingTracks.append(std::move(metadata));
+    if (pendingTracks.size() >= MaxPendingTracks) {
+        flushPendingTracks();
+    } else if (!pendingFlushTimer.isActive()) {
+        pendingFlushTimer.start();
+    }
+}
+
+void PlaylistModel::appendTracks(QList<Metadata> metadataList) {
+    if (metadataList.isEmpty()) {
+        return;
+    }
+
+    // Adopt the caller's buffer when nothing is queued yet
+    if (pendingTracks.isEmpty()) {
+        pendingTracks = std::move(metadataList);
+    } else {
+        pendingTracks.append(std::move(metadataList));
+    }
+
+    if (pendingTracks.size() >= MaxPendingTracks) {
+        flushPendingTracks();
+    } else if (!pendingFlushTimer.isActive()) {
+        pendingFlushTimer.start();
+    }
+}
+
+void PlaylistModel::flushPendingTracks() {
+    pendingFlushTimer.stop();
+    if (pendingTracks.isEmpty()) {
+        return;
+    }
+
+    TRACE_SCOPE("PlaylistModel::flushPendingTracks");
+    beginInsertRows(QModelIndex(), tracks.size(), tracks.size() + pendingTracks.size() - 1);
+    tracks.reserve(tracks.size() + pendingTracks.size());
+    for (const Metadata &metadata : std::as_const(pendingTracks)) {
+        appendToStore(metadata);
+    }
+    pendingTracks = QList<Metadata>();
+    endInsertRows();
+    TRACE_COUNTER("playlist rows", tracks.size());
+}
+
+void PlaylistModel::appendToStore(const Metadata &metadata) {
+    tracks.append(metadata);
+    extendDisplayTables(tracks.record(tracks.size() - 1));
+}
+
+void PlaylistModel::extendDisplayTables(const TrackRecord &record) {
+    const int seconds = qMin<quint32>(record.duration / 1000, MaxCachedDurationSeconds);
+    while (durationTexts.size() <= seconds) {
+        durationTexts.append(formatDuration(durationTexts.size()));
+    }
+    const int trackNumber = qMin<int>(record.trackNumber, MaxCachedTrackNumber);
+    while (trackNumberTexts.size() <= trackNumber) {
+        trackNumberTexts.append(trackNumberTexts.isEmpty() ? QString("-") : QString::number(trackNumberTexts.size()));
+    }
+}
+
 Metadata PlaylistModel::getTrack(int row) const {
-    if (row >= 0 && row < playlist.size()) {
-        return playlist[row];
+    if (row >= 0 && row < tracks.size()) {
+        return tracks.track(row);
     }
     return Metadata();
 }
 
 QString PlaylistModel::getFilePath(int row) const {
-    if (row >= 0 && row < playlist.size()) {
-        return playlist[row].filePath;
+    if (row >= 0 && row < tracks.size()) {
+        return tracks.filePath(row);
     }
     return QString();
 }
@@ -2,7 +2,12 @@
 #define PLAYLISTMODEL_H
 
 #include <QAbstractTableModel>
+#include <QCollator>
+#include <QThreadPool>
+#include <QTimer>
 #include "metadata.h"
+#include "textsearchindex.h"
+#include "trackstore.h"
 
 class PlaylistModel : public QAbstractTableModel {
     Q_OBJECT
@@ -24,16 +29,66 @@ public:
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 
+    // Sorts by column with fixed tie-breakers (artist sorts by album, then
+    // track number, then title). Text compares by locale collation. Rows are
+    // reordered in place and persistent indexes follow them.
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
     void addTrack(const Metadata &metadata);
     void addTracks(const QList<Metadata> &metadataList);
+    void insertTrack(int row, const Metadata &metadata);
+    // Replaces the tags of every row playing one of the given files
+    void updateTracks(const QList<Metadata> &metadataList);
     void removeTrack(int row);
     void clear();
 
+    // Streaming append for bulk imports: records are buffered and inserted
+    // as one contiguous block per frame, or as soon as enough have queued up
+    void appendTrack(Metadata metadata);
+    void appendTracks(QList<Metadata> metadataList);
+    void flushPendingTracks();
+
     Metadata getTrack(int row) const;
     QString getFilePath(int row) const;
 
+    // Rows from firstRow to lastRow (-1 for the last row) whose title,
+    // artist, album or genre contain every word of the query, ignoring case,
+    // in row order. Brings the search index up to date with the strings
+    // added since the last search first.
+    QList<int> search(const QString &query, int firstRow = 0, int lastRow = -1);
+
+    // Whole-playlist access for session snapshots
+    const TrackStore &trackStore() const { return tracks; }
+    void setTrackStore(TrackStore store);
+
+signals:
+    // Emitted by sort() before layoutChanged; newRows maps each old row to
+    // its new one
+    void rowsReordered(const QList<int> &newRows);
+
 private:
-    QList<Metadata> playlist;
+    void appendToStore(const Metadata &metadata);
+    // Extends the shared display tables to cover a new row
+    void extendDisplayTables(const TrackRecord &record);
+    // Brings textRanks up to date with the text pool
+    void updateTextRanks();
+
+    TrackStore tracks;
+    TextSearchIndex searchIndex;
+    QList<Metadata> pendingTracks;
+    QTimer pendingFlushTimer;
+
+    // Display strings shared by every row, filled in as rows are inserted
+    // so data() never formats or allocates
+    QList<QString> durationTexts;     // Indexed by whole seconds
+    QList<QString> trackNumberTexts;  // Indexed by track number, "-" for none
+
+    // Collation order of the text pool, so sorting compares integers.
+    // Sort keys are computed once per distinct string; ranks are rebuilt
+    // when the pool has grown since the last sort.
+    QList<QCollatorSortKey> textSortKeys;
+    QList<quint32> textRanks;  // Text id -> position in collation order, equal strings share one
+    QThreadPool sortPool;
 };
 
 #endif // PLAYLISTMODEL_H
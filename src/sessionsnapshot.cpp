@@ -0,0 +1,211 @@
+#include "sessionsnapshot.h"
+#include "trace.h"
+#include <QByteArray>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+namespace {
+
+const char Magic[8] = {'S', 'P', 'Q', 'S', 'E', 'S', 'S', '\0'};
+const quint32 FormatVersion = 1;
+// Written natively; a file from a machine of the other endianness is rejected
+const quint32 ByteOrderMark = 0x01020304;
+
+// File layout: Header, text strings, path strings, records (8-byte
+// aligned), shuffle order as qint32
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 recordSize;
+    quint32 trackCount;
+    quint32 textCount;
+    quint32 pathCount;
+    quint32 shuffleCount;
+    qint32 currentIndex;
+    quint32 repeatMode;
+    quint32 shuffleEnabled;
+    qint64 position;
+    quint64 textOffset;
+    quint64 pathOffset;
+    quint64 recordsOffset;
+    quint64 shuffleOffset;
+    quint64 fileSize;
+};
+
+static_assert(sizeof(Header) == 96, "Snapshot header layout is part of the file format");
+
+void padTo(QByteArray &out, int alignment) {
+    while (out.size() % alignment) {
+        out.append('\0');
+    }
+}
+
+// Each string is a quint32 length in UTF-16 units followed by the units,
+// padded to 4 bytes
+void appendStrings(QByteArray &out, const QList<QString> &strings) {
+    for (const QString &string : strings) {
+        const quint32 length = string.size();
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.append(reinterpret_cast<const char*>(string.utf16()), length * 2);
+        padTo(out, 4);
+    }
+}
+
+bool readStrings(const uchar *data, quint64 begin, quint64 end, quint32 count, QList<QString> &strings) {
+    // Every string takes at least its length field
+    if (quint64(count) * sizeof(quint32) > end - begin) {
+        return false;
+    }
+    strings.reserve(count);
+    quint64 offset = begin;
+    for (quint32 i = 0; i < count; ++i) {
+        quint32 length;
+        if (offset + sizeof(length) > end) {
+            return false;
+        }
+        memcpy(&length, data + offset, sizeof(length));
+        offset += sizeof(length);
+        if (offset + quint64(length) * 2 > end) {
+            return false;
+        }
+        QString string(length, Qt::Uninitialized);
+        memcpy(string.data(), data + offset, length * 2);
+        strings.append(std::move(string));
+        offset = (offset + quint64(length) * 2 + 3) & ~quint64(3);
+    }
+    return true;
+}
+
+} // namespace
+
+QString SessionSnapshot::defaultPath() {
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/SimplePlayerQt/session.bin";
+}
+
+bool SessionSnapshot::save(const QString &path, const TrackStore &tracks, const SessionState &state) {
+    TRACE_SCOPE("SessionSnapshot::save");
+    const QList<QString> &texts = tracks.texts().all();
+    const QList<QString> &paths = tracks.paths().all();
+    const QList<TrackRecord> &records = tracks.allRecords();
+
+    Header header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = FormatVersion;
+    header.byteOrder = ByteOrderMark;
+    header.recordSize = sizeof(TrackRecord);
+    header.trackCount = records.size();
+    header.textCount = texts.size();
+    header.pathCount = paths.size();
+    header.shuffleCount = state.shuffleOrder.size();
+    header.currentIndex = state.currentIndex;
+    header.repeatMode = state.repeatMode;
+    header.shuffleEnabled = state.shuffleEnabled;
+    header.position = state.position;
+
+    QByteArray out;
+    out.reserve(sizeof(Header) + records.size() * (sizeof(TrackRecord) + 64));
+    out.append(sizeof(Header), '\0');
+
+    header.textOffset = out.size();
+    appendStrings(out, texts);
+    header.pathOffset = out.size();
+    appendStrings(out, paths);
+
+    padTo(out, 8);
+    header.recordsOffset = out.size();
+    out.append(reinterpret_cast<const char*>(records.constData()), records.size() * sizeof(TrackRecord));
+
+    header.shuffleOffset = out.size();
+    for (int row : state.shuffleOrder) {
+        const qint32 value = row;
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    header.fileSize = out.size();
+    memcpy(out.data(), &header, sizeof(Header));
+
+    // QSaveFile only replaces the old snapshot once the new one is complete
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(out) != out.size() || !file.commit()) {
+        qWarning() << "Failed to write session snapshot" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool SessionSnapshot::load(const QString &path, TrackStore &tracks, SessionState &state) {
+    TRACE_SCOPE("SessionSnapshot::load");
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(Header))) {
+        return false;
+    }
+
+    const quint64 size = file.size();
+    uchar *data = file.map(0, size);
+    if (!data) {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, data, sizeof(Header));
+
+    const bool headerValid = memcmp(header.magic, Magic, sizeof(Magic)) == 0
+                             && header.version == FormatVersion
+                             && header.byteOrder == ByteOrderMark
+                             && header.recordSize == sizeof(TrackRecord)
+                             && header.fileSize == size
+                             && header.textOffset >= sizeof(Header)
+                             && header.textOffset <= header.pathOffset
+                             && header.pathOffset <= header.recordsOffset
+                             && header.recordsOffset <= header.shuffleOffset
+                             && header.shuffleOffset <= size
+                             && header.recordsOffset + quint64(header.trackCount) * sizeof(TrackRecord) <= header.shuffleOffset
+                             && header.shuffleOffset + quint64(header.shuffleCount) * sizeof(qint32) <= size;
+    if (!headerValid) {
+        qWarning() << "Ignoring unreadable session snapshot" << path;
+        return false;
+    }
+
+    QList<QString> texts;
+    QList<QString> paths;
+    if (!readStrings(data, header.textOffset, header.pathOffset, header.textCount, texts)
+        || !readStrings(data, header.pathOffset, header.recordsOffset, header.pathCount, paths)) {
+        qWarning() << "Ignoring unreadable session snapshot" << path;
+        return false;
+    }
+
+    // The record array is copied as a block; only the string ids are checked
+    QList<TrackRecord> records(header.trackCount);
+    memcpy(records.data(), data + header.recordsOffset, quint64(header.trackCount) * sizeof(TrackRecord));
+    for (const TrackRecord &record : std::as_const(records)) {
+        if (record.directory >= header.pathCount || record.fileName >= header.pathCount
+            || record.title >= header.textCount || record.artist >= header.textCount
+            || record.album >= header.textCount || record.genre >= header.textCount) {
+            qWarning() << "Ignoring unreadable session snapshot" << path;
+            return false;
+        }
+    }
+
+    QList<int> shuffleOrder(header.shuffleCount);
+    for (quint32 i = 0; i < header.shuffleCount; ++i) {
+        qint32 value;
+        memcpy(&value, data + header.shuffleOffset + i * sizeof(qint32), sizeof(value));
+        shuffleOrder[i] = value;
+    }
+    file.unmap(data);
+
+    tracks.assign(std::move(texts), std::move(paths), std::move(records));
+    state.currentIndex = header.currentIndex;
+    state.shuffleEnabled = header.shuffleEnabled != 0;
+    state.repeatMode = int(header.repeatMode);
+    state.position = header.position;
+    state.shuffleOrder = std::move(shuffleOrder);
+    return true;
+}
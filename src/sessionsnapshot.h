@@ -0,0 +1,34 @@
+#ifndef SESSIONSNAPSHOT_H
+#define SESSIONSNAPSHOT_H
+
+#include <QList>
+#include <QString>
+#include "trackstore.h"
+
+// Playback state saved alongside the playlist
+struct SessionState {
+    int currentIndex;
+    bool shuffleEnabled;
+    int repeatMode;
+    qint64 position;  // in milliseconds
+    QList<int> shuffleOrder;
+
+    SessionState() : currentIndex(0), shuffleEnabled(false), repeatMode(0), position(0) {}
+};
+
+// Versioned binary image of the playlist: the TrackStore's string tables and
+// its fixed-size records, written as they are in memory. Loading maps the
+// file and copies the record array in one go, so restoring a large session
+// costs no per-row parsing or tag I/O.
+class SessionSnapshot {
+public:
+    static QString defaultPath();
+
+    static bool save(const QString &path, const TrackStore &tracks, const SessionState &state);
+    static bool load(const QString &path, TrackStore &tracks, SessionState &state);
+
+private:
+    SessionSnapshot() {}
+};
+
+#endif // SESSIONSNAPSHOT_H
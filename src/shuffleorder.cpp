@@ -0,0 +1,108 @@
+#include "shuffleorder.h"
+#include <QRandomGenerator>
+
+void ShuffleOrder::reset(int rowCount, int firstRow) {
+    order.resize(rowCount);
+    positions.resize(rowCount);
+    for (int i = 0; i < rowCount; ++i) {
+        order[i] = i;
+    }
+
+    // Fisher-Yates
+    QRandomGenerator *random = QRandomGenerator::global();
+    for (int i = rowCount - 1; i > 0; --i) {
+        const int j = random->bounded(i + 1);
+        std::swap(order[i], order[j]);
+    }
+    for (int i = 0; i < rowCount; ++i) {
+        positions[order[i]] = i;
+    }
+
+    if (firstRow >= 0 && firstRow < rowCount) {
+        const int displaced = order[0];
+        place(positions[firstRow], displaced);
+        place(0, firstRow);
+    }
+}
+
+void ShuffleOrder::clear() {
+    order.clear();
+    positions.clear();
+}
+
+bool ShuffleOrder::assign(const QList<int> &savedOrder) {
+    const int count = savedOrder.size();
+    QList<int> inverse(count, -1);
+    for (int i = 0; i < count; ++i) {
+        const int row = savedOrder[i];
+        if (row < 0 || row >= count || inverse[row] >= 0) {
+            return false;
+        }
+        inverse[row] = i;
+    }
+
+    order = savedOrder;
+    positions = std::move(inverse);
+    return true;
+}
+
+void ShuffleOrder::insertRows(int first, int count, int fromPosition) {
+    if (count <= 0) {
+        return;
+    }
+
+    // Rows after the insertion point move down; appending skips this
+    const int oldSize = order.size();
+    order.resize(oldSize + count);
+    positions.resize(oldSize + count);
+    if (first < oldSize) {
+        for (int i = 0; i < oldSize; ++i) {
+            if (order[i] >= first) {
+                order[i] += count;
+            }
+            positions[order[i]] = i;
+        }
+    }
+
+    // Inside-out Fisher-Yates restricted to the unplayed tail: append, then
+    // swap with a random position in [fromPosition, end]
+    fromPosition = qBound(0, fromPosition, oldSize);
+    QRandomGenerator *random = QRandomGenerator::global();
+    for (int k = 0; k < count; ++k) {
+        const int end = oldSize + k;
+        const int row = first + k;
+        const int j = fromPosition + random->bounded(end - fromPosition + 1);
+        if (j != end) {
+            place(end, order[j]);
+        }
+        place(j, row);
+    }
+}
+
+void ShuffleOrder::removeRows(int first, int count) {
+    if (count <= 0) {
+        return;
+    }
+
+    const int last = first + count - 1;
+    int write = 0;
+    for (int read = 0; read < order.size(); ++read) {
+        const int row = order[read];
+        if (row >= first && row <= last) {
+            continue;
+        }
+        order[write++] = row > last ? row - count : row;
+    }
+    order.resize(write);
+
+    positions.resize(write);
+    for (int i = 0; i < write; ++i) {
+        positions[order[i]] = i;
+    }
+}
+
+void ShuffleOrder::remapRows(const QList<int> &newRows) {
+    for (int i = 0; i < order.size(); ++i) {
+        place(i, newRows[order[i]]);
+    }
+}
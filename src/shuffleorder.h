@@ -0,0 +1,46 @@
+#ifndef SHUFFLEORDER_H
+#define SHUFFLEORDER_H
+
+#include <QList>
+
+// Random play order over playlist rows. Keeps the permutation (position ->
+// row) and its inverse (row -> position), so finding where the current track
+// sits is O(1). Rows appended to the playlist are dropped into random
+// not-yet-played positions in O(1) each; removed rows are taken out in one
+// O(n) pass without reshuffling what is left.
+class ShuffleOrder {
+public:
+    int size() const { return order.size(); }
+    bool isEmpty() const { return order.isEmpty(); }
+    int rowAt(int position) const { return order[position]; }
+    int positionOf(int row) const { return positions[row]; }
+
+    // Fresh order over rows 0..rowCount-1; firstRow, if given, plays first
+    void reset(int rowCount, int firstRow = -1);
+    void clear();
+    // Restores a saved order; false (and nothing changed) unless it is a
+    // permutation of 0..size-1
+    bool assign(const QList<int> &savedOrder);
+    const QList<int> &rows() const { return order; }
+
+    // Rows [first, first + count) were inserted into the playlist. New rows
+    // land at random positions at or after fromPosition, so they are still
+    // ahead of the current track.
+    void insertRows(int first, int count, int fromPosition);
+    // Rows [first, first + count) were removed from the playlist
+    void removeRows(int first, int count);
+    // The playlist was reordered; newRows maps each old row to its new one.
+    // The play order itself is unchanged.
+    void remapRows(const QList<int> &newRows);
+
+private:
+    void place(int position, int row) {
+        order[position] = row;
+        positions[row] = position;
+    }
+
+    QList<int> order;      // position -> row
+    QList<int> positions;  // row -> position
+};
+
+#endif // SHUFFLEORDER_H
@@ -0,0 +1,53 @@
+#include "startuptiming.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+#include <cstring>
+
+namespace {
+
+bool enabled = false;
+bool reported = false;
+QElapsedTimer clock;
+QList<QPair<const char*, qint64>> stages;
+
+} // namespace
+
+void StartupTiming::start(int argc, char *argv[]) {
+    enabled = qEnvironmentVariableIsSet("SIMPLEPLAYER_STARTUP_TIMING");
+    for (int i = 1; i < argc && !enabled; ++i) {
+        enabled = strcmp(argv[i], "--startup-timing") == 0;
+    }
+    if (enabled) {
+        clock.start();
+    }
+}
+
+bool StartupTiming::isEnabled() {
+    return enabled;
+}
+
+void StartupTiming::mark(const char *stage) {
+    if (!enabled || reported) {
+        return;
+    }
+    for (const auto &recorded : std::as_const(stages)) {
+        if (strcmp(recorded.first, stage) == 0) {
+            return;
+        }
+    }
+    stages.append({stage, clock.nsecsElapsed() / 1000});
+}
+
+void StartupTiming::report() {
+    if (!enabled || reported) {
+        return;
+    }
+    reported = true;
+
+    qInfo().noquote() << "Startup timing (ms since main):";
+    for (const auto &stage : std::as_const(stages)) {
+        qInfo().noquote() << QString("  %1 %2").arg(stage.second / 1000.0, 9, 'f', 1).arg(stage.first);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef STARTUPTIMING_H
+#define STARTUPTIMING_H
+
+// Startup stage timestamps measured from the top of main(). Only recorded
+// and reported when SIMPLEPLAYER_STARTUP_TIMING is set or --startup-timing
+// is passed; otherwise every call is a cheap no-op.
+class StartupTiming {
+public:
+    static void start(int argc, char *argv[]);
+    static bool isEnabled();
+
+    // Records a stage; the first call for a given stage wins
+    static void mark(const char *stage);
+    // Prints all stages to stderr, once
+    static void report();
+
+private:
+    StartupTiming() {}
+};
+
+#endif // STARTUPTIMING_H
@@ -0,0 +1,729 @@
+#include "streamplayer.h"
+#include "trace.h"
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QAudioDevice>
+#include <QAudioSink>
+#include <QDebug>
+#include <QIODevice>
+#include <QMediaDevices>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// How often the mixer tops up the ring and checks playback progress
+static const int MixIntervalMs = 10;
+// How often position updates go out while playing
+static const int PositionIntervalMs = 100;
+// How far past the read position a track is decoded, and how much of what
+// was played stays decoded for seeking back
+static const int DecodeAheadMs = 20000;
+static const int KeepBehindMs = 10000;
+
+namespace {
+
+QAudioFormat outputFormat() {
+    const QAudioDevice device = QMediaDevices::defaultAudioOutput();
+    QAudioFormat format = device.preferredFormat();
+    format.setSampleFormat(QAudioFormat::Int16);
+    if (format.sampleRate() <= 0 || format.channelCount() <= 0 || !device.isFormatSupported(format)) {
+        format.setSampleRate(44100);
+        format.setChannelCount(2);
+    }
+    return format;
+}
+
+// Channel layouts may be labelled differently without changing the samples
+bool sameSampleLayout(const QAudioFormat &a, const QAudioFormat &b) {
+    return a.sampleRate() == b.sampleRate() && a.channelCount() == b.channelCount()
+           && a.sampleFormat() == b.sampleFormat();
+}
+
+// The output's side of the ring. Always returns as much as asked for: while
+// the ring is empty the gap is filled with silence, so the sink keeps
+// running and never has to restart after an underrun.
+class RingReader : public QIODevice {
+public:
+    RingReader(AudioRingBuffer *ring, int channels, std::atomic<bool> *drained,
+               std::atomic<int> *underruns, QObject *parent)
+        : QIODevice(parent), ring(ring), channels(channels), drained(drained), underruns(underruns) {}
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override {
+        return qint64(ring->capacity()) * qint64(sizeof(qint16)) + QIODevice::bytesAvailable();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override {
+        const int wanted = int(maxSize / qint64(sizeof(qint16))) / channels * channels;
+        qint16 *samples = reinterpret_cast<qint16*>(data);
+        int count = ring->read(samples, wanted);
+        if (count == 0 && wanted > 0) {
+            // A pending flush was carried out; what follows is already current
+            count = ring->read(samples, wanted);
+        }
+        if (count < wanted) {
+            if (!drained->load(std::memory_order_relaxed)) {
+                underruns->fetch_add(1, std::memory_order_relaxed);
+                TRACE_COUNTER("audio underruns", underruns->load(std::memory_order_relaxed));
+            }
+            std::memset(samples + count, 0, size_t(wanted - count) * sizeof(qint16));
+        }
+        return qint64(wanted) * qint64(sizeof(qint16));
+    }
+
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    AudioRingBuffer *ring;
+    int channels;
+    std::atomic<bool> *drained;
+    std::atomic<int> *underruns;
+};
+
+} // namespace
+
+// Lives on the output thread and owns the sink
+class StreamOutput : public QObject {
+public:
+    StreamOutput(const QAudioFormat &format, int bufferBytes, AudioRingBuffer *ring,
+                 std::atomic<bool> *drained, std::atomic<int> *underruns)
+        : format(format), bufferBytes(bufferBytes), ring(ring), drained(drained), underruns(underruns),
+          sink(nullptr), reader(nullptr), volume(1.0f) {}
+
+    void start() {
+        if (!sink) {
+            // Created here so that the sink and the reader belong to this thread
+            sink = new QAudioSink(format, this);
+            sink->setBufferSize(bufferBytes);
+            sink->setVolume(volume);
+            reader = new RingReader(ring, format.channelCount(), drained, underruns, this);
+            reader->open(QIODevice::ReadOnly);
+        }
+        if (sink->state() == QAudio::SuspendedState) {
+            sink->resume();
+        } else if (sink->state() != QAudio::ActiveState && sink->state() != QAudio::IdleState) {
+            sink->start(reader);
+        }
+    }
+
+    void pause() {
+        if (sink) {
+            sink->suspend();
+        }
+    }
+
+    void stop() {
+        if (sink) {
+            sink->stop();
+        }
+    }
+
+    void setVolume(float level) {
+        volume = level;
+        if (sink) {
+            sink->setVolume(level);
+        }
+    }
+
+private:
+    QAudioFormat format;
+    int bufferBytes;
+    AudioRingBuffer *ring;
+    std::atomic<bool> *drained;
+    std::atomic<int> *underruns;
+    QAudioSink *sink;
+    RingReader *reader;
+    float volume;
+};
+
+// Lives on the decode thread. Owns the decoders and the decoded windows of
+// the tracks and is the ring's only producer.
+class StreamMixer : public QObject {
+public:
+    StreamMixer(StreamPlayer *player, const QAudioFormat &format, int crossfadeMs, AudioRingBuffer *ring)
+        : player(player), format(format), ring(ring), mixBuffer(size_t(ring->capacity())), mixTimer(this) {
+        fadeSamples = msToSamples(crossfadeMs);
+        // The whole fade has to be decoded before it starts
+        aheadSamples = qMax(msToSamples(DecodeAheadMs), 2 * fadeSamples);
+        behindSamples = msToSamples(KeepBehindMs);
+        mixTimer.setInterval(MixIntervalMs);
+        QObject::connect(&mixTimer, &QTimer::timeout, this, [this]() {
+            fill();
+            reportProgress();
+        });
+    }
+
+    void open(quint64 id, const QUrl &source, bool asNext);
+    void promote(quint64 id, bool continuous);
+    void seek(qint64 positionMs);
+    void clear();
+
+private:
+    struct Voice {
+        quint64 id;
+        QUrl source;
+        QAudioDecoder *decoder;
+        QByteArray pcm;        // Decoded samples from firstSample on, interleaved
+        qint64 firstSample;
+        qint64 readSample;     // Next sample to write to the ring
+        qint64 anchorRing;     // Ring sample count at which anchorSample was written; -1 until then
+        qint64 anchorSample;
+        qint64 endRing;        // Ring sample count just past the last sample; -1 until all written
+        bool decoded;
+        bool loadedSent;
+        bool endSent;
+
+        Voice(quint64 id, const QUrl &source)
+            : id(id), source(source), decoder(nullptr), firstSample(0), readSample(0), anchorRing(-1),
+              anchorSample(0), endRing(-1), decoded(false), loadedSent(false), endSent(false) {}
+        ~Voice() { stopDecoder(); }
+
+        void stopDecoder() {
+            if (decoder) {
+                // May be inside one of the decoder's own signals
+                decoder->disconnect();
+                decoder->stop();
+                decoder->deleteLater();
+                decoder = nullptr;
+            }
+        }
+
+        // Samples decoded so far, counted from the start of the track
+        qint64 samples() const { return firstSample + pcm.size() / qint64(sizeof(qint16)); }
+        qint64 available() const { return qMax<qint64>(0, samples() - readSample); }
+        const qint16 *data(qint64 sample) const {
+            return reinterpret_cast<const qint16*>(pcm.constData()) + (sample - firstSample);
+        }
+        // Drops what lies more than keep behind the read position, at least
+        // keep at a time so the window isn't moved for every buffer
+        void trim(qint64 keep) {
+            const qint64 drop = qMin(readSample - keep, samples()) - firstSample;
+            if (drop >= keep) {
+                pcm.remove(0, drop * qint64(sizeof(qint16)));
+                firstSample += drop;
+            }
+        }
+        void rewind(qint64 sample) {
+            readSample = sample;
+            anchorRing = -1;
+            endRing = -1;
+            endSent = false;
+        }
+    };
+
+    void startDecoder(Voice *voice);
+    // Reads decoded buffers until aheadSamples are decoded past the read
+    // position; false if the voice failed and may be gone
+    bool decode(Voice *voice);
+    // Moves the read position, decoding again from the start if sample has
+    // already been dropped from the window
+    void rewind(Voice *voice, qint64 sample);
+    void fail(Voice *voice, const QString &errorString);
+    void fill();
+    // Writes count samples of voice, with the next track faded in when fading
+    void write(Voice *voice, qint64 count, bool fading);
+    void reportProgress();
+    qint64 samplesToMs(qint64 samples) const;
+    qint64 msToSamples(qint64 ms) const;
+
+    StreamPlayer *player;
+    QAudioFormat format;
+    AudioRingBuffer *ring;
+    qint64 fadeSamples;
+    qint64 aheadSamples;
+    qint64 behindSamples;
+    std::vector<qint16> mixBuffer;
+    QTimer mixTimer;
+
+    std::unique_ptr<Voice> current;
+    std::unique_ptr<Voice> next;
+};
+
+qint64 StreamMixer::samplesToMs(qint64 samples) const {
+    return samples / format.channelCount() * 1000 / format.sampleRate();
+}
+
+qint64 StreamMixer::msToSamples(qint64 ms) const {
+    return qint64(format.sampleRate()) * ms / 1000 * format.channelCount();
+}
+
+void StreamMixer::open(quint64 id, const QUrl &source, bool asNext) {
+    std::unique_ptr<Voice> voice(new Voice(id, source));
+    startDecoder(voice.get());
+    if (asNext) {
+        next = std::move(voice);
+    } else {
+        ring->requestFlush();
+        current = std::move(voice);
+        next.reset();
+        player->positionMs.store(0, std::memory_order_relaxed);
+    }
+    if (!mixTimer.isActive()) {
+        mixTimer.start();
+    }
+}
+
+void StreamMixer::startDecoder(Voice *voice) {
+    // Parented so that decoders still waiting on deleteLater() go with the
+    // mixer, which is destroyed after the decode thread's event loop has
+    // stopped and would never get to them
+    voice->decoder = new QAudioDecoder(this);
+    voice->decoder->setAudioFormat(format);
+
+    QObject::connect(voice->decoder, &QAudioDecoder::bufferReady, this, [this, voice]() {
+        if (!decode(voice)) {
+            return;
+        }
+        if (!voice->loadedSent) {
+            voice->loadedSent = true;
+            const quint64 id = voice->id;
+            QMetaObject::invokeMethod(player, [this, id]() {
+                player->trackLoaded(id);
+            }, Qt::QueuedConnection);
+        }
+    });
+    QObject::connect(voice->decoder, &QAudioDecoder::durationChanged, this, [this, voice](qint64 duration) {
+        if (duration <= 0) {
+            return;
+        }
+        const quint64 id = voice->id;
+        QMetaObject::invokeMethod(player, [this, id, duration]() {
+            player->trackDuration(id, duration);
+        }, Qt::QueuedConnection);
+    });
+    QObject::connect(voice->decoder, &QAudioDecoder::finished, this, [this, voice]() {
+        voice->decoded = true;
+        const quint64 id = voice->id;
+        const qint64 duration = samplesToMs(voice->samples());
+        QMetaObject::invokeMethod(player, [this, id, duration]() {
+            player->trackDuration(id, duration);
+        }, Qt::QueuedConnection);
+    });
+    QObject::connect(voice->decoder, qOverload<QAudioDecoder::Error>(&QAudioDecoder::error), this, [this, voice]() {
+        fail(voice, voice->decoder->errorString());
+    });
+
+    voice->decoder->setSource(voice->source);
+    voice->decoder->start();
+}
+
+bool StreamMixer::decode(Voice *voice) {
+    // A buffer left unread holds the decoder back until fill() has written
+    // enough for it to fit, so a long track never sits in memory whole
+    while (voice->decoder && voice->available() < aheadSamples && voice->decoder->bufferAvailable()) {
+        const QAudioBuffer buffer = voice->decoder->read();
+        if (!sameSampleLayout(buffer.format(), format)) {
+            fail(voice, "The decoder could not convert to the output format");
+            return false;
+        }
+        voice->pcm.append(buffer.constData<char>(), buffer.byteCount());
+        // Also drops what a seek forward skipped over as it comes in
+        voice->trim(behindSamples);
+    }
+    return true;
+}
+
+void StreamMixer::rewind(Voice *voice, qint64 sample) {
+    if (sample < voice->firstSample) {
+        // QAudioDecoder can't seek; what comes before sample is dropped by
+        // decode() as it arrives
+        voice->stopDecoder();
+        voice->pcm.clear();
+        voice->firstSample = 0;
+        voice->decoded = false;
+        startDecoder(voice);
+    }
+    voice->rewind(sample);
+}
+
+void StreamMixer::fail(Voice *voice, const QString &errorString) {
+    const quint64 id = voice->id;
+    QMetaObject::invokeMethod(player, [this, id, errorString]() {
+        player->trackFailed(id, errorString);
+    }, Qt::QueuedConnection);
+
+    // A failed next track is dropped; the current one plays out whatever
+    // was decoded before the error
+    if (next.get() == voice) {
+        next.reset();
+    } else {
+        voice->decoder->disconnect(this);
+        voice->decoder->stop();
+        voice->decoded = true;
+    }
+}
+
+void StreamMixer::promote(quint64 id, bool continuous) {
+    if (!next || next->id != id) {
+        return;
+    }
+    if (!continuous) {
+        // A skip rather than the end of the track: drop what is queued of
+        // the old one and start the new one from the top
+        ring->requestFlush();
+        rewind(next.get(), 0);
+    }
+    current = std::move(next);
+}
+
+void StreamMixer::seek(qint64 positionMs) {
+    if (!current) {
+        return;
+    }
+
+    const int channels = format.channelCount();
+    qint64 target = qint64(format.sampleRate()) * qMax<qint64>(0, positionMs) / 1000 * channels;
+    if (current->decoded) {
+        target = qMin(target, current->samples() / channels * channels);
+    }
+
+    // Anything of the next track already mixed in is thrown away with the
+    // ring's contents and mixed again later
+    rewind(current.get(), target);
+    if (next) {
+        rewind(next.get(), 0);
+    }
+    ring->requestFlush();
+    player->positionMs.store(samplesToMs(target), std::memory_order_relaxed);
+}
+
+void StreamMixer::clear() {
+    ring->requestFlush();
+    current.reset();
+    next.reset();
+    mixTimer.stop();
+    player->drained.store(true, std::memory_order_relaxed);
+    player->positionMs.store(0, std::memory_order_relaxed);
+}
+
+void StreamMixer::fill() {
+    // Decoding continues as far as what was written has made room for
+    if (current) {
+        decode(current.get());
+    }
+    if (next) {
+        decode(next.get());
+    }
+
+    // The output hasn't dropped the stale samples yet
+    if (ring->isFlushPending()) {
+        return;
+    }
+
+    qint64 space = ring->availableToWrite() / format.channelCount() * format.channelCount();
+    while (space > 0) {
+        // The current track, then the next one once the current is all written
+        Voice *voice = current && current->endRing < 0 ? current.get()
+                       : next && next->endRing < 0 ? next.get() : nullptr;
+        if (!voice) {
+            break;
+        }
+        if (voice->available() == 0) {
+            if (!voice->decoded) {
+                break;  // Waiting on the decoder
+            }
+            voice->endRing = qint64(ring->writeCount());
+            continue;
+        }
+
+        qint64 count = qMin(space, voice->available());
+        bool fading = false;
+        if (voice == current.get() && next && fadeSamples > 0 && current->decoded) {
+            const qint64 fadeStart = qMax<qint64>(0, current->samples() - fadeSamples);
+            if (current->readSample < fadeStart) {
+                count = qMin(count, fadeStart - current->readSample);
+            } else {
+                fading = true;
+            }
+        }
+        write(voice, count, fading);
+        space -= count;
+    }
+
+    const bool producing = (current && current->endRing < 0) || (next && next->endRing < 0);
+    player->drained.store(!producing, std::memory_order_relaxed);
+}
+
+void StreamMixer::write(Voice *voice, qint64 count, bool fading) {
+    const qint64 ringPosition = qint64(ring->writeCount());
+    if (voice->anchorRing < 0) {
+        voice->anchorRing = ringPosition;
+        voice->anchorSample = voice->readSample;
+    }
+
+    const qint16 *source = voice->data(voice->readSample);
+    if (!fading) {
+        ring->write(source, int(count));
+        voice->readSample += count;
+        return;
+    }
+
+    // Equal-power crossfade over the last fadeSamples of the current track.
+    // The next track joins as soon as it has decoded audio; until then the
+    // current one fades out alone.
+    const int channels = format.channelCount();
+    const qint64 incoming = qMin(count, next->available());
+    if (incoming > 0 && next->anchorRing < 0) {
+        next->anchorRing = ringPosition;
+        next->anchorSample = next->readSample;
+    }
+    const qint16 *nextSource = next->data(next->readSample);
+    const qint64 total = voice->samples();
+    for (qint64 i = 0; i < count; i += channels) {
+        const double t = qBound(0.0, 1.0 - double(total - (voice->readSample + i)) / double(fadeSamples), 1.0);
+        const double fadeOut = std::cos(t * M_PI / 2);
+        const double fadeIn = std::sin(t * M_PI / 2);
+        for (int c = 0; c < channels; ++c) {
+            double sample = source[i + c] * fadeOut;
+            if (i < incoming) {
+                sample += nextSource[i + c] * fadeIn;
+            }
+            mixBuffer[size_t(i + c)] = qint16(qBound(-32768.0, sample, 32767.0));
+        }
+    }
+    ring->write(mixBuffer.data(), int(count));
+    voice->readSample += count;
+    next->readSample += incoming;
+}
+
+void StreamMixer::reportProgress() {
+    if (!current) {
+        return;
+    }
+
+    const qint64 played = qint64(ring->readCount());
+    qint64 sample = current->readSample;
+    if (current->anchorRing >= 0) {
+        sample = current->anchorSample + qBound<qint64>(0, played - current->anchorRing,
+                                                        current->samples() - current->anchorSample);
+    }
+    player->positionMs.store(samplesToMs(sample), std::memory_order_relaxed);
+
+    if (current->endRing >= 0 && played >= current->endRing && !current->endSent) {
+        current->endSent = true;
+        const quint64 id = current->id;
+        QMetaObject::invokeMethod(player, [this, id]() {
+            player->trackEnded(id);
+        }, Qt::QueuedConnection);
+    }
+}
+
+StreamPlayer::StreamPlayer(int bufferMs, int crossfadeMs, QObject *parent)
+    : QObject(parent), currentId(0), preparedId(0), preparedLoaded(false), preparedDuration(0), nextId(1),
+      state(QMediaPlayer::StoppedState), status(QMediaPlayer::NoMedia), durationMs(0), shownPosition(-1),
+      volumeLevel(1.0f), positionMs(0), drained(true), underrunCount(0) {
+    format = outputFormat();
+    ring.reset(new AudioRingBuffer(format.bytesForDuration(qint64(bufferMs) * 1000) / int(sizeof(qint16))));
+
+    mixer = new StreamMixer(this, format, crossfadeMs, ring.get());
+    mixer->moveToThread(&decodeThread);
+    connect(&decodeThread, &QThread::finished, mixer, &QObject::deleteLater);
+
+    // The sink holds a quarter of the ring; the rest is the margin the mixer
+    // has before an underrun
+    output = new StreamOutput(format, format.bytesForDuration(qint64(bufferMs) * 1000 / 4), ring.get(),
+                              &drained, &underrunCount);
+    output->moveToThread(&outputThread);
+    connect(&outputThread, &QThread::finished, output, &QObject::deleteLater);
+
+    decodeThread.setObjectName("Audio decode");
+    outputThread.setObjectName("Audio output");
+    decodeThread.start(QThread::HighPriority);
+    outputThread.start(QThread::TimeCriticalPriority);
+
+    positionTimer.setInterval(PositionIntervalMs);
+    connect(&positionTimer, &QTimer::timeout, this, &StreamPlayer::updatePosition);
+}
+
+StreamPlayer::~StreamPlayer() {
+    decodeThread.quit();
+    outputThread.quit();
+    decodeThread.wait();
+    outputThread.wait();
+
+    if (underrunCount > 0) {
+        qWarning() << "Audio output ran dry" << underrunCount.load() << "times";
+    }
+}
+
+void StreamPlayer::setSource(const QUrl &source) {
+    if (!prepared.isEmpty() && source == prepared) {
+        // Already decoding and, at the end of a track, already audible
+        const bool continuous = status == QMediaPlayer::EndOfMedia;
+        const quint64 id = preparedId;
+        QMetaObject::invokeMethod(mixer, [this, id, continuous]() {
+            mixer->promote(id, continuous);
+        }, Qt::QueuedConnection);
+
+        currentSource = source;
+        currentId = preparedId;
+        prepared.clear();
+        durationMs = preparedDuration;
+        emit durationChanged(durationMs);
+        setStatus(preparedLoaded ? QMediaPlayer::LoadedMedia : QMediaPlayer::LoadingMedia);
+        return;
+    }
+
+    prepared.clear();
+    currentSource = source;
+    currentId = nextId++;
+    durationMs = 0;
+    emit durationChanged(0);
+
+    if (source.isEmpty()) {
+        QMetaObject::invokeMethod(mixer, [this]() {
+            mixer->clear();
+        }, Qt::QueuedConnection);
+        setState(QMediaPlayer::StoppedState);
+        setStatus(QMediaPlayer::NoMedia);
+        return;
+    }
+
+    const quint64 id = currentId;
+    QMetaObject::invokeMethod(mixer, [this, id, source]() {
+        mixer->open(id, source, false);
+    }, Qt::QueuedConnection);
+    setStatus(QMediaPlayer::LoadingMedia);
+    updatePosition();
+}
+
+void StreamPlayer::prepareNext(const QUrl &source) {
+    if (source == prepared || source == currentSource) {
+        return;
+    }
+
+    prepared = source;
+    preparedId = nextId++;
+    preparedLoaded = false;
+    preparedDuration = 0;
+    const quint64 id = preparedId;
+    QMetaObject::invokeMethod(mixer, [this, id, source]() {
+        mixer->open(id, source, true);
+    }, Qt::QueuedConnection);
+}
+
+void StreamPlayer::play() {
+    if (currentSource.isEmpty() || state == QMediaPlayer::PlayingState) {
+        return;
+    }
+    if (status == QMediaPlayer::EndOfMedia) {
+        setPosition(0);
+    }
+
+    QMetaObject::invokeMethod(output, [this]() {
+        output->start();
+    }, Qt::QueuedConnection);
+    positionTimer.start();
+    setState(QMediaPlayer::PlayingState);
+}
+
+void StreamPlayer::pause() {
+    if (state != QMediaPlayer::PlayingState) {
+        return;
+    }
+    QMetaObject::invokeMethod(output, [this]() {
+        output->pause();
+    }, Qt::QueuedConnection);
+    positionTimer.stop();
+    setState(QMediaPlayer::PausedState);
+}
+
+void StreamPlayer::stop() {
+    if (state == QMediaPlayer::StoppedState) {
+        return;
+    }
+    QMetaObject::invokeMethod(output, [this]() {
+        output->stop();
+    }, Qt::QueuedConnection);
+    positionTimer.stop();
+    setPosition(0);
+    setState(QMediaPlayer::StoppedState);
+}
+
+void StreamPlayer::setPosition(qint64 position) {
+    QMetaObject::invokeMethod(mixer, [this, position]() {
+        mixer->seek(position);
+    }, Qt::QueuedConnection);
+
+    if (status == QMediaPlayer::EndOfMedia) {
+        setStatus(QMediaPlayer::LoadedMedia);
+    }
+    shownPosition = position;
+    emit positionChanged(position);
+}
+
+void StreamPlayer::setVolume(float volume) {
+    volumeLevel = volume;
+    QMetaObject::invokeMethod(output, [this, volume]() {
+        output->setVolume(volume);
+    }, Qt::QueuedConnection);
+}
+
+void StreamPlayer::trackLoaded(quint64 id) {
+    if (id == preparedId && !prepared.isEmpty()) {
+        preparedLoaded = true;
+    } else if (id == currentId && status == QMediaPlayer::LoadingMedia) {
+        setStatus(QMediaPlayer::LoadedMedia);
+    }
+}
+
+void StreamPlayer::trackDuration(quint64 id, qint64 duration) {
+    if (id == preparedId && !prepared.isEmpty()) {
+        preparedDuration = duration;
+    } else if (id == currentId && duration != durationMs) {
+        durationMs = duration;
+        emit durationChanged(duration);
+    }
+}
+
+void StreamPlayer::trackEnded(quint64 id) {
+    if (id != currentId) {
+        return;
+    }
+    updatePosition();
+    setStatus(QMediaPlayer::EndOfMedia);
+
+    // Handlers of EndOfMedia usually start another track or replay this one;
+    // if none did, playback is over
+    if (status == QMediaPlayer::EndOfMedia && state == QMediaPlayer::PlayingState) {
+        QMetaObject::invokeMethod(output, [this]() {
+            output->stop();
+        }, Qt::QueuedConnection);
+        positionTimer.stop();
+        setState(QMediaPlayer::StoppedState);
+    }
+}
+
+void StreamPlayer::trackFailed(quint64 id, const QString &errorString) {
+    if (id == preparedId && !prepared.isEmpty()) {
+        // Loaded again from scratch if it does get played
+        prepared.clear();
+    } else if (id == currentId) {
+        setStatus(QMediaPlayer::InvalidMedia);
+        emit errorOccurred(errorString);
+    }
+}
+
+void StreamPlayer::setStatus(QMediaPlayer::MediaStatus newStatus) {
+    if (status != newStatus) {
+        status = newStatus;
+        emit mediaStatusChanged(newStatus);
+    }
+}
+
+void StreamPlayer::setState(QMediaPlayer::PlaybackState newState) {
+    if (state != newState) {
+        state = newState;
+        emit playbackStateChanged(newState);
+    }
+}
+
+void StreamPlayer::updatePosition() {
+    const qint64 current = position();
+    if (current != shownPosition) {
+        shownPosition = current;
+        emit positionChanged(current);
+    }
+}
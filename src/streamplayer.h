@@ -0,0 +1,110 @@
+#ifndef STREAMPLAYER_H
+#define STREAMPLAYER_H
+
+#include <QAudioFormat>
+#include <QMediaPlayer>
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
+#include <atomic>
+#include <memory>
+#include "audioringbuffer.h"
+
+class StreamMixer;
+class StreamOutput;
+
+// Playback engine without QMediaPlayer. QAudioDecoders feed a mixer on a
+// decode thread, which writes into a lock-free ring that a QAudioSink on an
+// output thread pulls from. Neither thread goes through the GUI thread's
+// event loop, so a busy GUI delays position updates but never the audio.
+//
+// Each track is decoded only a window ahead of what has been written, with
+// some of what was played kept for seeking back, so memory stays the same
+// however long the track. Seeking within the window only moves a read
+// offset; QAudioDecoder can't seek, so seeking back past it decodes the
+// track again from the start. A track handed to prepareNext() is decoded
+// alongside the current one and mixed in under its end with an
+// equal-power crossfade. The API mirrors the parts of QMediaPlayer that
+// PlaybackEngine forwards.
+class StreamPlayer : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultBufferMs = 500;
+
+    // bufferMs is the depth of the ring between mixer and output;
+    // crossfadeMs of 0 plays prepared tracks back to back
+    StreamPlayer(int bufferMs, int crossfadeMs, QObject *parent = nullptr);
+    ~StreamPlayer();
+
+    QUrl source() const { return currentSource; }
+    void setSource(const QUrl &source);
+    void prepareNext(const QUrl &source);
+    QUrl preparedSource() const { return prepared; }
+
+    void play();
+    void pause();
+    void stop();
+
+    qint64 position() const { return positionMs.load(std::memory_order_relaxed); }
+    void setPosition(qint64 position);
+    qint64 duration() const { return durationMs; }
+    QMediaPlayer::PlaybackState playbackState() const { return state; }
+    QMediaPlayer::MediaStatus mediaStatus() const { return status; }
+
+    float volume() const { return volumeLevel; }
+    void setVolume(float volume);
+
+    // Times the output found the ring empty while a track was playing
+    int underruns() const { return underrunCount.load(std::memory_order_relaxed); }
+
+signals:
+    void positionChanged(qint64 position);
+    void durationChanged(qint64 duration);
+    void mediaStatusChanged(QMediaPlayer::MediaStatus status);
+    void playbackStateChanged(QMediaPlayer::PlaybackState state);
+    void errorOccurred(const QString &errorString);
+
+private:
+    friend class StreamMixer;
+
+    // Reported by the mixer, queued to this thread; id names the track
+    void trackLoaded(quint64 id);
+    void trackDuration(quint64 id, qint64 duration);
+    void trackEnded(quint64 id);
+    void trackFailed(quint64 id, const QString &errorString);
+
+    void setStatus(QMediaPlayer::MediaStatus newStatus);
+    void setState(QMediaPlayer::PlaybackState newState);
+    void updatePosition();
+
+    QAudioFormat format;
+    std::unique_ptr<AudioRingBuffer> ring;
+    QThread decodeThread;
+    QThread outputThread;
+    StreamMixer *mixer;
+    StreamOutput *output;
+    QTimer positionTimer;
+
+    QUrl currentSource;
+    quint64 currentId;
+    QUrl prepared;
+    quint64 preparedId;
+    bool preparedLoaded;
+    qint64 preparedDuration;
+    quint64 nextId;
+
+    QMediaPlayer::PlaybackState state;
+    QMediaPlayer::MediaStatus status;
+    qint64 durationMs;
+    qint64 shownPosition;
+    float volumeLevel;
+
+    // Written by the mixer and output threads
+    std::atomic<qint64> positionMs;
+    std::atomic<bool> drained;  // Nothing left to write, so an empty ring is not an underrun
+    std::atomic<int> underrunCount;
+};
+
+#endif // STREAMPLAYER_H
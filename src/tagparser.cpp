@@ -0,0 +1,967 @@
+#include "tagparser.h"
+#include "trace.h"
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <cstring>
+
+namespace {
+
+// Bytes of a memory-mapped file; every read below is bounds-checked against it
+struct Bytes {
+    const uchar *data;
+    qint64 size;
+
+    bool has(qint64 offset, qint64 length) const {
+        return offset >= 0 && length >= 0 && offset <= size && length <= size - offset;
+    }
+    bool matches(qint64 offset, const char *magic, qint64 length) const {
+        return has(offset, length) && memcmp(data + offset, magic, length) == 0;
+    }
+};
+
+quint32 be16(const uchar *p) { return (quint32(p[0]) << 8) | p[1]; }
+quint32 be24(const uchar *p) { return (quint32(p[0]) << 16) | (quint32(p[1]) << 8) | p[2]; }
+quint32 be32(const uchar *p) { return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | p[3]; }
+quint64 be64(const uchar *p) { return (quint64(be32(p)) << 32) | be32(p + 4); }
+quint32 le16(const uchar *p) { return p[0] | (quint32(p[1]) << 8); }
+quint32 le32(const uchar *p) { return p[0] | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24); }
+quint64 le64(const uchar *p) { return le32(p) | (quint64(le32(p + 4)) << 32); }
+quint32 syncsafe32(const uchar *p) {
+    return ((p[0] & 0x7f) << 21) | ((p[1] & 0x7f) << 14) | ((p[2] & 0x7f) << 7) | (p[3] & 0x7f);
+}
+
+const char *const id3Genres[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop",
+    "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock",
+    "Techno", "Industrial", "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack",
+    "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance",
+    "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "AlternRock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop",
+    "Instrumental Rock", "Ethnic", "Gothic", "Darkwave", "Techno-Industrial", "Electronic",
+    "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40",
+    "Christian Rap", "Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave",
+    "Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal", "Acid Punk", "Acid Jazz",
+    "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock", "Folk", "Folk-Rock",
+    "National Folk", "Swing", "Fast Fusion", "Bebob", "Latin", "Revival", "Celtic",
+    "Bluegrass", "Avantgarde", "Gothic Rock", "Progressive Rock", "Psychedelic Rock",
+    "Symphonic Rock", "Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic",
+    "Humour", "Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony",
+    "Booty Bass", "Primus", "Porn Groove", "Satire", "Slow Jam", "Club", "Tango", "Samba",
+    "Folklore", "Ballad", "Power Ballad", "Rhythmic Soul", "Freestyle", "Duet", "Punk Rock",
+    "Drum Solo", "A capella", "Euro-House", "Dance Hall"
+};
+const int id3GenreCount = sizeof(id3Genres) / sizeof(id3Genres[0]);
+
+QString genreName(int index) {
+    if (index >= 0 && index < id3GenreCount) {
+        return QString::fromLatin1(id3Genres[index]);
+    }
+    return QString();
+}
+
+void setIfEmpty(QString &field, const QString &value) {
+    if (field.isEmpty()) {
+        field = value.trimmed();
+    }
+}
+
+void setTrackNumber(Metadata &metadata, const QString &value) {
+    if (metadata.trackNumber == 0) {
+        // "3" or "3/12"
+        metadata.trackNumber = value.section('/', 0, 0).trimmed().toInt();
+    }
+}
+
+void setYear(Metadata &metadata, const QString &value) {
+    if (metadata.year == 0) {
+        metadata.year = value.trimmed().left(4).toInt();
+    }
+}
+
+// "(17)", "17" and "(17)Rock" all name ID3v1 genre 17
+void setGenre(Metadata &metadata, const QString &value) {
+    QString genre = value.trimmed();
+    if (genre.startsWith('(')) {
+        const int close = genre.indexOf(')');
+        bool ok = false;
+        const int index = genre.mid(1, close - 1).toInt(&ok);
+        if (close > 0 && ok) {
+            const QString refinement = genre.mid(close + 1).trimmed();
+            genre = refinement.isEmpty() ? genreName(index) : refinement;
+        }
+    } else {
+        bool ok = false;
+        const int index = genre.toInt(&ok);
+        if (ok) {
+            genre = genreName(index);
+        }
+    }
+    setIfEmpty(metadata.genre, genre);
+}
+
+qint64 nulTerminatedLength(const uchar *data, qint64 size) {
+    const void *nul = memchr(data, 0, size);
+    return nul ? static_cast<const uchar*>(nul) - data : size;
+}
+
+QString decodeLatin1(const uchar *data, qint64 size) {
+    return QString::fromLatin1(reinterpret_cast<const char*>(data), nulTerminatedLength(data, size));
+}
+
+QString decodeUtf8(const uchar *data, qint64 size) {
+    return QString::fromUtf8(reinterpret_cast<const char*>(data), nulTerminatedLength(data, size));
+}
+
+// RIFF INFO and similar fields carry no declared encoding
+QString decodeUtf8OrLatin1(const uchar *data, qint64 size) {
+    const QString text = decodeUtf8(data, size);
+    return text.contains(QChar::ReplacementCharacter) ? decodeLatin1(data, size) : text;
+}
+
+QString decodeUtf16(const uchar *data, qint64 size, bool bigEndian) {
+    QString text;
+    text.reserve(size / 2);
+    for (qint64 i = 0; i + 1 < size; i += 2) {
+        const char16_t unit = bigEndian ? be16(data + i) : le16(data + i);
+        if (unit == 0) {
+            break;
+        }
+        text.append(QChar(unit));
+    }
+    return text;
+}
+
+// ID3v2
+
+QString decodeId3Text(const uchar *data, qint64 size) {
+    if (size < 1) {
+        return QString();
+    }
+    const uchar encoding = data[0];
+    ++data;
+    --size;
+
+    switch (encoding) {
+    case 0:
+        return decodeLatin1(data, size);
+    case 1:
+        // UTF-16 with byte order mark
+        if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
+            return decodeUtf16(data + 2, size - 2, true);
+        } else if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+            return decodeUtf16(data + 2, size - 2, false);
+        }
+        return decodeUtf16(data, size, false);
+    case 2:
+        return decodeUtf16(data, size, true);
+    case 3:
+        return decodeUtf8(data, size);
+    default:
+        return QString();
+    }
+}
+
+QByteArray removeUnsynchronisation(const uchar *data, qint64 size) {
+    QByteArray result;
+    result.reserve(size);
+    for (qint64 i = 0; i < size; ++i) {
+        result.append(char(data[i]));
+        if (data[i] == 0xFF && i + 1 < size && data[i + 1] == 0x00) {
+            ++i;
+        }
+    }
+    return result;
+}
+
+void applyId3Frame(const QByteArray &id, const uchar *body, qint64 size, Metadata &metadata, qint64 &lengthMs) {
+    if (id == "TIT2" || id == "TT2") {
+        setIfEmpty(metadata.title, decodeId3Text(body, size));
+    } else if (id == "TPE1" || id == "TP1") {
+        setIfEmpty(metadata.artist, decodeId3Text(body, size));
+    } else if (id == "TALB" || id == "TAL") {
+        setIfEmpty(metadata.album, decodeId3Text(body, size));
+    } else if (id == "TCON" || id == "TCO") {
+        setGenre(metadata, decodeId3Text(body, size));
+    } else if (id == "TRCK" || id == "TRK") {
+        setTrackNumber(metadata, decodeId3Text(body, size));
+    } else if (id == "TYER" || id == "TYE" || id == "TDRC") {
+        setYear(metadata, decodeId3Text(body, size));
+    } else if (id == "TLEN" || id == "TLE") {
+        lengthMs = decodeId3Text(body, size).trimmed().toLongLong();
+    }
+}
+
+void parseId3v2Frames(const uchar *data, qint64 size, int version, Metadata &metadata, qint64 &lengthMs) {
+    const int idLength = version == 2 ? 3 : 4;
+    const int headerLength = version == 2 ? 6 : 10;
+
+    qint64 pos = 0;
+    while (pos + headerLength <= size) {
+        const uchar *frame = data + pos;
+        if (frame[0] == 0) {
+            break;  // Padding
+        }
+
+        const QByteArray id(reinterpret_cast<const char*>(frame), idLength);
+        qint64 frameSize;
+        int flags = 0;
+        if (version == 2) {
+            frameSize = be24(frame + 3);
+        } else if (version == 3) {
+            frameSize = be32(frame + 4);
+            flags = be16(frame + 8);
+        } else {
+            frameSize = syncsafe32(frame + 4);
+            flags = be16(frame + 8);
+        }
+
+        pos += headerLength;
+        if (frameSize <= 0 || frameSize > size - pos) {
+            break;
+        }
+        const uchar *body = data + pos;
+        qint64 bodySize = frameSize;
+        pos += frameSize;
+
+        QByteArray unsynchronised;
+        if (version == 3) {
+            if (flags & 0x00C0) {
+                continue;  // Compressed or encrypted
+            }
+            if (flags & 0x0020) {
+                ++body;  // Group id
+                --bodySize;
+            }
+        } else if (version == 4) {
+            if (flags & 0x000C) {
+                continue;  // Compressed or encrypted
+            }
+            if (flags & 0x0040) {
+                ++body;  // Group id
+                --bodySize;
+            }
+            if (flags & 0x0001) {
+                body += 4;  // Data length indicator
+                bodySize -= 4;
+            }
+            if (bodySize > 0 && (flags & 0x0002)) {
+                unsynchronised = removeUnsynchronisation(body, bodySize);
+                body = reinterpret_cast<const uchar*>(unsynchronised.constData());
+                bodySize = unsynchronised.size();
+            }
+        }
+
+        if (bodySize > 0) {
+            applyId3Frame(id, body, bodySize, metadata, lengthMs);
+        }
+    }
+}
+
+// Returns the number of bytes taken by the tag at offset, or 0 if there is none
+qint64 parseId3v2(const Bytes &file, qint64 offset, Metadata &metadata, qint64 &lengthMs) {
+    if (!file.matches(offset, "ID3", 3) || !file.has(offset, 10)) {
+        return 0;
+    }
+    const uchar *header = file.data + offset;
+    const int version = header[3];
+    const int flags = header[5];
+    const qint64 tagSize = syncsafe32(header + 6);
+    const qint64 totalSize = 10 + tagSize + ((flags & 0x10) ? 10 : 0);
+    if (version < 2 || version > 4 || !file.has(offset + 10, tagSize)) {
+        return 0;
+    }
+
+    if (version == 2 && (flags & 0x40)) {
+        return totalSize;  // v2.2 compression has no defined scheme
+    }
+
+    const uchar *data = header + 10;
+    qint64 size = tagSize;
+
+    // Tag-wide unsynchronisation (v2.2/v2.3; v2.4 flags it per frame)
+    QByteArray unsynchronised;
+    if ((flags & 0x80) && version < 4) {
+        unsynchronised = removeUnsynchronisation(data, size);
+        data = reinterpret_cast<const uchar*>(unsynchronised.constData());
+        size = unsynchronised.size();
+    }
+
+    if ((flags & 0x40) && version >= 3 && size >= 4) {
+        // Extended header: v2.3 size excludes itself, v2.4 size includes itself
+        const qint64 extendedSize = version == 3 ? be32(data) + 4 : syncsafe32(data);
+        if (extendedSize > size) {
+            return totalSize;
+        }
+        data += extendedSize;
+        size -= extendedSize;
+    }
+
+    parseId3v2Frames(data, size, version, metadata, lengthMs);
+    return totalSize;
+}
+
+// Returns true if the last 128 bytes hold an ID3v1 tag
+bool parseId3v1(const Bytes &file, Metadata &metadata) {
+    const qint64 offset = file.size - 128;
+    if (!file.matches(offset, "TAG", 3)) {
+        return false;
+    }
+    const uchar *tag = file.data + offset;
+    setIfEmpty(metadata.title, decodeLatin1(tag + 3, 30));
+    setIfEmpty(metadata.artist, decodeLatin1(tag + 33, 30));
+    setIfEmpty(metadata.album, decodeLatin1(tag + 63, 30));
+    setYear(metadata, decodeLatin1(tag + 93, 4));
+    if (tag[125] == 0 && tag[126] != 0 && metadata.trackNumber == 0) {
+        metadata.trackNumber = tag[126];  // ID3v1.1
+    }
+    if (metadata.genre.isEmpty()) {
+        metadata.genre = genreName(tag[127]);
+    }
+    return true;
+}
+
+// MPEG audio and ADTS streams
+
+struct MpegFrame {
+    int version;  // 1, 2 or 25 (MPEG 2.5)
+    int layer;
+    int bitrate;  // kbit/s
+    int sampleRate;
+    bool mono;
+    int samplesPerFrame;
+    int length;
+};
+
+bool parseMpegHeader(const uchar *h, MpegFrame &frame) {
+    static const int bitrates[5][15] = {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},  // V1 L1
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},     // V1 L2
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},      // V1 L3
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},     // V2 L1
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}           // V2 L2/L3
+    };
+    static const int sampleRates[3][3] = {
+        {44100, 48000, 32000}, {22050, 24000, 16000}, {11025, 12000, 8000}
+    };
+
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+    const int versionBits = (h[1] >> 3) & 0x03;
+    const int layerBits = (h[1] >> 1) & 0x03;
+    const int bitrateIndex = h[2] >> 4;
+    const int sampleRateIndex = (h[2] >> 2) & 0x03;
+    if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3) {
+        return false;
+    }
+
+    frame.version = versionBits == 3 ? 1 : (versionBits == 2 ? 2 : 25);
+    frame.layer = 4 - layerBits;
+    const int table = frame.version == 1 ? frame.layer - 1 : (frame.layer == 1 ? 3 : 4);
+    frame.bitrate = bitrates[table][bitrateIndex];
+    frame.sampleRate = sampleRates[frame.version == 1 ? 0 : (frame.version == 2 ? 1 : 2)][sampleRateIndex];
+    frame.mono = (h[3] >> 6) == 3;
+
+    const int padding = (h[2] >> 1) & 0x01;
+    if (frame.layer == 1) {
+        frame.samplesPerFrame = 384;
+        frame.length = (12 * frame.bitrate * 1000 / frame.sampleRate + padding) * 4;
+    } else if (frame.layer == 3 && frame.version != 1) {
+        frame.samplesPerFrame = 576;
+        frame.length = 72 * frame.bitrate * 1000 / frame.sampleRate + padding;
+    } else {
+        frame.samplesPerFrame = 1152;
+        frame.length = 144 * frame.bitrate * 1000 / frame.sampleRate + padding;
+    }
+    return frame.length > 4;
+}
+
+// First frame whose successor also parses, to skip over false syncs in junk data
+qint64 findMpegFrame(const Bytes &file, qint64 start, MpegFrame &frame) {
+    const qint64 limit = qMin(file.size - 4, start + 64 * 1024);
+    for (qint64 pos = start; pos < limit; ++pos) {
+        if (file.data[pos] != 0xFF || !parseMpegHeader(file.data + pos, frame)) {
+            continue;
+        }
+        const qint64 next = pos + frame.length;
+        MpegFrame nextFrame;
+        if (!file.has(next, 4)) {
+            return pos;
+        }
+        if (parseMpegHeader(file.data + next, nextFrame) && nextFrame.version == frame.version
+                && nextFrame.layer == frame.layer && nextFrame.sampleRate == frame.sampleRate) {
+            return pos;
+        }
+    }
+    return -1;
+}
+
+// Returns 0 if no MPEG audio frame is found
+qint64 mpegDuration(const Bytes &file, qint64 audioStart, qint64 audioEnd) {
+    MpegFrame frame;
+    const qint64 pos = findMpegFrame(file, audioStart, frame);
+    if (pos < 0) {
+        return 0;
+    }
+
+    // Xing/Info header sits right after the side information of the first frame
+    const int sideInfo = frame.version == 1 ? (frame.mono ? 17 : 32) : (frame.mono ? 9 : 17);
+    const qint64 xing = pos + 4 + sideInfo;
+    if ((file.matches(xing, "Xing", 4) || file.matches(xing, "Info", 4)) && file.has(xing, 12)) {
+        const quint32 flags = be32(file.data + xing + 4);
+        const quint32 frames = be32(file.data + xing + 8);
+        if ((flags & 0x01) && frames > 0) {
+            return qint64(frames) * frame.samplesPerFrame * 1000 / frame.sampleRate;
+        }
+    }
+
+    // VBRI header always sits 32 bytes after the frame header
+    const qint64 vbri = pos + 4 + 32;
+    if (file.matches(vbri, "VBRI", 4) && file.has(vbri, 18)) {
+        const quint32 frames = be32(file.data + vbri + 14);
+        if (frames > 0) {
+            return qint64(frames) * frame.samplesPerFrame * 1000 / frame.sampleRate;
+        }
+    }
+
+    // Constant bitrate: kbit/s is bits per millisecond
+    return (audioEnd - pos) * 8 / frame.bitrate;
+}
+
+qint64 adtsDuration(const Bytes &file, qint64 audioStart, qint64 audioEnd) {
+    static const int sampleRates[13] = {
+        96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+    };
+
+    qint64 pos = audioStart;
+    // Skip junk before the first sync word
+    while (pos + 7 <= audioEnd && pos < audioStart + 64 * 1024
+           && !(file.data[pos] == 0xFF && (file.data[pos + 1] & 0xF6) == 0xF0)) {
+        ++pos;
+    }
+    if (pos + 7 > audioEnd) {
+        return 0;
+    }
+    const int sampleRateIndex = (file.data[pos + 2] >> 2) & 0x0F;
+    if (sampleRateIndex >= 13) {
+        return 0;
+    }
+    const int sampleRate = sampleRates[sampleRateIndex];
+
+    // ADTS has no frame count; average a few frame lengths and extrapolate
+    const qint64 firstFrame = pos;
+    qint64 frames = 0;
+    while (frames < 64 && pos + 7 <= audioEnd) {
+        const uchar *h = file.data + pos;
+        if (h[0] != 0xFF || (h[1] & 0xF6) != 0xF0) {
+            break;
+        }
+        const int length = ((h[3] & 0x03) << 11) | (h[4] << 3) | (h[5] >> 5);
+        if (length < 7) {
+            break;
+        }
+        pos += length;
+        ++frames;
+    }
+    if (frames == 0) {
+        return 0;
+    }
+    const qint64 totalFrames = pos >= audioEnd ? frames : (audioEnd - firstFrame) * frames / (pos - firstFrame);
+    return totalFrames * 1024 * 1000 / sampleRate;
+}
+
+bool parseFlac(const Bytes &file, qint64 offset, Metadata &metadata);
+
+bool parseMpeg(const Bytes &file, Metadata &metadata) {
+    qint64 lengthMs = 0;
+    qint64 audioStart = 0;
+    while (qint64 tagSize = parseId3v2(file, audioStart, metadata, lengthMs)) {
+        audioStart += tagSize;
+    }
+    if (file.matches(audioStart, "fLaC", 4)) {
+        return parseFlac(file, audioStart, metadata);
+    }
+
+    qint64 audioEnd = file.size;
+    if (parseId3v1(file, metadata)) {
+        audioEnd -= 128;
+    }
+    if (audioStart >= audioEnd) {
+        return false;
+    }
+
+    // ADTS (AAC) shares the 12-bit sync word with MPEG audio but has layer 0
+    qint64 duration = mpegDuration(file, audioStart, audioEnd);
+    if (duration == 0) {
+        duration = adtsDuration(file, audioStart, audioEnd);
+    }
+    metadata.duration = duration > 0 ? duration : lengthMs;
+    return metadata.duration > 0;
+}
+
+// Vorbis comments (FLAC, Ogg Vorbis, Opus)
+
+void parseVorbisComments(const uchar *data, qint64 size, Metadata &metadata) {
+    const Bytes block = {data, size};
+    if (!block.has(0, 4)) {
+        return;
+    }
+    qint64 pos = 4 + le32(data);  // Vendor string
+    if (!block.has(pos, 4)) {
+        return;
+    }
+    const quint32 count = le32(data + pos);
+    pos += 4;
+
+    for (quint32 i = 0; i < count && block.has(pos, 4); ++i) {
+        const qint64 length = le32(data + pos);
+        pos += 4;
+        if (!block.has(pos, length)) {
+            break;
+        }
+        const QByteArray comment = QByteArray::fromRawData(reinterpret_cast<const char*>(data + pos), length);
+        pos += length;
+
+        const int equals = comment.indexOf('=');
+        if (equals <= 0) {
+            continue;
+        }
+        const QByteArray key = comment.left(equals).toUpper();
+        const QString value = QString::fromUtf8(comment.constData() + equals + 1, length - equals - 1);
+        if (key == "TITLE") {
+            setIfEmpty(metadata.title, value);
+        } else if (key == "ARTIST") {
+            setIfEmpty(metadata.artist, value);
+        } else if (key == "ALBUM") {
+            setIfEmpty(metadata.album, value);
+        } else if (key == "GENRE") {
+            setIfEmpty(metadata.genre, value);
+        } else if (key == "TRACKNUMBER") {
+            setTrackNumber(metadata, value);
+        } else if (key == "DATE" || key == "YEAR") {
+            setYear(metadata, value);
+        }
+    }
+}
+
+bool parseFlac(const Bytes &file, qint64 offset, Metadata &metadata) {
+    qint64 pos = offset + 4;
+    bool last = false;
+    while (!last && file.has(pos, 4)) {
+        const uchar *header = file.data + pos;
+        last = header[0] & 0x80;
+        const int type = header[0] & 0x7F;
+        const qint64 length = be24(header + 1);
+        pos += 4;
+        if (!file.has(pos, length)) {
+            break;
+        }
+        const uchar *block = file.data + pos;
+
+        if (type == 0 && length >= 18) {
+            // STREAMINFO: 20-bit sample rate, then 36-bit total sample count
+            const quint32 sampleRate = (quint32(block[10]) << 12) | (quint32(block[11]) << 4) | (block[12] >> 4);
+            const quint64 samples = (quint64(block[13] & 0x0F) << 32) | be32(block + 14);
+            if (sampleRate > 0) {
+                metadata.duration = qint64(samples * 1000 / sampleRate);
+            }
+        } else if (type == 4) {
+            parseVorbisComments(block, length, metadata);
+        }
+        pos += length;
+    }
+    return metadata.duration > 0;
+}
+
+// Ogg Vorbis and Opus
+
+bool parseOgg(const Bytes &file, Metadata &metadata) {
+    // Reassemble the first two packets (identification and comment header)
+    // of the first logical stream, capping how much of the comment we copy
+    // so embedded cover art isn't pulled in.
+    const qint64 maxPacketSize = 256 * 1024;
+    QList<QByteArray> packets;
+    QByteArray packet;
+    quint32 serial = 0;
+    qint64 pos = 0;
+
+    while (packets.size() < 2 && file.matches(pos, "OggS", 4) && file.has(pos, 27)) {
+        const uchar *page = file.data + pos;
+        const quint32 pageSerial = le32(page + 14);
+        const int segments = page[26];
+        if (!file.has(pos + 27, segments)) {
+            return false;
+        }
+        if (pos == 0) {
+            serial = pageSerial;
+        }
+
+        qint64 body = pos + 27 + segments;
+        for (int i = 0; i < segments; ++i) {
+            const int lacing = page[27 + i];
+            if (!file.has(body, lacing)) {
+                return false;
+            }
+            if (pageSerial == serial && packets.size() < 2) {
+                if (packet.size() + lacing <= maxPacketSize) {
+                    packet.append(reinterpret_cast<const char*>(file.data + body), lacing);
+                }
+                // A lacing value below 255 ends the packet
+                if (lacing < 255) {
+                    packets.append(packet);
+                    packet.clear();
+                }
+            }
+            body += lacing;
+        }
+        pos = body;
+    }
+    if (packets.size() < 2) {
+        return false;
+    }
+
+    const QByteArray &identification = packets[0];
+    const QByteArray &comment = packets[1];
+    const auto *id = reinterpret_cast<const uchar*>(identification.constData());
+    const auto *tags = reinterpret_cast<const uchar*>(comment.constData());
+
+    quint32 sampleRate = 0;
+    qint64 preSkip = 0;
+    if (identification.startsWith("\x01vorbis") && identification.size() >= 16) {
+        sampleRate = le32(id + 12);
+        if (comment.startsWith("\x03vorbis")) {
+            parseVorbisComments(tags + 7, comment.size() - 7, metadata);
+        }
+    } else if (identification.startsWith("OpusHead") && identification.size() >= 12) {
+        // Opus granule positions always count 48 kHz samples
+        sampleRate = 48000;
+        preSkip = le16(id + 10);
+        if (comment.startsWith("OpusTags")) {
+            parseVorbisComments(tags + 8, comment.size() - 8, metadata);
+        }
+    } else {
+        return false;
+    }
+    if (sampleRate == 0) {
+        return false;
+    }
+
+    // Duration is the granule position of the stream's last page
+    const qint64 searchStart = qMax<qint64>(0, file.size - 64 * 1024);
+    for (qint64 last = file.size - 27; last >= searchStart; --last) {
+        if (file.data[last] == 'O' && file.matches(last, "OggS", 4) && le32(file.data + last + 14) == serial) {
+            const qint64 granule = qint64(le64(file.data + last + 6));
+            if (granule > preSkip) {
+                metadata.duration = (granule - preSkip) * 1000 / sampleRate;
+            }
+            break;
+        }
+    }
+    return metadata.duration > 0;
+}
+
+// MP4 / M4A
+
+struct Atom {
+    qint64 offset;      // Start of the payload
+    qint64 size;        // Payload size
+    QByteArray type;
+};
+
+// Iterates the atoms in [begin, end); returns false when no atom fits
+bool readAtom(const Bytes &file, qint64 pos, qint64 end, Atom &atom) {
+    if (pos + 8 > end || !file.has(pos, 8)) {
+        return false;
+    }
+    qint64 size = be32(file.data + pos);
+    atom.type = QByteArray(reinterpret_cast<const char*>(file.data + pos + 4), 4);
+    qint64 headerSize = 8;
+    if (size == 1) {
+        if (!file.has(pos, 16)) {
+            return false;
+        }
+        size = qint64(be64(file.data + pos + 8));
+        headerSize = 16;
+    } else if (size == 0) {
+        size = end - pos;
+    }
+    if (size < headerSize || size > end - pos) {
+        return false;
+    }
+    atom.offset = pos + headerSize;
+    atom.size = size - headerSize;
+    return true;
+}
+
+bool findAtom(const Bytes &file, qint64 begin, qint64 end, const char *type, Atom &atom) {
+    qint64 pos = begin;
+    while (readAtom(file, pos, end, atom)) {
+        if (atom.type == type) {
+            return true;
+        }
+        pos = atom.offset + atom.size;
+    }
+    return false;
+}
+
+void parseIlst(const Bytes &file, const Atom &ilst, Metadata &metadata) {
+    const qint64 end = ilst.offset + ilst.size;
+    Atom item;
+    qint64 pos = ilst.offset;
+    while (readAtom(file, pos, end, item)) {
+        pos = item.offset + item.size;
+
+        Atom data;
+        if (!findAtom(file, item.offset, item.offset + item.size, "data", data) || data.size < 8) {
+            continue;
+        }
+        // data atom payload: type indicator (4), locale (4), value
+        const uchar *value = file.data + data.offset + 8;
+        const qint64 valueSize = data.size - 8;
+        const QString text = QString::fromUtf8(reinterpret_cast<const char*>(value), valueSize);
+
+        if (item.type == "\xa9nam") {
+            setIfEmpty(metadata.title, text);
+        } else if (item.type == "\xa9" "ART") {
+            setIfEmpty(metadata.artist, text);
+        } else if (item.type == "\xa9" "alb") {
+            setIfEmpty(metadata.album, text);
+        } else if (item.type == "\xa9gen") {
+            setIfEmpty(metadata.genre, text);
+        } else if (item.type == "\xa9" "day") {
+            setYear(metadata, text);
+        } else if (item.type == "gnre" && valueSize >= 2) {
+            // ID3v1 genre index plus one
+            if (metadata.genre.isEmpty()) {
+                metadata.genre = genreName(int(be16(value)) - 1);
+            }
+        } else if (item.type == "trkn" && valueSize >= 4 && metadata.trackNumber == 0) {
+            metadata.trackNumber = be16(value + 2);
+        }
+    }
+}
+
+bool parseMp4(const Bytes &file, Metadata &metadata) {
+    Atom moov;
+    if (!findAtom(file, 0, file.size, "moov", moov)) {
+        return false;
+    }
+    const qint64 moovEnd = moov.offset + moov.size;
+
+    Atom mvhd;
+    if (findAtom(file, moov.offset, moovEnd, "mvhd", mvhd) && file.has(mvhd.offset, 32)) {
+        const uchar *header = file.data + mvhd.offset;
+        quint32 timescale;
+        quint64 duration;
+        if (header[0] == 1) {
+            timescale = be32(header + 20);
+            duration = be64(header + 24);
+        } else {
+            timescale = be32(header + 12);
+            duration = be32(header + 16);
+        }
+        if (timescale > 0) {
+            metadata.duration = qint64(duration * 1000 / timescale);
+        }
+    }
+
+    // moov/udta/meta/ilst; meta carries version and flags before its children
+    Atom udta, meta, ilst;
+    if (findAtom(file, moov.offset, moovEnd, "udta", udta)
+            && findAtom(file, udta.offset, udta.offset + udta.size, "meta", meta)
+            && meta.size > 4
+            && findAtom(file, meta.offset + 4, meta.offset + meta.size, "ilst", ilst)) {
+        parseIlst(file, ilst, metadata);
+    }
+    return metadata.duration > 0;
+}
+
+// RIFF WAVE
+
+bool parseWav(const Bytes &file, Metadata &metadata) {
+    quint32 byteRate = 0;
+    qint64 dataSize = 0;
+    qint64 lengthMs = 0;
+
+    qint64 pos = 12;
+    while (file.has(pos, 8)) {
+        const uchar *chunk = file.data + pos;
+        const qint64 length = le32(chunk + 4);
+        const qint64 body = pos + 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && file.has(body, 12)) {
+            byteRate = le32(file.data + body + 8);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            // Streamed files may leave the size unset; clamp to what is on disk
+            dataSize = qMin(length, file.size - body);
+        } else if (memcmp(chunk, "LIST", 4) == 0 && file.matches(body, "INFO", 4) && file.has(body, length)) {
+            qint64 sub = body + 4;
+            while (sub + 8 <= body + length) {
+                const uchar *field = file.data + sub;
+                const qint64 fieldLength = le32(field + 4);
+                if (!file.has(sub + 8, fieldLength)) {
+                    break;
+                }
+                const QString value = decodeUtf8OrLatin1(field + 8, fieldLength);
+                if (memcmp(field, "INAM", 4) == 0) {
+                    setIfEmpty(metadata.title, value);
+                } else if (memcmp(field, "IART", 4) == 0) {
+                    setIfEmpty(metadata.artist, value);
+                } else if (memcmp(field, "IPRD", 4) == 0) {
+                    setIfEmpty(metadata.album, value);
+                } else if (memcmp(field, "IGNR", 4) == 0) {
+                    setIfEmpty(metadata.genre, value);
+                } else if (memcmp(field, "ICRD", 4) == 0) {
+                    setYear(metadata, value);
+                } else if (memcmp(field, "ITRK", 4) == 0 || memcmp(field, "IPRT", 4) == 0) {
+                    setTrackNumber(metadata, value);
+                }
+                sub += 8 + fieldLength + (fieldLength & 1);
+            }
+        } else if (memcmp(chunk, "id3 ", 4) == 0 || memcmp(chunk, "ID3 ", 4) == 0) {
+            parseId3v2(file, body, metadata, lengthMs);
+        }
+
+        if (memcmp(chunk, "data", 4) == 0 && length >= file.size - body) {
+            break;
+        }
+        pos = body + length + (length & 1);
+    }
+
+    if (byteRate > 0 && dataSize > 0) {
+        metadata.duration = dataSize * 1000 / byteRate;
+    } else {
+        metadata.duration = lengthMs;
+    }
+    return metadata.duration > 0;
+}
+
+// ASF (WMA)
+
+const uchar asfHeaderGuid[16] = {
+    0x30, 0x26, 0xB2, 0x75, 0x8E, 0x66, 0xCF, 0x11, 0xA6, 0xD9, 0x00, 0xAA, 0x00, 0x62, 0xCE, 0x6C
+};
+const uchar asfFilePropertiesGuid[16] = {
+    0xA1, 0xDC, 0xAB, 0x8C, 0x47, 0xA9, 0xCF, 0x11, 0x8E, 0xE4, 0x00, 0xC0, 0x0C, 0x20, 0x53, 0x65
+};
+const uchar asfContentDescriptionGuid[16] = {
+    0x33, 0x26, 0xB2, 0x75, 0x8E, 0x66, 0xCF, 0x11, 0xA6, 0xD9, 0x00, 0xAA, 0x00, 0x62, 0xCE, 0x6C
+};
+const uchar asfExtendedContentGuid[16] = {
+    0x40, 0xA4, 0xD0, 0xD2, 0x07, 0xE3, 0xD2, 0x11, 0x97, 0xF0, 0x00, 0xA0, 0xC9, 0x5E, 0xA8, 0x50
+};
+
+void parseAsfExtendedContent(const Bytes &object, Metadata &metadata) {
+    if (!object.has(0, 2)) {
+        return;
+    }
+    const int count = le16(object.data);
+    qint64 pos = 2;
+    for (int i = 0; i < count && object.has(pos, 2); ++i) {
+        const qint64 nameLength = le16(object.data + pos);
+        if (!object.has(pos + 2, nameLength + 4)) {
+            break;
+        }
+        const QString name = decodeUtf16(object.data + pos + 2, nameLength, false);
+        pos += 2 + nameLength;
+        const int valueType = le16(object.data + pos);
+        const qint64 valueLength = le16(object.data + pos + 2);
+        pos += 4;
+        if (!object.has(pos, valueLength)) {
+            break;
+        }
+        const uchar *value = object.data + pos;
+        pos += valueLength;
+
+        // Type 0 is a UTF-16LE string, 3 a DWORD
+        QString text;
+        if (valueType == 0) {
+            text = decodeUtf16(value, valueLength, false);
+        } else if (valueType == 3 && valueLength >= 4) {
+            text = QString::number(le32(value));
+        }
+
+        if (name == "WM/AlbumTitle") {
+            setIfEmpty(metadata.album, text);
+        } else if (name == "WM/Genre") {
+            setIfEmpty(metadata.genre, text);
+        } else if (name == "WM/TrackNumber") {
+            setTrackNumber(metadata, text);
+        } else if (name == "WM/Track" && metadata.trackNumber == 0) {
+            metadata.trackNumber = text.toInt() + 1;  // Zero-based
+        } else if (name == "WM/Year") {
+            setYear(metadata, text);
+        }
+    }
+}
+
+bool parseAsf(const Bytes &file, Metadata &metadata) {
+    if (!file.has(0, 30)) {
+        return false;
+    }
+    const qint64 headerEnd = qMin<qint64>(file.size, qint64(le64(file.data + 16)));
+
+    qint64 pos = 30;
+    while (pos + 24 <= headerEnd) {
+        const uchar *object = file.data + pos;
+        const qint64 objectSize = qint64(le64(object + 16));
+        if (objectSize < 24 || objectSize > headerEnd - pos) {
+            break;
+        }
+        const Bytes body = {object + 24, objectSize - 24};
+
+        if (memcmp(object, asfFilePropertiesGuid, 16) == 0 && body.has(0, 64)) {
+            // Play duration is in 100 ns units and includes the preroll (ms)
+            const quint64 playDuration = le64(body.data + 40);
+            const quint64 preroll = le64(body.data + 56);
+            const qint64 duration = qint64(playDuration / 10000) - qint64(preroll);
+            metadata.duration = qMax<qint64>(0, duration);
+        } else if (memcmp(object, asfContentDescriptionGuid, 16) == 0 && body.has(0, 10)) {
+            const qint64 titleLength = le16(body.data);
+            const qint64 authorLength = le16(body.data + 2);
+            if (body.has(10, titleLength + authorLength)) {
+                setIfEmpty(metadata.title, decodeUtf16(body.data + 10, titleLength, false));
+                setIfEmpty(metadata.artist, decodeUtf16(body.data + 10 + titleLength, authorLength, false));
+            }
+        } else if (memcmp(object, asfExtendedContentGuid, 16) == 0) {
+            parseAsfExtendedContent(body, metadata);
+        }
+        pos += objectSize;
+    }
+    return metadata.duration > 0;
+}
+
+} // namespace
+
+bool TagParser::parse(const QString &filePath, Metadata &metadata) {
+    TRACE_SCOPE("TagParser::parse");
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < 16) {
+        return false;
+    }
+    const uchar *data = file.map(0, file.size());
+    if (!data) {
+        return false;
+    }
+    const Bytes bytes = {data, file.size()};
+
+    bool parsed;
+    if (bytes.matches(0, "fLaC", 4)) {
+        parsed = parseFlac(bytes, 0, metadata);
+    } else if (bytes.matches(0, "OggS", 4)) {
+        parsed = parseOgg(bytes, metadata);
+    } else if (bytes.matches(0, "RIFF", 4) && bytes.matches(8, "WAVE", 4)) {
+        parsed = parseWav(bytes, metadata);
+    } else if (bytes.matches(4, "ftyp", 4)) {
+        parsed = parseMp4(bytes, metadata);
+    } else if (memcmp(data, asfHeaderGuid, 16) == 0) {
+        parsed = parseAsf(bytes, metadata);
+    } else {
+        // MP3 and ADTS AAC, with or without a leading ID3v2 tag
+        parsed = parseMpeg(bytes, metadata);
+    }
+
+    file.unmap(const_cast<uchar*>(data));
+    return parsed;
+}
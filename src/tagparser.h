@@ -0,0 +1,21 @@
+#ifndef TAGPARSER_H
+#define TAGPARSER_H
+
+#include <QString>
+#include "metadata.h"
+
+// Reads tags and duration straight from the file's own headers (ID3v2/ID3v1
+// and MPEG/ADTS frames, FLAC STREAMINFO and Vorbis comments, Ogg Vorbis/Opus,
+// MP4 atoms, RIFF INFO and ASF objects). The file is memory-mapped and only
+// the pages holding headers are touched, so it is cheap and thread-safe.
+class TagParser {
+public:
+    // Returns false when the format isn't recognised or no duration could be
+    // determined; the caller should then fall back to the multimedia backend.
+    static bool parse(const QString &filePath, Metadata &metadata);
+
+private:
+    TagParser() {}
+};
+
+#endif // TAGPARSER_H
@@ -0,0 +1,59 @@
+#include "textsearchindex.h"
+
+void TextSearchIndex::update(const StringPool &pool) {
+    const int first = folded.size();
+    folded.reserve(pool.size());
+
+    for (int id = first; id < pool.size(); ++id) {
+        const QString text = pool.string(id).toCaseFolded();
+        const QChar *data = text.constData();
+        for (int i = 0; i + 3 <= text.size(); ++i) {
+            // Query words never contain whitespace
+            if (data[i].isSpace() || data[i + 1].isSpace() || data[i + 2].isSpace()) {
+                continue;
+            }
+            QList<quint32> &postings = trigrams[trigramKey(data + i)];
+            // A string repeating a trigram only lists itself once
+            if (postings.isEmpty() || postings.last() != quint32(id)) {
+                postings.append(id);
+            }
+        }
+        folded.append(text);
+    }
+}
+
+void TextSearchIndex::clear() {
+    folded.clear();
+    trigrams.clear();
+}
+
+void TextSearchIndex::match(const QString &word, QBitArray &matches) const {
+    if (word.size() < 3) {
+        // Too short for a trigram; a plain scan of the folded strings
+        for (int id = 0; id < folded.size(); ++id) {
+            if (folded[id].contains(word)) {
+                matches.setBit(id);
+            }
+        }
+        return;
+    }
+
+    // Candidates come from the word's rarest trigram and are then checked
+    // in full, since sharing every trigram doesn't make a substring
+    const QList<quint32> *rarest = nullptr;
+    for (int i = 0; i + 3 <= word.size(); ++i) {
+        auto it = trigrams.constFind(trigramKey(word.constData() + i));
+        if (it == trigrams.constEnd()) {
+            return;
+        }
+        if (!rarest || it->size() < rarest->size()) {
+            rarest = &it.value();
+        }
+    }
+
+    for (quint32 id : *rarest) {
+        if (folded[id].contains(word)) {
+            matches.setBit(id);
+        }
+    }
+}
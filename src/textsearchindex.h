@@ -0,0 +1,33 @@
+#ifndef TEXTSEARCHINDEX_H
+#define TEXTSEARCHINDEX_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include "trackstore.h"
+
+// Substring index over the strings of a StringPool. Every string is kept
+// case-folded and each of its trigrams maps to the ids of the strings that
+// contain it. The pool only ever grows, so update() indexes just the strings
+// added since the last call; clear() must be called when the pool is reset.
+class TextSearchIndex {
+public:
+    void update(const StringPool &pool);
+    void clear();
+    int size() const { return folded.size(); }
+
+    // Sets the bit of every indexed string containing word, which must
+    // already be case-folded
+    void match(const QString &word, QBitArray &matches) const;
+
+private:
+    static quint64 trigramKey(const QChar *text) {
+        return (quint64(text[0].unicode()) << 32) | (quint64(text[1].unicode()) << 16) | text[2].unicode();
+    }
+
+    QList<QString> folded;
+    QHash<quint64, QList<quint32>> trigrams;  // Posting lists in ascending id order
+};
+
+#endif // TEXTSEARCHINDEX_H
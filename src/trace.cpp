@@ -0,0 +1,215 @@
+#include "trace.h"
+
+#ifdef SIMPLEPLAYER_TRACING
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <QThread>
+#include <chrono>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+std::atomic<bool> Trace::enabled(false);
+
+namespace {
+
+struct Event {
+    const char *name;
+    qint64 timestamp;  // ns since start()
+    qint64 value;      // Duration in ns for spans, the value for counters
+    bool isCounter;
+};
+
+// A thread's buffer grows a chunk at a time up to MaxChunks, after which
+// its events are dropped and counted
+const int ChunkEvents = 4096;
+const int MaxChunks = 256;
+
+// Written only by its own thread. Chunks are published before the count
+// that covers them, so dump() sees complete events up to the count it reads.
+struct ThreadBuffer {
+    int tid;
+    QString threadName;
+    std::atomic<Event*> chunks[MaxChunks];
+    std::atomic<int> count;
+    std::atomic<int> dropped;
+
+    ThreadBuffer() : tid(0), count(0), dropped(0) {
+        for (std::atomic<Event*> &chunk : chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Buffers are registered once per thread and never freed, so a thread that
+// has exited still shows up in the trace
+QMutex registryMutex;
+QList<ThreadBuffer*> registry;
+thread_local ThreadBuffer *localBuffer = nullptr;
+
+qint64 origin = 0;
+QString outputPath;
+int signalPipe[2] = {-1, -1};
+
+qint64 steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ThreadBuffer *threadBuffer() {
+    if (!localBuffer) {
+        ThreadBuffer *buffer = new ThreadBuffer;
+        QThread *thread = QThread::currentThread();
+        buffer->threadName = thread->objectName();
+
+        QMutexLocker locker(&registryMutex);
+        buffer->tid = registry.size() + 1;
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+            buffer->threadName = "GUI";
+        } else if (buffer->threadName.isEmpty()) {
+            buffer->threadName = QString("Thread %1").arg(buffer->tid);
+        }
+        registry.append(buffer);
+        localBuffer = buffer;
+    }
+    return localBuffer;
+}
+
+void record(const Event &event) {
+    ThreadBuffer *buffer = threadBuffer();
+    const int index = buffer->count.load(std::memory_order_relaxed);
+    const int chunk = index / ChunkEvents;
+    if (chunk >= MaxChunks) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event *events = buffer->chunks[chunk].load(std::memory_order_relaxed);
+    if (!events) {
+        events = new Event[ChunkEvents];
+        buffer->chunks[chunk].store(events, std::memory_order_release);
+    }
+    events[index % ChunkEvents] = event;
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void appendEscaped(QByteArray &out, const char *text) {
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out.append('\\');
+        }
+        out.append(*c);
+    }
+}
+
+void onSignal(int) {
+    const char byte = 1;
+    // Nothing else is safe in a signal handler; the notifier does the dump
+    ssize_t written = write(signalPipe[1], &byte, 1);
+    Q_UNUSED(written);
+}
+
+} // namespace
+
+void Trace::start() {
+    outputPath = qEnvironmentVariable("SIMPLEPLAYER_TRACE");
+    if (outputPath.isEmpty()) {
+        return;
+    }
+
+    origin = steadyNanoseconds();
+    enabled.store(true, std::memory_order_relaxed);
+
+    QCoreApplication *app = QCoreApplication::instance();
+    QObject::connect(app, &QCoreApplication::aboutToQuit, app, []() {
+        dump(outputPath);
+    });
+
+    if (pipe2(signalPipe, O_CLOEXEC | O_NONBLOCK) == 0) {
+        QSocketNotifier *notifier = new QSocketNotifier(signalPipe[0], QSocketNotifier::Read, app);
+        QObject::connect(notifier, &QSocketNotifier::activated, app, []() {
+            char bytes[16];
+            while (read(signalPipe[0], bytes, sizeof(bytes)) > 0) {
+            }
+            dump(outputPath);
+        });
+        signal(SIGUSR1, onSignal);
+    }
+
+    qInfo() << "Tracing to" << outputPath << "(written at exit and on SIGUSR1)";
+}
+
+qint64 Trace::now() {
+    return steadyNanoseconds() - origin;
+}
+
+void Trace::complete(const char *name, qint64 begin, qint64 end) {
+    record({name, begin, end - begin, false});
+}
+
+void Trace::counter(const char *name, qint64 value) {
+    record({name, now(), value, true});
+}
+
+bool Trace::dump(const QString &path) {
+    QList<ThreadBuffer*> buffers;
+    {
+        QMutexLocker locker(&registryMutex);
+        buffers = registry;
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QByteArray out;
+    out.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    auto beginEvent = [&out, &first]() {
+        out.append(first ? "" : ",\n");
+        first = false;
+    };
+
+    for (ThreadBuffer *buffer : std::as_const(buffers)) {
+        beginEvent();
+        out.append(QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%1,\"tid\":%2,\"args\":{\"name\":\"%3\"}}")
+                       .arg(pid).arg(buffer->tid).arg(buffer->threadName).toUtf8());
+
+        const int count = buffer->count.load(std::memory_order_acquire);
+        for (int i = 0; i < count; ++i) {
+            const Event *events = buffer->chunks[i / ChunkEvents].load(std::memory_order_acquire);
+            const Event &event = events[i % ChunkEvents];
+
+            beginEvent();
+            out.append("{\"name\":\"");
+            appendEscaped(out, event.name);
+            out.append(event.isCounter ? "\",\"ph\":\"C\"" : "\",\"ph\":\"X\"");
+            out.append(",\"pid\":").append(QByteArray::number(pid));
+            out.append(",\"tid\":").append(QByteArray::number(buffer->tid));
+            out.append(",\"ts\":").append(QByteArray::number(event.timestamp / 1000.0, 'f', 3));
+            if (event.isCounter) {
+                out.append(",\"args\":{\"value\":").append(QByteArray::number(event.value)).append("}}");
+            } else {
+                out.append(",\"dur\":").append(QByteArray::number(event.value / 1000.0, 'f', 3)).append('}');
+            }
+        }
+
+        const int dropped = buffer->dropped.load(std::memory_order_relaxed);
+        if (dropped > 0) {
+            qWarning() << "Trace buffer of" << buffer->threadName << "was full;" << dropped << "events dropped";
+        }
+    }
+    out.append("\n]}\n");
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(out) != out.size() || !file.commit()) {
+        qWarning() << "Failed to write trace" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+#endif // SIMPLEPLAYER_TRACING
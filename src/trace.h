@@ -0,0 +1,75 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Hot-path tracing: scoped spans and counters written out as a Chrome
+// trace-event JSON file (chrome://tracing, ui.perfetto.dev).
+//
+// Only built with -DSIMPLEPLAYER_TRACING=ON; otherwise every macro expands
+// to nothing. When built in, recording starts if SIMPLEPLAYER_TRACE names an
+// output file, and a span costs one relaxed atomic load until then. Each
+// thread appends to its own buffer without locking. The trace is written at
+// exit and whenever the process receives SIGUSR1.
+
+#ifdef SIMPLEPLAYER_TRACING
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+class Trace {
+public:
+    // Call once the application object exists
+    static void start();
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Nanoseconds since start()
+    static qint64 now();
+    // Names must outlive the trace (string literals); only the pointer is kept
+    static void complete(const char *name, qint64 begin, qint64 end);
+    static void counter(const char *name, qint64 value);
+
+    // Writes everything recorded so far; safe while other threads record
+    static bool dump(const QString &path);
+
+private:
+    Trace() {}
+    static std::atomic<bool> enabled;
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name) : name(name), begin(Trace::isEnabled() ? Trace::now() : -1) {}
+    ~TraceScope() {
+        if (begin >= 0) {
+            Trace::complete(name, begin, Trace::now());
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+    const char *name;
+    qint64 begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_START() Trace::start()
+// Times the rest of the enclosing block
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_COUNTER(name, value) \
+    do { \
+        if (Trace::isEnabled()) { \
+            Trace::counter(name, value); \
+        } \
+    } while (0)
+
+#else
+
+#define TRACE_START() do {} while (0)
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_COUNTER(name, value) do {} while (0)
+
+#endif // SIMPLEPLAYER_TRACING
+
+#endif // TRACE_H
@@ -0,0 +1,90 @@
+#include "trackprefetcher.h"
+#include "ioscheduler.h"
+#include "trace.h"
+#include <QDebug>
+#include <QFile>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Enough for several minutes of lossless audio; a longer file is read
+// normally once playback gets past it
+static const qint64 MaxPrefetchBytes = 64 * 1024 * 1024;
+
+static void adviseFile(const QByteArray &path, int advice) {
+    const int fd = open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        posix_fadvise(fd, 0, qMin<qint64>(st.st_size, MaxPrefetchBytes), advice);
+    }
+    close(fd);
+}
+
+TrackPrefetcher::TrackPrefetcher(QObject *parent)
+    : QObject(parent), hitCount(0), missCount(0) {
+}
+
+TrackPrefetcher::~TrackPrefetcher() {
+    IoScheduler::shared().cancel(this);
+    IoScheduler::shared().waitForDone(this);
+
+    if (hitCount + missCount > 0) {
+        qInfo() << "Track prefetch:" << hitCount << "hits," << missCount << "misses";
+    }
+}
+
+void TrackPrefetcher::prefetch(const QStringList &filePaths) {
+    // Tracks no longer predicted give their pages back
+    for (auto it = predicted.begin(); it != predicted.end();) {
+        if (filePaths.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        const QByteArray path = QFile::encodeName(it.key());
+        IoScheduler::shared().submitPath(this, path, [path]() {
+            adviseFile(path, POSIX_FADV_DONTNEED);
+        });
+        it = predicted.erase(it);
+    }
+
+    for (const QString &filePath : filePaths) {
+        if (predicted.contains(filePath)) {
+            continue;
+        }
+        predicted.insert(filePath, false);
+
+        // WILLNEED starts the reads and may block on a slow device, so it
+        // runs on the disk's queue, ahead of any scan or import on it. The
+        // device lookup is a stat as well and happens off this thread.
+        const QByteArray path = QFile::encodeName(filePath);
+        IoScheduler::shared().submitPath(this, path, [this, path, filePath]() {
+            TRACE_SCOPE("TrackPrefetcher::prefetch");
+            adviseFile(path, POSIX_FADV_WILLNEED);
+            QMetaObject::invokeMethod(this, [this, filePath]() {
+                prefetchFinished(filePath);
+            }, Qt::QueuedConnection);
+        }, IoScheduler::Urgent);
+    }
+}
+
+void TrackPrefetcher::prefetchFinished(const QString &filePath) {
+    auto it = predicted.find(filePath);
+    if (it != predicted.end()) {
+        *it = true;
+    }
+}
+
+void TrackPrefetcher::trackStarted(const QString &filePath) {
+    // A track that was predicted but not yet prefetched is a miss as well;
+    // it stays out of the set so it isn't released while playing
+    if (predicted.take(filePath)) {
+        ++hitCount;
+    } else {
+        ++missCount;
+    }
+    TRACE_COUNTER("prefetch hits", hitCount);
+    TRACE_COUNTER("prefetch misses", missCount);
+}
@@ -0,0 +1,39 @@
+#ifndef TRACKPREFETCHER_H
+#define TRACKPREFETCHER_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+// Warms the page cache for the tracks predicted to play next, so a track
+// change on a cold disk or network mount doesn't wait for the file to be
+// read. The advice runs through the I/O scheduler in the background, as
+// urgent work that a disk takes before bulk scans and imports. At
+// most MaxPrefetchBytes of each file are requested, and files that drop out
+// of the prediction are released again, so only a couple of tracks are held
+// at any time.
+class TrackPrefetcher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit TrackPrefetcher(QObject *parent = nullptr);
+    ~TrackPrefetcher();
+
+    // Replaces the predicted tracks, in play order
+    void prefetch(const QStringList &filePaths);
+    // Counts a hit if the track's prefetch had finished by the time it started
+    void trackStarted(const QString &filePath);
+
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+
+private:
+    void prefetchFinished(const QString &filePath);
+
+    // Predicted path -> whether its prefetch has finished
+    QHash<QString, bool> predicted;
+    int hitCount;
+    int missCount;
+};
+
+#endif // TRACKPREFETCHER_H
@@ -0,0 +1,135 @@
+#include "trackstore.h"
+#include <limits>
+
+void StringPool::updateIds() {
+    if (idsStale) {
+        ids.clear();
+        ids.reserve(strings.size());
+        for (int i = 0; i < strings.size(); ++i) {
+            ids.insert(strings[i], quint32(i));
+        }
+        idsStale = false;
+    }
+}
+
+quint32 StringPool::intern(const QString &text) {
+    updateIds();
+    auto it = ids.constFind(text);
+    if (it != ids.constEnd()) {
+        return it.value();
+    }
+
+    // The hash key shares the stored string's data
+    const quint32 id = strings.size();
+    strings.append(text);
+    ids.insert(strings.last(), id);
+    return id;
+}
+
+qint64 StringPool::find(const QString &text) {
+    updateIds();
+    auto it = ids.constFind(text);
+    return it != ids.constEnd() ? qint64(it.value()) : -1;
+}
+
+void StringPool::clear() {
+    strings.clear();
+    ids.clear();
+    idsStale = false;
+}
+
+void StringPool::assign(QList<QString> table) {
+    strings = std::move(table);
+    ids.clear();
+    idsStale = true;
+}
+
+TrackRecord TrackStore::makeRecord(const Metadata &metadata) {
+    const int separator = metadata.filePath.lastIndexOf('/');
+
+    TrackRecord record;
+    record.directory = pathPool.intern(metadata.filePath.left(separator + 1));
+    record.fileName = pathPool.intern(metadata.filePath.mid(separator + 1));
+    record.title = textPool.intern(metadata.title);
+    record.artist = textPool.intern(metadata.artist);
+    record.album = textPool.intern(metadata.album);
+    record.genre = textPool.intern(metadata.genre);
+    record.duration = quint32(qBound<qint64>(0, metadata.duration, std::numeric_limits<quint32>::max()));
+    record.trackNumber = quint16(qBound(0, metadata.trackNumber, 0xFFFF));
+    record.year = quint16(qBound(0, metadata.year, 0xFFFF));
+    return record;
+}
+
+void TrackStore::append(const Metadata &metadata) {
+    records.append(makeRecord(metadata));
+}
+
+void TrackStore::insert(int row, const Metadata &metadata) {
+    append(metadata);
+    if (row < records.size() - 1) {
+        const TrackRecord record = records.takeLast();
+        records.insert(row, record);
+    }
+}
+
+void TrackStore::replace(int row, const Metadata &metadata) {
+    // The old strings stay pooled; other rows may share them
+    records[row] = makeRecord(metadata);
+}
+
+void TrackStore::remove(int row) {
+    records.removeAt(row);
+}
+
+void TrackStore::reorder(const QList<int> &order) {
+    QList<TrackRecord> reordered;
+    reordered.reserve(records.size());
+    for (int row : order) {
+        reordered.append(records[row]);
+    }
+    records = std::move(reordered);
+}
+
+void TrackStore::clear() {
+    records.clear();
+    textPool.clear();
+    pathPool.clear();
+}
+
+void TrackStore::assign(QList<QString> texts, QList<QString> paths, QList<TrackRecord> trackRecords) {
+    textPool.assign(std::move(texts));
+    pathPool.assign(std::move(paths));
+    records = std::move(trackRecords);
+}
+
+Metadata TrackStore::track(int row) const {
+    const TrackRecord &record = records[row];
+
+    Metadata metadata;
+    metadata.filePath = filePath(row);
+    metadata.title = textPool.string(record.title);
+    metadata.artist = textPool.string(record.artist);
+    metadata.album = textPool.string(record.album);
+    metadata.genre = textPool.string(record.genre);
+    metadata.duration = record.duration;
+    metadata.trackNumber = record.trackNumber;
+    metadata.year = record.year;
+    return metadata;
+}
+
+QString TrackStore::filePath(int row) const {
+    const TrackRecord &record = records[row];
+    return pathPool.string(record.directory) + pathPool.string(record.fileName);
+}
+
+bool TrackStore::findPath(const QString &filePath, quint32 &directory, quint32 &fileName) {
+    const int separator = filePath.lastIndexOf('/');
+    const qint64 directoryId = pathPool.find(filePath.left(separator + 1));
+    const qint64 fileNameId = directoryId < 0 ? -1 : pathPool.find(filePath.mid(separator + 1));
+    if (fileNameId < 0) {
+        return false;
+    }
+    directory = quint32(directoryId);
+    fileName = quint32(fileNameId);
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef TRACKSTORE_H
+#define TRACKSTORE_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include "metadata.h"
+
+// Deduplicating string table. Ids are dense and stay valid until clear();
+// strings are never released individually.
+class StringPool {
+public:
+    quint32 intern(const QString &text);
+    // Id of text if it is pooled, without adding it; -1 otherwise
+    qint64 find(const QString &text);
+    const QString &string(quint32 id) const { return strings[id]; }
+    const QList<QString> &all() const { return strings; }
+    int size() const { return strings.size(); }
+    void clear();
+    // Adopts a saved table; the lookup hash is only built on the next intern()
+    void assign(QList<QString> table);
+
+private:
+    void updateIds();
+
+    QList<QString> strings;
+    QHash<QString, quint32> ids;
+    bool idsStale = false;
+};
+
+// Fixed-size per-track record; all text lives in the store's string pools
+struct TrackRecord {
+    quint32 directory;  // Path pool, including the trailing separator
+    quint32 fileName;   // Path pool
+    quint32 title;      // Text pool
+    quint32 artist;     // Text pool
+    quint32 album;      // Text pool
+    quint32 genre;      // Text pool
+    quint32 duration;   // in milliseconds
+    quint16 trackNumber;
+    quint16 year;
+};
+
+static_assert(sizeof(TrackRecord) == 32, "TrackRecord should stay compact");
+
+// Compact playlist storage: one contiguous array of TrackRecords with
+// artist/album/genre (and directory) strings interned, so a large playlist
+// costs a few dozen bytes per row plus its distinct strings. The bench's
+// memory() compares its resident size with a QList<Metadata>.
+class TrackStore {
+public:
+    int size() const { return records.size(); }
+    void reserve(int count) { records.reserve(count); }
+    void append(const Metadata &metadata);
+    void insert(int row, const Metadata &metadata);
+    void replace(int row, const Metadata &metadata);
+    void remove(int row);
+    void clear();
+    // Row i becomes the record previously at row order[i]
+    void reorder(const QList<int> &order);
+
+    // Snapshot access: the pools and records exactly as stored
+    const StringPool &texts() const { return textPool; }
+    const StringPool &paths() const { return pathPool; }
+    const QList<TrackRecord> &allRecords() const { return records; }
+    void assign(QList<QString> texts, QList<QString> paths, QList<TrackRecord> trackRecords);
+
+    const TrackRecord &record(int row) const { return records[row]; }
+    const QString &text(quint32 id) const { return textPool.string(id); }
+    Metadata track(int row) const;
+    QString filePath(int row) const;
+    // Path pool ids a record would have for filePath; false if it is in no record
+    bool findPath(const QString &filePath, quint32 &directory, quint32 &fileName);
+
+private:
+    TrackRecord makeRecord(const Metadata &metadata);
+
+    StringPool textPool;
+    StringPool pathPool;
+    QList<TrackRecord> records;
+};
+
+#endif // TRACKSTORE_H
@@ -0,0 +1,47 @@
+#include "metadata.h"
+#include "playlistfiltermodel.h"
+#include "playlistmodel.h"
+#include <QtTest>
+
+// Checks that the search filter follows the playlist as its rows change.
+class PlaylistFilterModelTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void changedRowsAreMatchedAgain();
+};
+
+static Metadata track(int number, const QString &title) {
+    Metadata metadata = MetadataReader::fromFileName(QString("/music/%1.flac").arg(number));
+    metadata.title = title;
+    return metadata;
+}
+
+static QStringList shownTitles(const PlaylistFilterModel &filter) {
+    QStringList titles;
+    for (int row = 0; row < filter.rowCount(); ++row) {
+        titles.append(filter.index(row, PlaylistModel::ColumnTitle).data().toString());
+    }
+    return titles;
+}
+
+void PlaylistFilterModelTest::changedRowsAreMatchedAgain() {
+    PlaylistModel playlist;
+    playlist.addTracks({track(0, "Blue"), track(1, "Red"), track(2, "Green"),
+                        track(3, "Blue moon"), track(4, "Yellow")});
+    PlaylistFilterModel filter(&playlist);
+    filter.setFilterText("blue");
+    QCOMPARE(shownTitles(filter), QStringList({"Blue", "Blue moon"}));
+
+    // Rows 1 and 2 start matching, row 3 stops, in one update
+    playlist.updateTracks({track(1, "Blue sky"), track(2, "Deep blue"), track(3, "Moon")});
+    QCOMPARE(shownTitles(filter), QStringList({"Blue", "Blue sky", "Deep blue"}));
+
+    playlist.updateTracks({track(0, "Grey")});
+    QCOMPARE(shownTitles(filter), QStringList({"Blue sky", "Deep blue"}));
+    QCOMPARE(filter.mapToSource(filter.index(1, 0)).row(), 2);
+    QCOMPARE(filter.mapFromSource(playlist.index(1, 0)).row(), 0);
+}
+
+QTEST_GUILESS_MAIN(PlaylistFilterModelTest)
+#include "playlistfiltermodel_test.moc"
@@ -0,0 +1,86 @@
+#include "metadata.h"
+#include "playlistmodel.h"
+#include "trackstore.h"
+#include <QSignalSpy>
+#include <QtTest>
+
+// Checks for PlaylistModel behaviour that the GUI relies on but that is
+// easy to break from the session restore and batching paths.
+class PlaylistModelTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void restoredRowsDisplayLikeAddedRows_data();
+    void restoredRowsDisplayLikeAddedRows();
+    void updateTracksReplacesMatchingRows();
+};
+
+void PlaylistModelTest::restoredRowsDisplayLikeAddedRows_data() {
+    QTest::addColumn<int>("trackNumber");
+    QTest::addColumn<qint64>("duration");
+
+    QTest::newRow("untagged") << 0 << qint64(0);
+    QTest::newRow("tagged") << 7 << qint64(215000);
+    QTest::newRow("past cached range") << 60000 << qint64(30 * 3600 * 1000);
+}
+
+void PlaylistModelTest::restoredRowsDisplayLikeAddedRows() {
+    QFETCH(int, trackNumber);
+    QFETCH(qint64, duration);
+
+    Metadata metadata;
+    metadata.title = "Title";
+    metadata.artist = "Artist";
+    metadata.album = "Album";
+    metadata.filePath = "/music/Artist/Album/01.flac";
+    metadata.trackNumber = trackNumber;
+    metadata.duration = duration;
+
+    PlaylistModel added;
+    added.addTrack(metadata);
+
+    // Same path as a session restore: a store built outside the model
+    TrackStore store;
+    store.append(metadata);
+    PlaylistModel restored;
+    restored.setTrackStore(std::move(store));
+
+    QCOMPARE(restored.rowCount(), added.rowCount());
+    for (int column = 0; column < PlaylistModel::ColumnCount; ++column) {
+        QCOMPARE(restored.data(restored.index(0, column)).toString(),
+                 added.data(added.index(0, column)).toString());
+    }
+}
+
+void PlaylistModelTest::updateTracksReplacesMatchingRows() {
+    PlaylistModel model;
+    QList<Metadata> placeholders;
+    for (int i = 0; i < 5; ++i) {
+        placeholders.append(MetadataReader::fromFileName(QString("/music/%1.flac").arg(i)));
+    }
+    model.addTracks(placeholders);
+
+    Metadata first = placeholders[1];
+    first.title = "Real title 1";
+    Metadata second = placeholders[2];
+    second.title = "Real title 2";
+    Metadata unknown = MetadataReader::fromFileName("/music/elsewhere.flac");
+    unknown.title = "Not in the playlist";
+
+    QSignalSpy changed(&model, &PlaylistModel::dataChanged);
+    model.updateTracks({second, unknown, first});
+
+    QCOMPARE(model.rowCount(), 5);
+    QCOMPARE(model.getTrack(1).title, QString("Real title 1"));
+    QCOMPARE(model.getTrack(2).title, QString("Real title 2"));
+    QCOMPARE(model.getTrack(0).title, placeholders[0].title);
+    QCOMPARE(model.getTrack(3).title, placeholders[3].title);
+
+    // Neighbouring rows come as one range
+    QCOMPARE(changed.count(), 1);
+    QCOMPARE(changed[0][0].value<QModelIndex>().row(), 1);
+    QCOMPARE(changed[0][1].value<QModelIndex>().row(), 2);
+}
+
+QTEST_GUILESS_MAIN(PlaylistModelTest)
+#include "playlistmodel_test.moc"
@@ -0,0 +1,550 @@
+#include "metadata.h"
+#include "tagparser.h"
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Feeds TagParser small hand-built files for each container it reads,
+// including the truncated and oversized lengths found in damaged downloads,
+// which must be refused rather than read past the end of the mapping.
+class TagParserTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void id3v23WithUnsynchronisationAndExtendedHeader();
+    void id3v24WithFrameUnsynchronisationAndVbri();
+    void id3v1WithConstantBitrate();
+    void id3FrameOverrunningTagStopsFrameScan();
+    void truncatedId3TagIsRefused();
+    void flac();
+    void truncatedFlacIsRefused();
+    void oggVorbis();
+    void opus();
+    void truncatedOggIsRefused();
+    void mp4();
+    void oversizedMp4AtomIsRefused();
+    void wav();
+    void unsizedWavDataIsClampedToFile();
+    void oversizedWavChunkIsRefused();
+    void asf();
+    void oversizedAsfObjectIsRefused();
+    void unknownFormatIsRefused();
+
+private:
+    bool parse(const QByteArray &contents, Metadata &metadata);
+
+    QTemporaryDir dir;
+    int files = 0;
+};
+
+namespace {
+
+void appendBe16(QByteArray &out, quint32 value) {
+    out.append(char(value >> 8)).append(char(value));
+}
+
+void appendBe32(QByteArray &out, quint32 value) {
+    appendBe16(out, value >> 16);
+    appendBe16(out, value);
+}
+
+void appendLe16(QByteArray &out, quint32 value) {
+    out.append(char(value)).append(char(value >> 8));
+}
+
+void appendLe32(QByteArray &out, quint32 value) {
+    appendLe16(out, value);
+    appendLe16(out, value >> 16);
+}
+
+void appendLe64(QByteArray &out, quint64 value) {
+    appendLe32(out, quint32(value));
+    appendLe32(out, quint32(value >> 32));
+}
+
+void appendSyncsafe32(QByteArray &out, quint32 value) {
+    out.append(char((value >> 21) & 0x7f)).append(char((value >> 14) & 0x7f))
+       .append(char((value >> 7) & 0x7f)).append(char(value & 0x7f));
+}
+
+QByteArray unsynchronise(const QByteArray &data) {
+    QByteArray result;
+    for (char c : data) {
+        result.append(c);
+        if (uchar(c) == 0xFF) {
+            result.append('\0');
+        }
+    }
+    return result;
+}
+
+// ID3v2.3 frame: 4-char id, 32-bit size, 16-bit flags
+QByteArray id3v23Frame(const char *id, const QByteArray &body) {
+    QByteArray frame(id, 4);
+    appendBe32(frame, body.size());
+    appendBe16(frame, 0);
+    return frame + body;
+}
+
+QByteArray id3v24Frame(const char *id, const QByteArray &body, quint32 flags = 0) {
+    QByteArray frame(id, 4);
+    appendSyncsafe32(frame, body.size());
+    appendBe16(frame, flags);
+    return frame + body;
+}
+
+QByteArray id3Tag(int version, int flags, const QByteArray &data) {
+    QByteArray tag("ID3");
+    tag.append(char(version)).append('\0').append(char(flags));
+    appendSyncsafe32(tag, data.size());
+    return tag + data;
+}
+
+// MPEG-1 Layer III, 128 kbit/s, 44.1 kHz stereo: 417 bytes, 1152 samples
+const int mpegFrameLength = 417;
+
+QByteArray mpegFrame() {
+    QByteArray frame(mpegFrameLength, '\0');
+    frame[0] = char(0xFF);
+    frame[1] = char(0xFB);
+    frame[2] = char(0x90);
+    return frame;
+}
+
+// The side information of a stereo MPEG-1 frame ends 36 bytes in
+QByteArray mpegFrameWithHeader(const QByteArray &header) {
+    QByteArray frame = mpegFrame();
+    frame.replace(36, header.size(), header);
+    return frame;
+}
+
+QByteArray vorbisComments(const QList<QByteArray> &comments) {
+    const QByteArray vendor("generated");
+    QByteArray block;
+    appendLe32(block, vendor.size());
+    block.append(vendor);
+    appendLe32(block, comments.size());
+    for (const QByteArray &comment : comments) {
+        appendLe32(block, comment.size());
+        block.append(comment);
+    }
+    return block;
+}
+
+QByteArray flacBlock(int type, bool last, const QByteArray &body) {
+    QByteArray block;
+    block.append(char(type | (last ? 0x80 : 0)));
+    block.append(char(body.size() >> 16)).append(char(body.size() >> 8)).append(char(body.size()));
+    return block + body;
+}
+
+QByteArray flacStreamInfo(quint32 sampleRate, quint64 samples) {
+    const int channels = 2, bitsPerSample = 16;
+    QByteArray info(34, '\0');
+    info[10] = char(sampleRate >> 12);
+    info[11] = char(sampleRate >> 4);
+    info[12] = char(((sampleRate & 0x0F) << 4) | ((channels - 1) << 1) | ((bitsPerSample - 1) >> 4));
+    info[13] = char((((bitsPerSample - 1) & 0x0F) << 4) | ((samples >> 32) & 0x0F));
+    QByteArray count;
+    appendBe32(count, quint32(samples));
+    info.replace(14, 4, count);
+    return info;
+}
+
+// One Ogg page holding whole packets
+QByteArray oggPage(quint32 serial, quint32 sequence, quint64 granule, const QList<QByteArray> &packets) {
+    QByteArray lacing;
+    QByteArray body;
+    for (const QByteArray &packet : packets) {
+        lacing.append(QByteArray(packet.size() / 255, char(255)));
+        lacing.append(char(packet.size() % 255));
+        body.append(packet);
+    }
+
+    QByteArray page("OggS");
+    page.append('\0').append(sequence == 0 ? '\x02' : '\0');
+    appendLe64(page, granule);
+    appendLe32(page, serial);
+    appendLe32(page, sequence);
+    appendLe32(page, 0);  // CRC, which the parser doesn't check
+    page.append(char(lacing.size()));
+    return page + lacing + body;
+}
+
+QByteArray oggVorbisFile(quint32 sampleRate, quint64 lastGranule) {
+    QByteArray identification("\x01vorbis");
+    appendLe32(identification, 0);
+    identification.append('\x02');
+    appendLe32(identification, sampleRate);
+    identification.append(QByteArray(12, '\0'));  // Bitrates
+    identification.append('\xB8').append('\x01');
+
+    QByteArray comment = QByteArray("\x03vorbis")
+        + vorbisComments({"TITLE=Ogg title", "artist=Ogg artist"}) + '\x01';
+
+    const quint32 serial = 0x1234;
+    return oggPage(serial, 0, 0, {identification})
+         + oggPage(serial, 1, 0, {comment})
+         + oggPage(serial, 2, lastGranule, {QByteArray(100, '\x55')});
+}
+
+QByteArray atom(const char *type, const QByteArray &payload) {
+    QByteArray result;
+    appendBe32(result, 8 + payload.size());
+    result.append(type, 4);
+    return result + payload;
+}
+
+QByteArray ilstItem(const char *type, const QByteArray &text) {
+    QByteArray data;
+    appendBe32(data, 1);  // UTF-8
+    appendBe32(data, 0);  // Locale
+    return atom(type, atom("data", data + text));
+}
+
+QByteArray mp4File(quint32 timescale, quint32 duration) {
+    QByteArray mvhd(100, '\0');
+    QByteArray times;
+    appendBe32(times, timescale);
+    appendBe32(times, duration);
+    mvhd.replace(12, 8, times);
+
+    const QByteArray ilst = ilstItem("\xa9nam", "MP4 title") + ilstItem("\xa9" "ART", "MP4 artist");
+    const QByteArray hdlr = QByteArray(8, '\0') + "mdirappl" + QByteArray(9, '\0');
+    const QByteArray meta = QByteArray(4, '\0') + atom("hdlr", hdlr) + atom("ilst", ilst);
+    const QByteArray moov = atom("mvhd", mvhd) + atom("udta", atom("meta", meta));
+
+    return atom("ftyp", QByteArray("M4A ") + QByteArray(4, '\0') + "M4A mp42")
+         + atom("mdat", QByteArray(64, '\0'))
+         + atom("moov", moov);
+}
+
+void appendRiffChunk(QByteArray &out, const char *id, const QByteArray &body, quint32 length) {
+    out.append(id, 4);
+    appendLe32(out, length);
+    out.append(body);
+    if (body.size() & 1) {
+        out.append('\0');
+    }
+}
+
+void appendRiffChunk(QByteArray &out, const char *id, const QByteArray &body) {
+    appendRiffChunk(out, id, body, body.size());
+}
+
+// 8 kHz mono 8-bit, so one byte of data is one eighth of a millisecond
+QByteArray wavFile(const QByteArray &info, quint32 infoLength, quint32 dataLength) {
+    QByteArray format;
+    appendLe16(format, 1);     // PCM
+    appendLe16(format, 1);     // Channels
+    appendLe32(format, 8000);  // Sample rate
+    appendLe32(format, 8000);  // Byte rate
+    appendLe16(format, 1);     // Block align
+    appendLe16(format, 8);     // Bits per sample
+
+    QByteArray body("WAVE");
+    appendRiffChunk(body, "fmt ", format);
+    appendRiffChunk(body, "LIST", info, infoLength);
+    appendRiffChunk(body, "data", QByteArray(8000, char(0x80)), dataLength);
+
+    QByteArray wav;
+    appendRiffChunk(wav, "RIFF", body);
+    return wav;
+}
+
+QByteArray wavInfo() {
+    QByteArray info("INFO");
+    appendRiffChunk(info, "INAM", QByteArray("WAV title") + '\0');
+    appendRiffChunk(info, "IART", QByteArray("WAV artist") + '\0');
+    return info;
+}
+
+const char asfHeaderGuid[] = "\x30\x26\xB2\x75\x8E\x66\xCF\x11\xA6\xD9\x00\xAA\x00\x62\xCE\x6C";
+const char asfFilePropertiesGuid[] = "\xA1\xDC\xAB\x8C\x47\xA9\xCF\x11\x8E\xE4\x00\xC0\x0C\x20\x53\x65";
+const char asfContentDescriptionGuid[] = "\x33\x26\xB2\x75\x8E\x66\xCF\x11\xA6\xD9\x00\xAA\x00\x62\xCE\x6C";
+
+QByteArray asfObject(const char *guid, const QByteArray &body, quint64 size = 0) {
+    QByteArray object(guid, 16);
+    appendLe64(object, size ? size : quint64(24 + body.size()));
+    return object + body;
+}
+
+QByteArray utf16le(const QString &text) {
+    QByteArray result;
+    for (QChar c : text) {
+        appendLe16(result, c.unicode());
+    }
+    appendLe16(result, 0);
+    return result;
+}
+
+QByteArray asfFile(quint64 contentDescriptionSize) {
+    // Play duration is in 100 ns units and includes the preroll
+    const quint64 durationMs = 6000, prerollMs = 3000;
+    QByteArray properties(40, '\0');
+    appendLe64(properties, (durationMs + prerollMs) * 10000);
+    appendLe64(properties, 0);  // Send duration
+    appendLe64(properties, prerollMs);
+    properties.append(QByteArray(16, '\0'));
+
+    const QByteArray title = utf16le("ASF title");
+    const QByteArray author = utf16le("ASF artist");
+    QByteArray description;
+    appendLe16(description, title.size());
+    appendLe16(description, author.size());
+    appendLe16(description, 0);
+    appendLe16(description, 0);
+    appendLe16(description, 0);
+    description.append(title).append(author);
+
+    const QByteArray objects = asfObject(asfContentDescriptionGuid, description, contentDescriptionSize)
+                             + asfObject(asfFilePropertiesGuid, properties);
+    QByteArray header(asfHeaderGuid, 16);
+    appendLe64(header, 30 + objects.size());
+    appendLe32(header, 2);
+    header.append('\x01').append('\x02');
+    return header + objects;
+}
+
+} // namespace
+
+bool TagParserTest::parse(const QByteArray &contents, Metadata &metadata) {
+    QFile file(dir.filePath(QString::number(files++)));
+    if (!file.open(QIODevice::WriteOnly) || file.write(contents) != contents.size()) {
+        return false;
+    }
+    file.close();
+    return TagParser::parse(file.fileName(), metadata);
+}
+
+void TagParserTest::id3v23WithUnsynchronisationAndExtendedHeader() {
+    // The 0xFF bytes are followed by a zero once unsynchronised; left in,
+    // that zero would end the Latin-1 title early
+    QByteArray extendedHeader;
+    appendBe32(extendedHeader, 6);
+    extendedHeader.append(QByteArray(6, '\0'));
+    const QByteArray frames = id3v23Frame("TIT2", QByteArray("\0Caf\xE9 \xFF\xFF Mix", 12))
+                            + id3v23Frame("TPE1", QByteArray("\0Artist", 7));
+    const QByteArray tag = id3Tag(3, 0xC0, unsynchronise(extendedHeader + frames + QByteArray(16, '\0')));
+
+    QByteArray xing("Xing");
+    appendBe32(xing, 0x01);
+    appendBe32(xing, 100);
+
+    Metadata metadata;
+    QVERIFY(parse(tag + mpegFrameWithHeader(xing), metadata));
+    QCOMPARE(metadata.title, QString::fromLatin1("Caf\xE9 \xFF\xFF Mix"));
+    QCOMPARE(metadata.artist, QString("Artist"));
+    QCOMPARE(metadata.duration, qint64(100 * 1152 * 1000 / 44100));
+}
+
+void TagParserTest::id3v24WithFrameUnsynchronisationAndVbri() {
+    // Extended header size includes itself, then the flag byte count and flags
+    QByteArray extendedHeader;
+    appendSyncsafe32(extendedHeader, 6);
+    extendedHeader.append('\x01').append('\0');
+
+    // Data length indicator, then the unsynchronised body
+    const QByteArray title("\0Title \xFF\xFF", 9);
+    QByteArray titleBody;
+    appendSyncsafe32(titleBody, title.size());
+    titleBody.append(unsynchronise(title));
+
+    const QByteArray frames = id3v24Frame("TIT2", titleBody, 0x0003)
+                            + id3v24Frame("TPE1", QByteArray("\3Sigur R\xC3\xB3s", 11));
+    const QByteArray tag = id3Tag(4, 0x40, extendedHeader + frames + QByteArray(16, '\0'));
+
+    QByteArray vbri("VBRI");
+    appendBe16(vbri, 1);     // Version
+    appendBe16(vbri, 0);     // Delay
+    appendBe16(vbri, 75);    // Quality
+    appendBe32(vbri, 0);     // Bytes
+    appendBe32(vbri, 200);   // Frames
+
+    Metadata metadata;
+    QVERIFY(parse(tag + mpegFrameWithHeader(vbri), metadata));
+    QCOMPARE(metadata.title, QString::fromLatin1("Title \xFF\xFF"));
+    QCOMPARE(metadata.artist, QString::fromUtf8("Sigur R\xC3\xB3s"));
+    QCOMPARE(metadata.duration, qint64(200 * 1152 * 1000 / 44100));
+}
+
+void TagParserTest::id3v1WithConstantBitrate() {
+    QByteArray id3v1(128, '\0');
+    id3v1.replace(0, 3, "TAG");
+    id3v1.replace(3, 8, "V1 title");
+    id3v1.replace(33, 9, "V1 artist");
+    id3v1[126] = 7;
+
+    QByteArray audio;
+    for (int i = 0; i < 10; ++i) {
+        audio.append(mpegFrame());
+    }
+
+    Metadata metadata;
+    QVERIFY(parse(audio + id3v1, metadata));
+    QCOMPARE(metadata.title, QString("V1 title"));
+    QCOMPARE(metadata.artist, QString("V1 artist"));
+    QCOMPARE(metadata.trackNumber, 7);
+    // The tag isn't counted as audio: 10 frames at 128 bits per millisecond
+    QCOMPARE(metadata.duration, qint64(10 * mpegFrameLength * 8 / 128));
+}
+
+void TagParserTest::id3FrameOverrunningTagStopsFrameScan() {
+    QByteArray oversized("TPE1");
+    appendBe32(oversized, 0x00FFFFFF);
+    appendBe16(oversized, 0);
+    oversized.append(QByteArray("\0Artist", 7));
+    const QByteArray frames = id3v23Frame("TIT2", QByteArray("\0Title", 6)) + oversized
+                            + id3v23Frame("TALB", QByteArray("\0Album", 6));
+
+    Metadata metadata;
+    QVERIFY(parse(id3Tag(3, 0, frames) + mpegFrame() + mpegFrame(), metadata));
+    QCOMPARE(metadata.title, QString("Title"));
+    QVERIFY(metadata.artist.isEmpty());
+    QVERIFY(metadata.album.isEmpty());
+    QVERIFY(metadata.duration > 0);
+}
+
+void TagParserTest::truncatedId3TagIsRefused() {
+    // A TLEN frame can't stand in for the audio when the tag runs past the end
+    const QByteArray frames = id3v23Frame("TIT2", QByteArray("\0Title", 6))
+                            + id3v23Frame("TLEN", QByteArray("\0" "180000", 7));
+    QByteArray tag = id3Tag(3, 0, frames + QByteArray(4096, '\0'));
+    tag.truncate(10 + frames.size() + 100);
+
+    Metadata metadata;
+    QVERIFY(!parse(tag, metadata));
+}
+
+void TagParserTest::flac() {
+    const QByteArray file = QByteArray("fLaC")
+        + flacBlock(0, false, flacStreamInfo(44100, 441000))
+        + flacBlock(1, false, QByteArray(32, '\0'))  // Padding
+        + flacBlock(4, true, vorbisComments({"TITLE=FLAC title", "Artist=FLAC artist", "TRACKNUMBER=3/12"}));
+
+    Metadata metadata;
+    QVERIFY(parse(file, metadata));
+    QCOMPARE(metadata.title, QString("FLAC title"));
+    QCOMPARE(metadata.artist, QString("FLAC artist"));
+    QCOMPARE(metadata.trackNumber, 3);
+    QCOMPARE(metadata.duration, qint64(10000));
+}
+
+void TagParserTest::truncatedFlacIsRefused() {
+    QByteArray file = QByteArray("fLaC") + flacBlock(0, true, flacStreamInfo(44100, 441000));
+    file.truncate(4 + 4 + 20);
+
+    Metadata metadata;
+    QVERIFY(!parse(file, metadata));
+}
+
+void TagParserTest::oggVorbis() {
+    Metadata metadata;
+    QVERIFY(parse(oggVorbisFile(44100, 3 * 44100), metadata));
+    QCOMPARE(metadata.title, QString("Ogg title"));
+    QCOMPARE(metadata.artist, QString("Ogg artist"));
+    QCOMPARE(metadata.duration, qint64(3000));
+}
+
+void TagParserTest::opus() {
+    const quint32 preSkip = 312;
+    QByteArray head("OpusHead");
+    head.append('\x01').append('\x02');
+    appendLe16(head, preSkip);
+    appendLe32(head, 44100);  // Input rate, which doesn't affect granules
+    appendLe16(head, 0);
+    head.append('\0');
+
+    // A comment packet longer than one lacing value
+    const QByteArray tags = QByteArray("OpusTags")
+        + vorbisComments({"TITLE=Opus title", "ARTIST=Opus artist", "COMMENT=" + QByteArray(400, 'x')});
+
+    const quint32 serial = 7;
+    const QByteArray file = oggPage(serial, 0, 0, {head})
+                          + oggPage(serial, 1, 0, {tags})
+                          + oggPage(serial, 2, 2 * 48000 + preSkip, {QByteArray(100, '\x55')});
+
+    Metadata metadata;
+    QVERIFY(parse(file, metadata));
+    QCOMPARE(metadata.title, QString("Opus title"));
+    QCOMPARE(metadata.artist, QString("Opus artist"));
+    QCOMPARE(metadata.duration, qint64(2000));
+}
+
+void TagParserTest::truncatedOggIsRefused() {
+    // Cut inside the comment header page, whose lacing claims more than is left
+    QByteArray file = oggVorbisFile(44100, 3 * 44100);
+    const int secondPage = file.indexOf("OggS", 4);
+    file.truncate(secondPage + 27 + 1 + 10);
+
+    Metadata metadata;
+    QVERIFY(!parse(file, metadata));
+}
+
+void TagParserTest::mp4() {
+    Metadata metadata;
+    QVERIFY(parse(mp4File(1000, 4500), metadata));
+    QCOMPARE(metadata.title, QString("MP4 title"));
+    QCOMPARE(metadata.artist, QString("MP4 artist"));
+    QCOMPARE(metadata.duration, qint64(4500));
+}
+
+void TagParserTest::oversizedMp4AtomIsRefused() {
+    QByteArray file = mp4File(1000, 4500);
+    const int moov = file.indexOf("moov") - 4;
+    QByteArray size;
+    appendBe32(size, 0x7FFFFFFF);
+    file.replace(moov, 4, size);
+
+    Metadata metadata;
+    QVERIFY(!parse(file, metadata));
+}
+
+void TagParserTest::wav() {
+    const QByteArray info = wavInfo();
+    Metadata metadata;
+    QVERIFY(parse(wavFile(info, info.size(), 8000), metadata));
+    QCOMPARE(metadata.title, QString("WAV title"));
+    QCOMPARE(metadata.artist, QString("WAV artist"));
+    QCOMPARE(metadata.duration, qint64(1000));
+}
+
+void TagParserTest::unsizedWavDataIsClampedToFile() {
+    // Streamed recordings leave the data size at its maximum
+    const QByteArray info = wavInfo();
+    Metadata metadata;
+    QVERIFY(parse(wavFile(info, info.size(), 0xFFFFFFFF), metadata));
+    QCOMPARE(metadata.duration, qint64(1000));
+}
+
+void TagParserTest::oversizedWavChunkIsRefused() {
+    // The LIST chunk claims to run past the end, hiding the data chunk
+    Metadata metadata;
+    QVERIFY(!parse(wavFile(wavInfo(), 0x7FFFFFF0, 8000), metadata));
+    QVERIFY(metadata.title.isEmpty());
+}
+
+void TagParserTest::asf() {
+    Metadata metadata;
+    QVERIFY(parse(asfFile(0), metadata));
+    QCOMPARE(metadata.title, QString("ASF title"));
+    QCOMPARE(metadata.artist, QString("ASF artist"));
+    QCOMPARE(metadata.duration, qint64(6000));
+}
+
+void TagParserTest::oversizedAsfObjectIsRefused() {
+    // The file properties object after it is never reached
+    Metadata metadata;
+    QVERIFY(!parse(asfFile(0x7FFFFFFF), metadata));
+    QVERIFY(metadata.title.isEmpty());
+}
+
+void TagParserTest::unknownFormatIsRefused() {
+    Metadata metadata;
+    QVERIFY(!parse(QByteArray("Not an audio file, just some text.\n").repeated(8), metadata));
+    QVERIFY(!parse(QByteArray("ID3\x03"), metadata));
+    QVERIFY(!TagParser::parse(dir.filePath("missing"), metadata));
+}
+
+QTEST_GUILESS_MAIN(TagParserTest)
+#include "tagparser_test.moc"